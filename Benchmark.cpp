@@ -0,0 +1,211 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.cpp
+// ============
+// command line options and results of the offscreen benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// declaration of local helpers
+namespace
+{
+	// value of the percentile of sorted times, nearest rank
+	float Percentile(const std::vector<float>& sortedTimes, int percent)
+	{
+		size_t rank = (sortedTimes.size() * percent + 99) / 100;
+		return sortedTimes[(rank > 0) ? rank - 1 : 0];
+	}
+
+	// write one statistics object, the times must not be empty
+	void WriteStatistics(FILE* file, const char* name, std::vector<float>& times, bool bLast)
+	{
+		std::sort(times.begin(), times.end());
+		double sum = 0.0;
+		for (size_t i = 0; i < times.size(); i++)
+		{
+			sum += times[i];
+		}
+
+		fprintf(file, "\t\"%s\": {\"samples\": %d, \"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+			name,
+			(int)times.size(),
+			times.front(),
+			sum / times.size(),
+			Percentile(times, 50),
+			Percentile(times, 95),
+			Percentile(times, 99),
+			times.back(),
+			bLast ? "" : ",");
+	}
+
+	// escape a string for a JSON string value
+	std::string EscapeJSON(const std::string& text)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if ((text[i] == '"') || (text[i] == '\\'))
+			{
+				escaped += '\\';
+			}
+			if ((unsigned char)text[i] >= 0x20)
+			{
+				escaped += text[i];
+			}
+		}
+		return(escaped);
+	}
+}
+
+/***********************************************************
+ *  ParseBenchmarkOptions()
+ *
+ *  This function is used for reading the benchmark options
+ *  from the command line.  The run is 500 measured frames at
+ *  1000x800 unless the options say otherwise.
+ ***********************************************************/
+bool ParseBenchmarkOptions(int argc, char* argv[], BENCHMARK_OPTIONS& options)
+{
+	options.frames = 500;
+	options.width = 1000;
+	options.height = 800;
+	options.warmupFrames = 30;
+	options.outputFilename = "bench_results.json";
+	options.bGpuCulling = false;
+	options.bOcclusionCulling = false;
+	options.bShaderCache = true;
+	options.bStaticBaking = false;
+	options.bLevelOfDetail = true;
+	options.bPipelinedFrames = false;
+
+	bool bBenchmark = false;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool bHasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--bench") == 0)
+		{
+			bBenchmark = true;
+		}
+		else if (strcmp(argv[i], "--gpu-culling") == 0)
+		{
+			options.bGpuCulling = true;
+		}
+		else if (strcmp(argv[i], "--occlusion-culling") == 0)
+		{
+			options.bGpuCulling = true;
+			options.bOcclusionCulling = true;
+		}
+		else if (strcmp(argv[i], "--no-shader-cache") == 0)
+		{
+			options.bShaderCache = false;
+		}
+		else if (strcmp(argv[i], "--bake-static") == 0)
+		{
+			options.bStaticBaking = true;
+		}
+		else if (strcmp(argv[i], "--no-lod") == 0)
+		{
+			options.bLevelOfDetail = false;
+		}
+		else if (strcmp(argv[i], "--pipelined-frames") == 0)
+		{
+			options.bPipelinedFrames = true;
+		}
+		else if (bHasValue && (strcmp(argv[i], "--frames") == 0))
+		{
+			options.frames = std::max(atoi(argv[++i]), 1);
+		}
+		else if (bHasValue && (strcmp(argv[i], "--width") == 0))
+		{
+			options.width = std::max(atoi(argv[++i]), 1);
+		}
+		else if (bHasValue && (strcmp(argv[i], "--height") == 0))
+		{
+			options.height = std::max(atoi(argv[++i]), 1);
+		}
+		else if (bHasValue && (strcmp(argv[i], "--warmup") == 0))
+		{
+			options.warmupFrames = std::max(atoi(argv[++i]), 0);
+		}
+		else if (bHasValue && (strcmp(argv[i], "--output") == 0))
+		{
+			options.outputFilename = argv[++i];
+		}
+		else if (bHasValue && (strcmp(argv[i], "--play-camera") == 0))
+		{
+			options.cameraTrackFilename = argv[++i];
+		}
+	}
+
+	return(bBenchmark);
+}
+
+/***********************************************************
+ *  WriteBenchmarkResults()
+ *
+ *  This function is used for writing the statistics of a
+ *  benchmark run.  Frames whose GPU time came back late are
+ *  left out of the GPU statistics only.
+ ***********************************************************/
+bool WriteBenchmarkResults(
+	const BENCHMARK_OPTIONS& options,
+	const std::vector<FRAME_TIMING>& frames,
+	float loadShadersMilliseconds,
+	float prepareSceneMilliseconds,
+	const std::string& renderer)
+{
+	if (frames.empty())
+	{
+		std::cout << "Benchmark recorded no frames" << std::endl;
+		return(false);
+	}
+
+	std::vector<float> cpuTimes;
+	std::vector<float> gpuTimes;
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		cpuTimes.push_back(frames[i].cpuMilliseconds);
+		if (frames[i].gpuMilliseconds >= 0.0f)
+		{
+			gpuTimes.push_back(frames[i].gpuMilliseconds);
+		}
+	}
+
+	FILE* file = fopen(options.outputFilename.c_str(), "w");
+	if (NULL == file)
+	{
+		std::cout << "Could not write benchmark results:" << options.outputFilename << std::endl;
+		return(false);
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "\t\"renderer\": \"%s\",\n", EscapeJSON(renderer).c_str());
+	fprintf(file, "\t\"width\": %d,\n", options.width);
+	fprintf(file, "\t\"height\": %d,\n", options.height);
+	fprintf(file, "\t\"frames\": %d,\n", (int)frames.size());
+	fprintf(file, "\t\"cameraTrack\": \"%s\",\n", EscapeJSON(options.cameraTrackFilename).c_str());
+	fprintf(file, "\t\"gpuCulling\": %s,\n", options.bGpuCulling ? "true" : "false");
+	fprintf(file, "\t\"occlusionCulling\": %s,\n", options.bOcclusionCulling ? "true" : "false");
+	fprintf(file, "\t\"shaderCache\": %s,\n", options.bShaderCache ? "true" : "false");
+	fprintf(file, "\t\"staticBaking\": %s,\n", options.bStaticBaking ? "true" : "false");
+	fprintf(file, "\t\"levelOfDetail\": %s,\n", options.bLevelOfDetail ? "true" : "false");
+	fprintf(file, "\t\"pipelinedFrames\": %s,\n", options.bPipelinedFrames ? "true" : "false");
+	fprintf(file, "\t\"loadShadersMs\": %.4f,\n", loadShadersMilliseconds);
+	fprintf(file, "\t\"prepareSceneMs\": %.4f,\n", prepareSceneMilliseconds);
+	WriteStatistics(file, "cpuFrameMs", cpuTimes, gpuTimes.empty());
+	if (!gpuTimes.empty())
+	{
+		WriteStatistics(file, "gpuFrameMs", gpuTimes, true);
+	}
+	fprintf(file, "}\n");
+	fclose(file);
+
+	std::cout << "Saved benchmark results:" << options.outputFilename << std::endl;
+	return(true);
+}
@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.h
+// ============
+// command line options and results of the offscreen benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Profiler.h"
+
+#include <string>
+#include <vector>
+
+// settings of an offscreen benchmark run
+struct BENCHMARK_OPTIONS
+{
+	int frames;
+	int width;
+	int height;
+	// frames rendered after the textures finished streaming
+	// in and before the measured frames start
+	int warmupFrames;
+	std::string outputFilename;
+	// camera track the measured frames follow, or empty for
+	// the default camera
+	std::string cameraTrackFilename;
+	// cull in the compute shader instead of on the CPU
+	bool bGpuCulling;
+	// also cull what the large occluders hide, implies bGpuCulling
+	bool bOcclusionCulling;
+	// load the shader programs from the program binary cache
+	bool bShaderCache;
+	// merge the static objects into pre-transformed meshes
+	bool bStaticBaking;
+	// pick a level of detail per object from its screen size
+	bool bLevelOfDetail;
+	// prepare the next frame while the current one is drawn
+	bool bPipelinedFrames;
+};
+
+// true when the command line asks for a benchmark run, the
+// options are filled from --frames, --width, --height,
+// --warmup, --output, --play-camera, --gpu-culling,
+// --occlusion-culling, --no-shader-cache, --bake-static,
+// --no-lod and --pipelined-frames, or keep their defaults
+bool ParseBenchmarkOptions(int argc, char* argv[], BENCHMARK_OPTIONS& options);
+
+// write the min, mean, percentiles and max of the recorded
+// CPU and GPU frame times as JSON
+bool WriteBenchmarkResults(
+	const BENCHMARK_OPTIONS& options,
+	const std::vector<FRAME_TIMING>& frames,
+	float loadShadersMilliseconds,
+	float prepareSceneMilliseconds,
+	const std::string& renderer);
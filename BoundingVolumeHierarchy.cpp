@@ -0,0 +1,301 @@
+///////////////////////////////////////////////////////////////////////////////
+// boundingvolumehierarchy.cpp
+// ============
+// bounding boxes of the scene objects and view frustum culling
+///////////////////////////////////////////////////////////////////////////////
+
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+
+// declaration of local helpers
+namespace
+{
+	// objects per leaf, testing a few boxes directly is cheaper
+	// than descending further
+	const int MAX_LEAF_OBJECTS = 4;
+
+	AABB MergeAABB(const AABB& a, const AABB& b)
+	{
+		AABB merged;
+		merged.min = glm::min(a.min, b.min);
+		merged.max = glm::max(a.max, b.max);
+		return merged;
+	}
+
+	glm::vec3 AABBCenter(const AABB& bounds)
+	{
+		return (bounds.min + bounds.max) * 0.5f;
+	}
+
+	// result of testing a box against the frustum
+	enum FRUSTUM_TEST
+	{
+		TEST_OUTSIDE = 0,
+		TEST_INTERSECTS,
+		TEST_INSIDE
+	};
+
+	FRUSTUM_TEST TestAABB(const FRUSTUM& frustum, const AABB& bounds)
+	{
+		FRUSTUM_TEST result = TEST_INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& plane = frustum.planes[i];
+
+			// the corner furthest along the plane normal, if it is
+			// outside the whole box is
+			glm::vec3 farCorner(
+				(plane.x >= 0.0f) ? bounds.max.x : bounds.min.x,
+				(plane.y >= 0.0f) ? bounds.max.y : bounds.min.y,
+				(plane.z >= 0.0f) ? bounds.max.z : bounds.min.z);
+			if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), farCorner) + plane.w < 0.0f)
+			{
+				return TEST_OUTSIDE;
+			}
+
+			// the nearest corner decides if the box crosses the plane
+			glm::vec3 nearCorner(
+				(plane.x >= 0.0f) ? bounds.min.x : bounds.max.x,
+				(plane.y >= 0.0f) ? bounds.min.y : bounds.max.y,
+				(plane.z >= 0.0f) ? bounds.min.z : bounds.max.z);
+			if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), nearCorner) + plane.w < 0.0f)
+			{
+				result = TEST_INTERSECTS;
+			}
+		}
+		return result;
+	}
+}
+
+/***********************************************************
+ *  TransformAABB()
+ *
+ *  This function is used for getting the box around a local
+ *  bounding box after it is transformed by a matrix.  The
+ *  center is transformed and the half extents are projected
+ *  onto each world axis.
+ ***********************************************************/
+AABB TransformAABB(const AABB& bounds, const glm::mat4& matrix)
+{
+	glm::vec3 center = AABBCenter(bounds);
+	glm::vec3 extents = (bounds.max - bounds.min) * 0.5f;
+
+	glm::vec3 worldCenter(matrix * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtents;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		worldExtents[axis] =
+			fabsf(matrix[0][axis]) * extents.x +
+			fabsf(matrix[1][axis]) * extents.y +
+			fabsf(matrix[2][axis]) * extents.z;
+	}
+
+	AABB result;
+	result.min = worldCenter - worldExtents;
+	result.max = worldCenter + worldExtents;
+	return result;
+}
+
+/***********************************************************
+ *  ExtractFrustum()
+ *
+ *  This function is used for getting the six clip planes
+ *  from a combined projection * view matrix.  Each plane is
+ *  a sum or difference of the matrix rows, which works for
+ *  perspective and orthographic projections alike.
+ ***********************************************************/
+FRUSTUM ExtractFrustum(const glm::mat4& viewProjection)
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	FRUSTUM frustum;
+	frustum.planes[0] = rows[3] + rows[0];	// left
+	frustum.planes[1] = rows[3] - rows[0];	// right
+	frustum.planes[2] = rows[3] + rows[1];	// bottom
+	frustum.planes[3] = rows[3] - rows[1];	// top
+	frustum.planes[4] = rows[3] + rows[2];	// near
+	frustum.planes[5] = rows[3] - rows[2];	// far
+	return frustum;
+}
+
+/***********************************************************
+ *  BoundingVolumeHierarchy()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+{
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for building the tree from scratch
+ *  over the passed in object bounds.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Build(const std::vector<AABB>& objectBounds)
+{
+	const int objectCount = (int)objectBounds.size();
+
+	m_objectBounds = objectBounds;
+	m_nodes.clear();
+	m_objectOrder.resize(objectCount);
+	for (int i = 0; i < objectCount; i++)
+	{
+		m_objectOrder[i] = i;
+	}
+	if (objectCount == 0)
+	{
+		return;
+	}
+
+	// a binary tree with small leaves never needs more nodes
+	m_nodes.reserve(objectCount * 2);
+	m_nodes.push_back(BVH_NODE());
+	BuildNode(objectBounds, 0, 0, objectCount);
+}
+
+/***********************************************************
+ *  BuildNode()
+ *
+ *  This method is used for filling in a node over a range of
+ *  objects.  Large ranges are split at the median of the
+ *  object centers along the longest axis, and both children
+ *  are allocated together so the second follows the first.
+ ***********************************************************/
+void BoundingVolumeHierarchy::BuildNode(const std::vector<AABB>& objectBounds, int node, int firstObject, int objectCount)
+{
+	AABB bounds = objectBounds[m_objectOrder[firstObject]];
+	glm::vec3 centerMin = AABBCenter(bounds);
+	glm::vec3 centerMax = centerMin;
+	for (int i = firstObject + 1; i < firstObject + objectCount; i++)
+	{
+		const AABB& objectBox = objectBounds[m_objectOrder[i]];
+		bounds = MergeAABB(bounds, objectBox);
+		centerMin = glm::min(centerMin, AABBCenter(objectBox));
+		centerMax = glm::max(centerMax, AABBCenter(objectBox));
+	}
+
+	m_nodes[node].bounds = bounds;
+	m_nodes[node].firstChild = -1;
+	m_nodes[node].firstObject = firstObject;
+	m_nodes[node].objectCount = objectCount;
+
+	glm::vec3 spread = centerMax - centerMin;
+	int axis = 0;
+	if (spread.y > spread[axis])
+		axis = 1;
+	if (spread.z > spread[axis])
+		axis = 2;
+	if ((objectCount <= MAX_LEAF_OBJECTS) || (spread[axis] <= 0.0f))
+	{
+		return;
+	}
+
+	int half = objectCount / 2;
+	std::vector<int>::iterator first = m_objectOrder.begin() + firstObject;
+	std::nth_element(first, first + half, first + objectCount,
+		[&objectBounds, axis](int a, int b)
+		{
+			return AABBCenter(objectBounds[a])[axis] < AABBCenter(objectBounds[b])[axis];
+		});
+
+	int firstChild = (int)m_nodes.size();
+	m_nodes.push_back(BVH_NODE());
+	m_nodes.push_back(BVH_NODE());
+	m_nodes[node].firstChild = firstChild;
+	BuildNode(objectBounds, firstChild, firstObject, half);
+	BuildNode(objectBounds, firstChild + 1, firstObject + half, objectCount - half);
+}
+
+/***********************************************************
+ *  Refit()
+ *
+ *  This method is used for recomputing the node bounds after
+ *  objects moved.  Children always come after their parent,
+ *  so walking the nodes back to front finishes every child
+ *  before its parent is merged.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Refit(const std::vector<AABB>& objectBounds)
+{
+	if ((int)objectBounds.size() != GetObjectCount())
+	{
+		Build(objectBounds);
+		return;
+	}
+	m_objectBounds = objectBounds;
+
+	for (int node = (int)m_nodes.size() - 1; node >= 0; node--)
+	{
+		BVH_NODE& current = m_nodes[node];
+		if (current.firstChild >= 0)
+		{
+			current.bounds = MergeAABB(m_nodes[current.firstChild].bounds, m_nodes[current.firstChild + 1].bounds);
+			continue;
+		}
+
+		current.bounds = objectBounds[m_objectOrder[current.firstObject]];
+		for (int i = current.firstObject + 1; i < current.firstObject + current.objectCount; i++)
+		{
+			current.bounds = MergeAABB(current.bounds, objectBounds[m_objectOrder[i]]);
+		}
+	}
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for collecting the objects whose
+ *  bounds touch the frustum.  Subtrees entirely outside are
+ *  skipped and subtrees entirely inside are added without
+ *  testing anything below them.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Cull(const FRUSTUM& frustum, std::vector<int>& visibleObjects) const
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	std::vector<int> stack;
+	stack.reserve(64);
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const BVH_NODE& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		FRUSTUM_TEST test = TestAABB(frustum, node.bounds);
+		if (test == TEST_OUTSIDE)
+		{
+			continue;
+		}
+		if (test == TEST_INSIDE)
+		{
+			visibleObjects.insert(visibleObjects.end(),
+				m_objectOrder.begin() + node.firstObject,
+				m_objectOrder.begin() + node.firstObject + node.objectCount);
+			continue;
+		}
+		if (node.firstChild < 0)
+		{
+			for (int i = node.firstObject; i < node.firstObject + node.objectCount; i++)
+			{
+				if (TestAABB(frustum, m_objectBounds[m_objectOrder[i]]) != TEST_OUTSIDE)
+				{
+					visibleObjects.push_back(m_objectOrder[i]);
+				}
+			}
+			continue;
+		}
+
+		stack.push_back(node.firstChild + 1);
+		stack.push_back(node.firstChild);
+	}
+}
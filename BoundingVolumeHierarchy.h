@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// boundingvolumehierarchy.h
+// ============
+// bounding boxes of the scene objects and view frustum culling
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// axis aligned bounding box
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// the six planes of a view frustum, every plane is stored as
+// (normal, distance) with the normal pointing inside
+struct FRUSTUM
+{
+	glm::vec4 planes[6];
+};
+
+// transform a local bounding box into a box around the result
+AABB TransformAABB(const AABB& bounds, const glm::mat4& matrix);
+// get the frustum planes of a projection * view matrix
+FRUSTUM ExtractFrustum(const glm::mat4& viewProjection);
+
+/***********************************************************
+ *  BoundingVolumeHierarchy
+ *
+ *  This class keeps a binary tree of bounding boxes over the
+ *  scene objects.  Every node covers a contiguous range of
+ *  the object order, so a node that is entirely inside the
+ *  frustum adds its whole range without testing the objects
+ *  below it, and a node that is outside skips them all.
+ *  Children are stored after their parent, so a refit after
+ *  objects move is a single back to front pass.
+ ***********************************************************/
+class BoundingVolumeHierarchy
+{
+public:
+	// constructor
+	BoundingVolumeHierarchy();
+
+	// build the tree over the passed in object bounds
+	void Build(const std::vector<AABB>& objectBounds);
+	// update the node bounds after objects moved, the tree
+	// shape is kept so the object count must not change
+	void Refit(const std::vector<AABB>& objectBounds);
+	// append the objects that touch the frustum
+	void Cull(const FRUSTUM& frustum, std::vector<int>& visibleObjects) const;
+
+	int GetObjectCount() const { return (int)m_objectOrder.size(); }
+
+private:
+	struct BVH_NODE
+	{
+		AABB bounds;
+		// first child, the second child follows it, or -1 for a leaf
+		int firstChild;
+		// range of m_objectOrder covered by the node
+		int firstObject;
+		int objectCount;
+	};
+
+	std::vector<BVH_NODE> m_nodes;
+	// object indexes, grouped so every node covers a range
+	std::vector<int> m_objectOrder;
+	// bounds of every object, for testing the objects of a leaf
+	std::vector<AABB> m_objectBounds;
+
+	void BuildNode(const std::vector<AABB>& objectBounds, int node, int firstObject, int objectCount);
+};
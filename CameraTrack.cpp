@@ -0,0 +1,201 @@
+///////////////////////////////////////////////////////////////////////////////
+// cameratrack.cpp
+// ============
+// timestamped camera keys for recording and replaying flythroughs
+///////////////////////////////////////////////////////////////////////////////
+
+#include "CameraTrack.h"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// declaration of local helpers
+namespace
+{
+	// Catmull-Rom spline through p1 and p2 at t in [0, 1]
+	template <typename T>
+	T CatmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+	{
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return ((p1 * 2.0f) +
+			(p2 - p0) * t +
+			(p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 +
+			(p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+	}
+}
+
+/***********************************************************
+ *  CameraTrack()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+CameraTrack::CameraTrack()
+{
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void CameraTrack::Clear()
+{
+	m_keys.clear();
+}
+
+/***********************************************************
+ *  AddKey()
+ ***********************************************************/
+void CameraTrack::AddKey(const CAMERA_KEY& key)
+{
+	if (!m_keys.empty() && (key.time < m_keys.back().time))
+	{
+		return;
+	}
+	m_keys.push_back(key);
+}
+
+/***********************************************************
+ *  Load()
+ *
+ *  This method is used for reading a track file.  Blank
+ *  lines and everything after a # are ignored.
+ ***********************************************************/
+bool CameraTrack::Load(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open camera track:" << filename << std::endl;
+		return false;
+	}
+
+	Clear();
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		// strip comments
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		if (!(tokens >> keyword))
+			continue;
+
+		CAMERA_KEY key;
+		std::string projection;
+		if ((keyword != "key") ||
+			!(tokens >> key.time >> key.position.x >> key.position.y >> key.position.z
+				>> key.yaw >> key.pitch >> key.zoom >> projection) ||
+			((projection != "perspective") && (projection != "orthographic")) ||
+			(!m_keys.empty() && (key.time < m_keys.back().time)))
+		{
+			std::cout << filename << "(" << lineNumber << "): bad camera key" << std::endl;
+			return false;
+		}
+		key.bOrthographic = (projection == "orthographic");
+		m_keys.push_back(key);
+	}
+
+	if (m_keys.empty())
+	{
+		std::cout << "Camera track has no keys:" << filename << std::endl;
+		return false;
+	}
+
+	std::cout << "Loaded camera track:" << filename << ", keys:" << m_keys.size() << ", seconds:" << GetDuration() << std::endl;
+	return true;
+}
+
+/***********************************************************
+ *  Save()
+ ***********************************************************/
+bool CameraTrack::Save(const char* filename) const
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write camera track:" << filename << std::endl;
+		return false;
+	}
+
+	file << "# camera track, one key per line" << std::endl;
+	file << "# key <time> <x> <y> <z> <yaw> <pitch> <zoom> <perspective|orthographic>" << std::endl;
+	file.precision(6);
+	for (size_t i = 0; i < m_keys.size(); i++)
+	{
+		const CAMERA_KEY& key = m_keys[i];
+		file << "key " << key.time << " "
+			<< key.position.x << " " << key.position.y << " " << key.position.z << " "
+			<< key.yaw << " " << key.pitch << " " << key.zoom << " "
+			<< (key.bOrthographic ? "orthographic" : "perspective") << std::endl;
+	}
+
+	std::cout << "Saved camera track:" << filename << ", keys:" << m_keys.size() << std::endl;
+	return true;
+}
+
+/***********************************************************
+ *  Sample()
+ *
+ *  This method is used for getting the camera at a point of
+ *  the track.  The keys on either side of the time and their
+ *  neighbours are the control points of the spline, the ends
+ *  of the track repeat the first and last key.
+ ***********************************************************/
+bool CameraTrack::Sample(float time, CAMERA_KEY& key) const
+{
+	if (m_keys.empty())
+	{
+		return false;
+	}
+
+	const float duration = GetDuration();
+	if (duration > 0.0f)
+	{
+		time = std::fmod(time, duration);
+		if (time < 0.0f)
+			time += duration;
+	}
+	else
+	{
+		time = 0.0f;
+	}
+
+	// the last key at or before the time
+	size_t next = 1;
+	while ((next < m_keys.size()) && (m_keys[next].time <= time))
+	{
+		next++;
+	}
+	if (next >= m_keys.size())
+	{
+		key = m_keys.back();
+		key.time = time;
+		return true;
+	}
+
+	const CAMERA_KEY& k1 = m_keys[next - 1];
+	const CAMERA_KEY& k2 = m_keys[next];
+	const CAMERA_KEY& k0 = (next >= 2) ? m_keys[next - 2] : k1;
+	const CAMERA_KEY& k3 = (next + 1 < m_keys.size()) ? m_keys[next + 1] : k2;
+
+	float span = k2.time - k1.time;
+	float t = (span > 0.0f) ? (time - k1.time) / span : 0.0f;
+
+	key.time = time;
+	key.position = CatmullRom(k0.position, k1.position, k2.position, k3.position, t);
+	key.yaw = CatmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, t);
+	key.pitch = CatmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, t);
+	key.zoom = CatmullRom(k0.zoom, k1.zoom, k2.zoom, k3.zoom, t);
+	key.bOrthographic = k1.bOrthographic;
+	return true;
+}
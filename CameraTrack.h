@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// cameratrack.h
+// ============
+// timestamped camera keys for recording and replaying flythroughs
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// the camera state at one point of a track
+struct CAMERA_KEY
+{
+	// seconds from the start of the track
+	float time;
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+	float zoom;
+	bool bOrthographic;
+};
+
+/***********************************************************
+ *  CameraTrack
+ *
+ *  This class keeps a camera path as keys in time order.  The
+ *  position and angles between keys follow a Catmull-Rom
+ *  spline through the keys, the projection mode switches at
+ *  a key.  Tracks are stored as text, one key per line:
+ *
+ *    key <time> <x> <y> <z> <yaw> <pitch> <zoom> <perspective|orthographic>
+ ***********************************************************/
+class CameraTrack
+{
+public:
+	// constructor
+	CameraTrack();
+
+	void Clear();
+	// add a key, its time must not be before the last key
+	void AddKey(const CAMERA_KEY& key);
+
+	bool Load(const char* filename);
+	bool Save(const char* filename) const;
+
+	// get the camera at a time, times past the end wrap
+	// around to the start
+	bool Sample(float time, CAMERA_KEY& key) const;
+
+	size_t Count() const { return m_keys.size(); }
+	float GetDuration() const { return m_keys.empty() ? 0.0f : m_keys.back().time; }
+
+private:
+	std::vector<CAMERA_KEY> m_keys;
+};
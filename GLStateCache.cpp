@@ -0,0 +1,487 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstatecache.cpp
+// ============
+// shadow copy of the OpenGL state that drops redundant calls
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GLStateCache.h"
+
+#include <cstring>
+
+// the state cache of the OpenGL context
+GLStateCache g_GLState;
+
+/***********************************************************
+ *  GLStateCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GLStateCache::GLStateCache()
+{
+	m_frameStats.issued = 0;
+	m_frameStats.suppressed = 0;
+	m_lastFrameStats = m_frameStats;
+	Invalidate();
+}
+
+/***********************************************************
+ *  Invalidate()
+ *
+ *  This method is used for forgetting every shadowed value.
+ *  The capability and binding lists keep their entries, only
+ *  the values are marked unknown.
+ ***********************************************************/
+void GLStateCache::Invalidate()
+{
+	for (size_t i = 0; i < m_capabilities.size(); i++)
+	{
+		m_capabilities[i].enabled = -1;
+	}
+	m_depthFunc = UNKNOWN;
+	m_depthMask = -1;
+	m_blendSource = UNKNOWN;
+	m_blendDestination = UNKNOWN;
+	m_bClearColorKnown = false;
+
+	m_program = UNKNOWN;
+	m_vertexArray = UNKNOWN;
+	m_activeTexture = -1;
+	for (int unit = 0; unit < MAX_CACHED_TEXTURE_UNITS; unit++)
+	{
+		for (size_t i = 0; i < m_textures[unit].size(); i++)
+		{
+			m_textures[unit][i].texture = UNKNOWN;
+		}
+	}
+	for (size_t i = 0; i < m_buffers.size(); i++)
+	{
+		m_buffers[i].buffer = UNKNOWN;
+		for (int index = 0; index < MAX_CACHED_BUFFER_BINDINGS; index++)
+		{
+			m_buffers[i].indexed[index] = UNKNOWN;
+		}
+	}
+
+	m_uniforms.clear();
+}
+
+/***********************************************************
+ *  ForgetProgram()
+ *
+ *  This method is used for dropping the uniform values kept
+ *  for a program.  Linking resets every uniform, and a
+ *  deleted program name can be handed out again.
+ ***********************************************************/
+void GLStateCache::ForgetProgram(GLuint programID)
+{
+	for (auto it = m_uniforms.begin(); it != m_uniforms.end();)
+	{
+		if ((GLuint)(it->first >> 32) == programID)
+		{
+			it = m_uniforms.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	if (m_program == programID)
+	{
+		m_program = UNKNOWN;
+	}
+}
+
+/***********************************************************
+ *  EndFrame()
+ ***********************************************************/
+void GLStateCache::EndFrame()
+{
+	m_lastFrameStats = m_frameStats;
+	m_frameStats.issued = 0;
+	m_frameStats.suppressed = 0;
+}
+
+/***********************************************************
+ *  Issue()
+ *
+ *  This method is used for counting a call as issued or as
+ *  suppressed, it returns whether the call must be made.
+ ***********************************************************/
+bool GLStateCache::Issue(bool bChanged)
+{
+	if (bChanged)
+	{
+		m_frameStats.issued++;
+	}
+	else
+	{
+		m_frameStats.suppressed++;
+	}
+	return(bChanged);
+}
+
+/***********************************************************
+ *  FindCapability()
+ *
+ *  This method is used for finding the shadowed value of a
+ *  capability, a capability seen for the first time is added
+ *  as unknown.  Only a handful are ever used, so a linear
+ *  search is the fastest lookup.
+ ***********************************************************/
+GLStateCache::CAPABILITY_STATE& GLStateCache::FindCapability(GLenum capability)
+{
+	for (size_t i = 0; i < m_capabilities.size(); i++)
+	{
+		if (m_capabilities[i].capability == capability)
+		{
+			return(m_capabilities[i]);
+		}
+	}
+
+	CAPABILITY_STATE state;
+	state.capability = capability;
+	state.enabled = -1;
+	m_capabilities.push_back(state);
+	return(m_capabilities.back());
+}
+
+/***********************************************************
+ *  FindBufferTarget()
+ ***********************************************************/
+GLStateCache::BUFFER_TARGET_STATE& GLStateCache::FindBufferTarget(GLenum target)
+{
+	for (size_t i = 0; i < m_buffers.size(); i++)
+	{
+		if (m_buffers[i].target == target)
+		{
+			return(m_buffers[i]);
+		}
+	}
+
+	BUFFER_TARGET_STATE state;
+	state.target = target;
+	state.buffer = UNKNOWN;
+	for (int index = 0; index < MAX_CACHED_BUFFER_BINDINGS; index++)
+	{
+		state.indexed[index] = UNKNOWN;
+	}
+	m_buffers.push_back(state);
+	return(m_buffers.back());
+}
+
+/***********************************************************
+ *  Enable()
+ ***********************************************************/
+void GLStateCache::Enable(GLenum capability)
+{
+	CAPABILITY_STATE& state = FindCapability(capability);
+	if (Issue(state.enabled != 1))
+	{
+		glEnable(capability);
+		state.enabled = 1;
+	}
+}
+
+/***********************************************************
+ *  Disable()
+ ***********************************************************/
+void GLStateCache::Disable(GLenum capability)
+{
+	CAPABILITY_STATE& state = FindCapability(capability);
+	if (Issue(state.enabled != 0))
+	{
+		glDisable(capability);
+		state.enabled = 0;
+	}
+}
+
+/***********************************************************
+ *  DepthFunc()
+ ***********************************************************/
+void GLStateCache::DepthFunc(GLenum function)
+{
+	if (Issue(m_depthFunc != function))
+	{
+		glDepthFunc(function);
+		m_depthFunc = function;
+	}
+}
+
+/***********************************************************
+ *  DepthMask()
+ ***********************************************************/
+void GLStateCache::DepthMask(GLboolean bWrite)
+{
+	int write = (bWrite != GL_FALSE) ? 1 : 0;
+	if (Issue(m_depthMask != write))
+	{
+		glDepthMask(bWrite);
+		m_depthMask = write;
+	}
+}
+
+/***********************************************************
+ *  BlendFunc()
+ ***********************************************************/
+void GLStateCache::BlendFunc(GLenum sourceFactor, GLenum destinationFactor)
+{
+	if (Issue((m_blendSource != sourceFactor) || (m_blendDestination != destinationFactor)))
+	{
+		glBlendFunc(sourceFactor, destinationFactor);
+		m_blendSource = sourceFactor;
+		m_blendDestination = destinationFactor;
+	}
+}
+
+/***********************************************************
+ *  ClearColor()
+ ***********************************************************/
+void GLStateCache::ClearColor(float red, float green, float blue, float alpha)
+{
+	bool bChanged = !m_bClearColorKnown ||
+		(m_clearColor[0] != red) || (m_clearColor[1] != green) ||
+		(m_clearColor[2] != blue) || (m_clearColor[3] != alpha);
+	if (Issue(bChanged))
+	{
+		glClearColor(red, green, blue, alpha);
+		m_clearColor[0] = red;
+		m_clearColor[1] = green;
+		m_clearColor[2] = blue;
+		m_clearColor[3] = alpha;
+		m_bClearColorKnown = true;
+	}
+}
+
+/***********************************************************
+ *  UseProgram()
+ ***********************************************************/
+void GLStateCache::UseProgram(GLuint programID)
+{
+	if (Issue(m_program != programID))
+	{
+		glUseProgram(programID);
+		m_program = programID;
+	}
+}
+
+/***********************************************************
+ *  BindVertexArray()
+ ***********************************************************/
+void GLStateCache::BindVertexArray(GLuint vertexArray)
+{
+	if (Issue(m_vertexArray != vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+		m_vertexArray = vertexArray;
+	}
+}
+
+/***********************************************************
+ *  ActiveTexture()
+ *
+ *  This method is used for selecting a texture unit by its
+ *  index, not by its GL_TEXTURE0 based enum.
+ ***********************************************************/
+void GLStateCache::ActiveTexture(int unit)
+{
+	if (Issue(m_activeTexture != unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + (GLenum)unit);
+		m_activeTexture = unit;
+	}
+}
+
+/***********************************************************
+ *  BindTexture()
+ *
+ *  This method is used for binding a texture to a target of
+ *  the passed in unit.  The active unit is only changed when
+ *  the binding itself changes.
+ ***********************************************************/
+void GLStateCache::BindTexture(int unit, GLenum target, GLuint texture)
+{
+	if ((unit < 0) || (unit >= MAX_CACHED_TEXTURE_UNITS))
+	{
+		Issue(true);
+		glActiveTexture(GL_TEXTURE0 + (GLenum)unit);
+		glBindTexture(target, texture);
+		m_activeTexture = unit;
+		return;
+	}
+
+	std::vector<TEXTURE_BINDING>& bindings = m_textures[unit];
+	TEXTURE_BINDING* binding = NULL;
+	for (size_t i = 0; i < bindings.size(); i++)
+	{
+		if (bindings[i].target == target)
+		{
+			binding = &bindings[i];
+			break;
+		}
+	}
+	if (NULL == binding)
+	{
+		TEXTURE_BINDING newBinding;
+		newBinding.target = target;
+		newBinding.texture = UNKNOWN;
+		bindings.push_back(newBinding);
+		binding = &bindings.back();
+	}
+
+	if (Issue(binding->texture != texture))
+	{
+		ActiveTexture(unit);
+		glBindTexture(target, texture);
+		binding->texture = texture;
+	}
+}
+
+void GLStateCache::BindTexture(GLenum target, GLuint texture)
+{
+	if (m_activeTexture < 0)
+	{
+		ActiveTexture(0);
+	}
+	BindTexture(m_activeTexture, target, texture);
+}
+
+/***********************************************************
+ *  BindBuffer()
+ ***********************************************************/
+void GLStateCache::BindBuffer(GLenum target, GLuint buffer)
+{
+	// the element buffer belongs to the bound vertex array
+	if (target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		Issue(true);
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	BUFFER_TARGET_STATE& state = FindBufferTarget(target);
+	if (Issue(state.buffer != buffer))
+	{
+		glBindBuffer(target, buffer);
+		state.buffer = buffer;
+	}
+}
+
+/***********************************************************
+ *  BindBufferBase()
+ *
+ *  This method is used for binding a buffer to an indexed
+ *  binding point.  OpenGL binds it to the generic target as
+ *  well, so that binding is updated too.
+ ***********************************************************/
+void GLStateCache::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	BUFFER_TARGET_STATE& state = FindBufferTarget(target);
+	if (index >= (GLuint)MAX_CACHED_BUFFER_BINDINGS)
+	{
+		Issue(true);
+		glBindBufferBase(target, index, buffer);
+		state.buffer = buffer;
+		return;
+	}
+
+	if (Issue(state.indexed[index] != buffer))
+	{
+		glBindBufferBase(target, index, buffer);
+		state.indexed[index] = buffer;
+		state.buffer = buffer;
+	}
+}
+
+/***********************************************************
+ *  DeleteTextures()
+ *
+ *  This method is used for deleting textures and forgetting
+ *  the units they were bound to.
+ ***********************************************************/
+void GLStateCache::DeleteTextures(GLsizei count, const GLuint* textures)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (int unit = 0; unit < MAX_CACHED_TEXTURE_UNITS; unit++)
+		{
+			for (size_t j = 0; j < m_textures[unit].size(); j++)
+			{
+				if (m_textures[unit][j].texture == textures[i])
+				{
+					m_textures[unit][j].texture = UNKNOWN;
+				}
+			}
+		}
+	}
+	Issue(true);
+	glDeleteTextures(count, textures);
+}
+
+/***********************************************************
+ *  DeleteBuffers()
+ ***********************************************************/
+void GLStateCache::DeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (size_t j = 0; j < m_buffers.size(); j++)
+		{
+			BUFFER_TARGET_STATE& state = m_buffers[j];
+			if (state.buffer == buffers[i])
+			{
+				state.buffer = UNKNOWN;
+			}
+			for (int index = 0; index < MAX_CACHED_BUFFER_BINDINGS; index++)
+			{
+				if (state.indexed[index] == buffers[i])
+				{
+					state.indexed[index] = UNKNOWN;
+				}
+			}
+		}
+	}
+	Issue(true);
+	glDeleteBuffers(count, buffers);
+}
+
+/***********************************************************
+ *  DeleteVertexArrays()
+ ***********************************************************/
+void GLStateCache::DeleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+{
+	for (GLsizei i = 0; i < count; i++)
+	{
+		if (m_vertexArray == vertexArrays[i])
+		{
+			m_vertexArray = UNKNOWN;
+		}
+	}
+	Issue(true);
+	glDeleteVertexArrays(count, vertexArrays);
+}
+
+/***********************************************************
+ *  UniformChanged()
+ *
+ *  This method is used for comparing a uniform value with
+ *  the one last set.  Values are compared as bytes, so the
+ *  caller passes the exact data it hands to glUniform.
+ ***********************************************************/
+bool GLStateCache::UniformChanged(GLuint programID, GLint location, const void* value, size_t size)
+{
+	if ((location < 0) || (size > sizeof(UNIFORM_VALUE::data)))
+	{
+		// -1 is ignored by OpenGL, oversized values are not kept
+		return(Issue(location >= 0));
+	}
+
+	uint64_t key = ((uint64_t)programID << 32) | (uint32_t)location;
+	UNIFORM_VALUE& cached = m_uniforms[key];
+	bool bChanged = (cached.size != size) || (0 != memcmp(cached.data, value, size));
+	if (bChanged)
+	{
+		cached.size = (uint32_t)size;
+		memcpy(cached.data, value, size);
+	}
+	return(Issue(bChanged));
+}
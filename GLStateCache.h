@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////////////
+// glstatecache.h
+// ============
+// shadow copy of the OpenGL state that drops redundant calls
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// texture units the cache tracks, binds to higher units are
+// passed straight through
+const int MAX_CACHED_TEXTURE_UNITS = 32;
+// indexed binding points tracked per buffer target
+const int MAX_CACHED_BUFFER_BINDINGS = 16;
+
+// OpenGL calls of one frame, suppressed calls are the ones
+// dropped because they would not have changed anything
+struct GL_STATE_STATS
+{
+	int issued;
+	int suppressed;
+};
+
+/***********************************************************
+ *  GLStateCache
+ *
+ *  This class keeps the last value passed for the capability
+ *  enables, the depth and blend functions, the bound program,
+ *  vertex array, textures and buffers, and the uniforms of
+ *  every program, and only calls OpenGL when a value changes.
+ *  Every state change of the renderer must go through it, or
+ *  the shadow copy falls out of step; Invalidate() forgets
+ *  everything after code that did not.
+ *
+ *  GL_ELEMENT_ARRAY_BUFFER is part of the bound vertex array
+ *  and is always passed through.  Deleting objects through
+ *  the cache clears the bindings that used them, so a reused
+ *  name is bound again.
+ ***********************************************************/
+class GLStateCache
+{
+public:
+	// constructor
+	GLStateCache();
+
+	// forget every shadowed value, the next call of each kind
+	// always reaches OpenGL
+	void Invalidate();
+	// forget the uniform values of a program that was relinked
+	// or deleted
+	void ForgetProgram(GLuint programID);
+
+	// start counting the calls of a new frame
+	void EndFrame();
+	// calls of the last finished frame
+	const GL_STATE_STATS& GetFrameStats() const { return m_lastFrameStats; }
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void DepthFunc(GLenum function);
+	void DepthMask(GLboolean bWrite);
+	void BlendFunc(GLenum sourceFactor, GLenum destinationFactor);
+	void ClearColor(float red, float green, float blue, float alpha);
+
+	void UseProgram(GLuint programID);
+	void BindVertexArray(GLuint vertexArray);
+	void ActiveTexture(int unit);
+	// bind to the passed in unit, or to the active unit
+	void BindTexture(int unit, GLenum target, GLuint texture);
+	void BindTexture(GLenum target, GLuint texture);
+	void BindBuffer(GLenum target, GLuint buffer);
+	void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	void DeleteTextures(GLsizei count, const GLuint* textures);
+	void DeleteBuffers(GLsizei count, const GLuint* buffers);
+	void DeleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+
+	// true when the uniform at the location of the program does
+	// not already hold the passed in value, which is then kept;
+	// a location of -1 is never set
+	bool UniformChanged(GLuint programID, GLint location, const void* value, size_t size);
+
+private:
+	// marks a value the cache does not know
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+	// the last value of a capability, -1 when not known
+	struct CAPABILITY_STATE
+	{
+		GLenum capability;
+		int enabled;
+	};
+
+	// the buffer bound to a generic target and to its indexed
+	// binding points
+	struct BUFFER_TARGET_STATE
+	{
+		GLenum target;
+		GLuint buffer;
+		GLuint indexed[MAX_CACHED_BUFFER_BINDINGS];
+	};
+
+	// the texture bound to one target of one unit
+	struct TEXTURE_BINDING
+	{
+		GLenum target;
+		GLuint texture;
+	};
+
+	// the bytes last set to one uniform
+	struct UNIFORM_VALUE
+	{
+		uint32_t size;
+		uint32_t data[16];
+	};
+
+	std::vector<CAPABILITY_STATE> m_capabilities;
+	GLenum m_depthFunc;
+	int m_depthMask;
+	GLenum m_blendSource;
+	GLenum m_blendDestination;
+	float m_clearColor[4];
+	bool m_bClearColorKnown;
+
+	GLuint m_program;
+	GLuint m_vertexArray;
+	int m_activeTexture;
+	std::vector<TEXTURE_BINDING> m_textures[MAX_CACHED_TEXTURE_UNITS];
+	std::vector<BUFFER_TARGET_STATE> m_buffers;
+
+	// keyed by program in the high and location in the low bits
+	std::unordered_map<uint64_t, UNIFORM_VALUE> m_uniforms;
+
+	GL_STATE_STATS m_frameStats;
+	GL_STATE_STATS m_lastFrameStats;
+
+	CAPABILITY_STATE& FindCapability(GLenum capability);
+	BUFFER_TARGET_STATE& FindBufferTarget(GLenum target);
+	// count a call, true when it has to reach OpenGL
+	bool Issue(bool bChanged);
+};
+
+// the state cache of the OpenGL context
+extern GLStateCache g_GLState;
@@ -0,0 +1,343 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.cpp
+// ============
+// cull the scene objects and build the indirect draws in a compute shader
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GpuCulling.h"
+#include "GLStateCache.h"
+#include "ShaderLoader.h"
+#include "Profiler.h"
+
+#include <iostream>
+
+/***********************************************************
+ *  GpuCulling()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GpuCulling::GpuCulling()
+{
+	m_program = 0;
+	m_objectCountLocation = -1;
+	m_frustumLocation = -1;
+	m_useOcclusionLocation = -1;
+	m_viewProjectionLocation = -1;
+	m_hiZLocation = -1;
+	m_hiZSizeLocation = -1;
+	m_hiZLevelsLocation = -1;
+	m_objectBuffer = 0;
+	m_templateBuffer = 0;
+	m_commandBuffer = 0;
+	m_instanceBuffer = 0;
+	m_objectCount = 0;
+	m_commandCount = 0;
+	m_occluderBuffer = 0;
+	m_occluderCount = 0;
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		m_statsBuffers[i] = 0;
+		m_statsFences[i] = 0;
+	}
+	m_statsFrame = 0;
+	m_cullStats = CULL_STATS();
+}
+
+/***********************************************************
+ *  ~GpuCulling()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+GpuCulling::~GpuCulling()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for loading the culling shader and
+ *  creating the buffers.  Compute shaders are core since
+ *  OpenGL 4.3, so this only fails when the shader has an
+ *  error or its file is missing.
+ ***********************************************************/
+bool GpuCulling::Initialize()
+{
+	static_assert(sizeof(GPU_CULL_OBJECT) == 144, "GPU_CULL_OBJECT must match the std430 CullObject layout");
+	static_assert(sizeof(DRAW_ELEMENTS_COMMAND) == 20, "DRAW_ELEMENTS_COMMAND must match the std430 DrawCommand layout");
+
+	if (m_program != 0)
+	{
+		return(true);
+	}
+
+	m_program = LoadComputeProgram("shaders/cullCompute.glsl");
+	if (m_program == 0)
+	{
+		std::cout << "GPU culling is not available" << std::endl;
+		return(false);
+	}
+	m_objectCountLocation = glGetUniformLocation(m_program, "objectCount");
+	m_frustumLocation = glGetUniformLocation(m_program, "frustumPlanes");
+	m_useOcclusionLocation = glGetUniformLocation(m_program, "bUseOcclusion");
+	m_viewProjectionLocation = glGetUniformLocation(m_program, "viewProjection");
+	m_hiZLocation = glGetUniformLocation(m_program, "hiZ");
+	m_hiZSizeLocation = glGetUniformLocation(m_program, "hiZSize");
+	m_hiZLevelsLocation = glGetUniformLocation(m_program, "hiZLevels");
+
+	glGenBuffers(1, &m_objectBuffer);
+	glGenBuffers(1, &m_templateBuffer);
+	glGenBuffers(1, &m_commandBuffer);
+	glGenBuffers(1, &m_instanceBuffer);
+	glGenBuffers(1, &m_occluderBuffer);
+
+	const CULL_STATS emptyStats = CULL_STATS();
+	glGenBuffers(GPU_QUERY_FRAMES, m_statsBuffers);
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(CULL_STATS), &emptyStats, GL_DYNAMIC_READ);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void GpuCulling::Destroy()
+{
+	if (m_program != 0)
+	{
+		g_GLState.ForgetProgram(m_program);
+		glDeleteProgram(m_program);
+		m_program = 0;
+	}
+	if (m_objectBuffer != 0)
+	{
+		GLuint buffers[4] = { m_objectBuffer, m_templateBuffer, m_commandBuffer, m_instanceBuffer };
+		g_GLState.DeleteBuffers(4, buffers);
+		m_objectBuffer = 0;
+		m_templateBuffer = 0;
+		m_commandBuffer = 0;
+		m_instanceBuffer = 0;
+	}
+	if (m_occluderBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_occluderBuffer);
+		m_occluderBuffer = 0;
+	}
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		if (m_statsFences[i] != 0)
+		{
+			glDeleteSync(m_statsFences[i]);
+			m_statsFences[i] = 0;
+		}
+	}
+	if (m_statsBuffers[0] != 0)
+	{
+		g_GLState.DeleteBuffers(GPU_QUERY_FRAMES, m_statsBuffers);
+		for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+		{
+			m_statsBuffers[i] = 0;
+		}
+	}
+	m_objectCount = 0;
+	m_commandCount = 0;
+	m_occluderCount = 0;
+	m_cullStats = CULL_STATS();
+}
+
+/***********************************************************
+ *  SetObjects()
+ *
+ *  This method is used for uploading the objects and the
+ *  command template.  The template is the passed in commands
+ *  with every instance count set to 0, the culling adds the
+ *  visible instances back.  The instance buffer is sized for
+ *  every object being visible.
+ ***********************************************************/
+void GpuCulling::SetObjects(
+	const std::vector<GPU_CULL_OBJECT>& objects,
+	const std::vector<DRAW_ELEMENTS_COMMAND>& commands)
+{
+	if (m_program == 0)
+	{
+		return;
+	}
+
+	std::vector<DRAW_ELEMENTS_COMMAND> emptyCommands = commands;
+	for (size_t i = 0; i < emptyCommands.size(); i++)
+	{
+		emptyCommands[i].instanceCount = 0;
+	}
+
+	m_objectCount = objects.size();
+	m_commandCount = commands.size();
+
+	// sizes of at least one record, zero sized buffers cannot be bound
+	const size_t objectCapacity = (m_objectCount > 0) ? m_objectCount : 1;
+	const size_t commandCapacity = (m_commandCount > 0) ? m_commandCount : 1;
+
+	g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objectCapacity * sizeof(GPU_CULL_OBJECT),
+		objects.empty() ? NULL : objects.data(), GL_STATIC_DRAW);
+	g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objectCapacity * sizeof(MESH_INSTANCE), NULL, GL_DYNAMIC_COPY);
+
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, m_templateBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, commandCapacity * sizeof(DRAW_ELEMENTS_COMMAND),
+		emptyCommands.empty() ? NULL : emptyCommands.data(), GL_STATIC_DRAW);
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, commandCapacity * sizeof(DRAW_ELEMENTS_COMMAND), NULL, GL_DYNAMIC_COPY);
+}
+
+/***********************************************************
+ *  SetOccluders()
+ ***********************************************************/
+void GpuCulling::SetOccluders(const std::vector<DRAW_ELEMENTS_COMMAND>& commands)
+{
+	if (m_program == 0)
+	{
+		return;
+	}
+
+	m_occluderCount = commands.size();
+	if (m_occluderCount > 0)
+	{
+		g_GLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_occluderBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_occluderCount * sizeof(DRAW_ELEMENTS_COMMAND),
+			commands.data(), GL_STATIC_DRAW);
+	}
+}
+
+/***********************************************************
+ *  DrawOccluders()
+ *
+ *  This method is used for drawing every occluder with one
+ *  indirect call.  The depth shader reads the model matrix of
+ *  each occluder from the object buffer, so the occluders do
+ *  not need an instance buffer of their own.
+ ***********************************************************/
+void GpuCulling::DrawOccluders()
+{
+	if (m_occluderCount == 0)
+	{
+		return;
+	}
+
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_OBJECTS, m_objectBuffer);
+	g_GLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, m_occluderBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, (GLsizei)m_occluderCount, 0);
+}
+
+/***********************************************************
+ *  ReadCullStats()
+ *
+ *  This method is used for reading back the statistics
+ *  buffer of a slot when the GPU has finished with it.  A
+ *  fence that has not signaled yet is dropped along with its
+ *  frame, the buffer is cleared in command order before it is
+ *  reused, so only the counts of that frame are lost.
+ ***********************************************************/
+void GpuCulling::ReadCullStats(int slot)
+{
+	if (m_statsFences[slot] == 0)
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(m_statsFences[slot], 0, 0);
+	if ((result == GL_ALREADY_SIGNALED) || (result == GL_CONDITION_SATISFIED))
+	{
+		g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffers[slot]);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(CULL_STATS), &m_cullStats);
+	}
+	glDeleteSync(m_statsFences[slot]);
+	m_statsFences[slot] = 0;
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for resetting the instance counts and
+ *  dispatching one thread per object.  The barrier makes the
+ *  written commands and instances visible to the indirect
+ *  draws that read them.  The Hi-Z pyramid must be built
+ *  before this is called.
+ ***********************************************************/
+void GpuCulling::Cull(const FRUSTUM& frustum, const glm::mat4& viewProjection, const HiZBuffer* pHiZ)
+{
+	if ((m_program == 0) || (m_objectCount == 0))
+	{
+		return;
+	}
+
+	GpuProfileScope gpuScope("GpuCulling");
+
+	// pick up the counts of the frame that last used this slot,
+	// then clear the slot for this frame
+	const int slot = m_statsFrame % GPU_QUERY_FRAMES;
+	ReadCullStats(slot);
+	const CULL_STATS emptyStats = CULL_STATS();
+	g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffers[slot]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(CULL_STATS), &emptyStats);
+
+	g_GLState.BindBuffer(GL_COPY_READ_BUFFER, m_templateBuffer);
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, m_commandBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+		m_commandCount * sizeof(DRAW_ELEMENTS_COMMAND));
+
+	g_GLState.UseProgram(m_program);
+	GLuint objectCount = (GLuint)m_objectCount;
+	if (g_GLState.UniformChanged(m_program, m_objectCountLocation, &objectCount, sizeof(objectCount)))
+	{
+		glUniform1ui(m_objectCountLocation, objectCount);
+	}
+	if (g_GLState.UniformChanged(m_program, m_frustumLocation, frustum.planes, sizeof(frustum.planes)))
+	{
+		glUniform4fv(m_frustumLocation, 6, &frustum.planes[0].x);
+	}
+
+	const bool bUseOcclusion = (NULL != pHiZ) && pHiZ->IsReady();
+	GLint useOcclusion = bUseOcclusion ? 1 : 0;
+	if (g_GLState.UniformChanged(m_program, m_useOcclusionLocation, &useOcclusion, sizeof(useOcclusion)))
+	{
+		glUniform1i(m_useOcclusionLocation, useOcclusion);
+	}
+	if (bUseOcclusion)
+	{
+		const glm::vec2 hiZSize((float)HIZ_WIDTH, (float)HIZ_HEIGHT);
+		const GLint hiZLevels = pHiZ->GetLevelCount();
+		const GLint hiZUnit = TEXTURE_UNIT_HIZ;
+		if (g_GLState.UniformChanged(m_program, m_viewProjectionLocation, &viewProjection[0].x, sizeof(viewProjection)))
+		{
+			glUniformMatrix4fv(m_viewProjectionLocation, 1, GL_FALSE, &viewProjection[0].x);
+		}
+		if (g_GLState.UniformChanged(m_program, m_hiZSizeLocation, &hiZSize.x, sizeof(hiZSize)))
+		{
+			glUniform2f(m_hiZSizeLocation, hiZSize.x, hiZSize.y);
+		}
+		if (g_GLState.UniformChanged(m_program, m_hiZLevelsLocation, &hiZLevels, sizeof(hiZLevels)))
+		{
+			glUniform1i(m_hiZLevelsLocation, hiZLevels);
+		}
+		if (g_GLState.UniformChanged(m_program, m_hiZLocation, &hiZUnit, sizeof(hiZUnit)))
+		{
+			glUniform1i(m_hiZLocation, hiZUnit);
+		}
+		g_GLState.BindTexture(TEXTURE_UNIT_HIZ, GL_TEXTURE_2D, pHiZ->GetTexture());
+	}
+
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_OBJECTS, m_objectBuffer);
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_COMMANDS, m_commandBuffer);
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_INSTANCES, m_instanceBuffer);
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_CULL_STATS, m_statsBuffers[slot]);
+
+	glDispatchCompute((GLuint)((m_objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	m_statsFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_statsFrame++;
+}
@@ -0,0 +1,149 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.h
+// ============
+// cull the scene objects and build the indirect draws in a compute shader
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+#include "BoundingVolumeHierarchy.h"
+#include "HiZBuffer.h"
+#include "Profiler.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// binding points of the culling pass storage buffers, after the
+// ones the scene shaders use, must match the compute shader
+enum CULL_STORAGE_BINDING
+{
+	STORAGE_BINDING_CULL_OBJECTS = 4,
+	STORAGE_BINDING_CULL_COMMANDS,
+	STORAGE_BINDING_CULL_INSTANCES,
+	STORAGE_BINDING_CULL_STATS
+};
+
+// threads per work group, must match the compute shader
+const int CULL_GROUP_SIZE = 64;
+
+/***********************************************************
+ *  GPU_CULL_OBJECT
+ *
+ *  One object as the culling shader reads it, std430 layout.
+ *  The instance record is copied to the instance buffer when
+ *  the object is visible, the bounds are the local bounds of
+ *  its mesh and are moved by the instance model matrix.
+ ***********************************************************/
+struct GPU_CULL_OBJECT
+{
+	MESH_INSTANCE instance;
+	glm::vec3 boundsMin;
+	// indirect command the object is drawn by
+	uint32_t batch;
+	glm::vec3 boundsMax;
+	uint32_t padding;
+};
+
+// objects the culling rejected in one frame, std430 layout
+struct CULL_STATS
+{
+	uint32_t frustumCulled;
+	uint32_t occlusionCulled;
+};
+
+/***********************************************************
+ *  GpuCulling
+ *
+ *  This class keeps every scene object and its transform in
+ *  a storage buffer and culls them in a compute shader.  Each
+ *  thread tests one object against the frustum, and a visible
+ *  object claims the next instance slot of its batch with an
+ *  atomic add on the batch's indirect command, so the visible
+ *  instances of a batch end up packed at the start of its
+ *  range.  The CPU only resets the instance counts from a
+ *  template, dispatches and draws indirect.
+ *
+ *  Every batch keeps its command even when nothing in it is
+ *  visible, an instance count of 0 draws nothing, so no
+ *  indirect count extension is needed and the path runs on
+ *  software OpenGL implementations.
+ *
+ *  With a Hi-Z buffer the objects inside the frustum are also
+ *  tested against the depth of the large occluders, drawn by
+ *  DrawOccluders() into the buffer before the culling runs.
+ ***********************************************************/
+class GpuCulling
+{
+public:
+	// constructor
+	GpuCulling();
+	// destructor
+	~GpuCulling();
+
+	// load the culling shader, false when it does not compile
+	bool Initialize();
+	// free the program and buffers
+	void Destroy();
+	bool IsReady() const { return m_program != 0; }
+
+	// upload the objects, grouped by batch, and one command per
+	// batch whose base instance and instance count give the
+	// batch's range of objects
+	void SetObjects(
+		const std::vector<GPU_CULL_OBJECT>& objects,
+		const std::vector<DRAW_ELEMENTS_COMMAND>& commands);
+	// upload one command per occluder, each drawing a single
+	// instance whose base instance is the index of its object
+	void SetOccluders(const std::vector<DRAW_ELEMENTS_COMMAND>& commands);
+	// draw the occluders with the mesh vertex array and the
+	// depth program of the Hi-Z buffer bound
+	void DrawOccluders();
+	// cull every object and rewrite the indirect commands and
+	// the instance buffer, objects hidden in the passed in Hi-Z
+	// buffer are culled too when it is not NULL; the scene
+	// program must be bound again afterwards
+	void Cull(const FRUSTUM& frustum, const glm::mat4& viewProjection, const HiZBuffer* pHiZ);
+
+	GLuint GetCommandBuffer() const { return m_commandBuffer; }
+	GLuint GetInstanceBuffer() const { return m_instanceBuffer; }
+	size_t GetObjectCount() const { return m_objectCount; }
+	size_t GetOccluderCount() const { return m_occluderCount; }
+	// the counts of the newest frame the GPU has finished, read
+	// back without waiting so they lag a frame or two behind
+	const CULL_STATS& GetCullStats() const { return m_cullStats; }
+
+private:
+	GLuint m_program;
+	GLint m_objectCountLocation;
+	GLint m_frustumLocation;
+	GLint m_useOcclusionLocation;
+	GLint m_viewProjectionLocation;
+	GLint m_hiZLocation;
+	GLint m_hiZSizeLocation;
+	GLint m_hiZLevelsLocation;
+
+	// the objects, the commands with zero instance counts, the
+	// commands written by the culling and the visible instances
+	GLuint m_objectBuffer;
+	GLuint m_templateBuffer;
+	GLuint m_commandBuffer;
+	GLuint m_instanceBuffer;
+	size_t m_objectCount;
+	size_t m_commandCount;
+
+	GLuint m_occluderBuffer;
+	size_t m_occluderCount;
+
+	// one statistics buffer per frame in flight, each read back
+	// once its fence has signaled
+	GLuint m_statsBuffers[GPU_QUERY_FRAMES];
+	GLsync m_statsFences[GPU_QUERY_FRAMES];
+	int m_statsFrame;
+	CULL_STATS m_cullStats;
+
+	void ReadCullStats(int slot);
+};
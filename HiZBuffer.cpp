@@ -0,0 +1,264 @@
+///////////////////////////////////////////////////////////////////////////////
+// hizbuffer.cpp
+// ============
+// depth of the large occluders and its hierarchical-Z mip chain
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HiZBuffer.h"
+#include "GLStateCache.h"
+#include "ShaderLoader.h"
+#include "Profiler.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <iostream>
+
+// declaration of local helpers
+namespace
+{
+	// threads per work group side, must match the pyramid shader
+	const int PYRAMID_GROUP_SIZE = 8;
+}
+
+/***********************************************************
+ *  HiZBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+HiZBuffer::HiZBuffer()
+{
+	m_depthProgram = 0;
+	m_viewProjectionLocation = -1;
+	m_pyramidProgram = 0;
+	m_sourceLocation = -1;
+	m_sourceLevelLocation = -1;
+	m_sourceSizeLocation = -1;
+	m_framebuffer = 0;
+	m_depthTexture = 0;
+	m_pyramidTexture = 0;
+	m_levelCount = 0;
+	m_savedFramebuffer = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		m_savedViewport[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~HiZBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+HiZBuffer::~HiZBuffer()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for loading the occluder depth and
+ *  pyramid shaders and creating the depth framebuffer and
+ *  the pyramid texture with its full mip chain.
+ ***********************************************************/
+bool HiZBuffer::Initialize()
+{
+	if (m_pyramidProgram != 0)
+	{
+		return(true);
+	}
+
+	m_depthProgram = LoadShaderProgram("shaders/depthVertexShader.glsl", "shaders/depthFragmentShader.glsl");
+	GLuint pyramidProgram = LoadComputeProgram("shaders/hiZCompute.glsl");
+	if ((m_depthProgram == 0) || (pyramidProgram == 0))
+	{
+		std::cout << "Occlusion culling is not available" << std::endl;
+		if (m_depthProgram != 0)
+		{
+			glDeleteProgram(m_depthProgram);
+			m_depthProgram = 0;
+		}
+		if (pyramidProgram != 0)
+		{
+			glDeleteProgram(pyramidProgram);
+		}
+		return(false);
+	}
+	m_pyramidProgram = pyramidProgram;
+	m_viewProjectionLocation = glGetUniformLocation(m_depthProgram, "viewProjection");
+	m_sourceLocation = glGetUniformLocation(m_pyramidProgram, "source");
+	m_sourceLevelLocation = glGetUniformLocation(m_pyramidProgram, "sourceLevel");
+	m_sourceSizeLocation = glGetUniformLocation(m_pyramidProgram, "sourceSize");
+
+	// the pyramid always reads its source from the same unit
+	const GLint sourceUnit = TEXTURE_UNIT_HIZ;
+	g_GLState.UseProgram(m_pyramidProgram);
+	if (g_GLState.UniformChanged(m_pyramidProgram, m_sourceLocation, &sourceUnit, sizeof(sourceUnit)))
+	{
+		glUniform1i(m_sourceLocation, sourceUnit);
+	}
+
+	m_levelCount = 1;
+	for (int size = (HIZ_WIDTH > HIZ_HEIGHT) ? HIZ_WIDTH : HIZ_HEIGHT; size > 1; size >>= 1)
+	{
+		m_levelCount++;
+	}
+
+	// depth only target the occluders are drawn into
+	glGenTextures(1, &m_depthTexture);
+	g_GLState.BindTexture(TEXTURE_UNIT_HIZ, GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, HIZ_WIDTH, HIZ_HEIGHT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	// the caller may be rendering into a framebuffer of its
+	// own, like the benchmark's offscreen target
+	GLint drawFramebuffer = 0;
+	GLint readFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	bool bComplete = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)drawFramebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)readFramebuffer);
+
+	// farthest depth pyramid, read with texelFetch only
+	glGenTextures(1, &m_pyramidTexture);
+	g_GLState.BindTexture(TEXTURE_UNIT_HIZ, GL_TEXTURE_2D, m_pyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_levelCount, GL_R32F, HIZ_WIDTH, HIZ_HEIGHT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	if (!bComplete)
+	{
+		std::cout << "Could not create the occluder depth framebuffer" << std::endl;
+		Destroy();
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void HiZBuffer::Destroy()
+{
+	if (m_depthProgram != 0)
+	{
+		g_GLState.ForgetProgram(m_depthProgram);
+		glDeleteProgram(m_depthProgram);
+		m_depthProgram = 0;
+	}
+	if (m_pyramidProgram != 0)
+	{
+		g_GLState.ForgetProgram(m_pyramidProgram);
+		glDeleteProgram(m_pyramidProgram);
+		m_pyramidProgram = 0;
+	}
+	if (m_framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (m_depthTexture != 0)
+	{
+		g_GLState.DeleteTextures(1, &m_depthTexture);
+		m_depthTexture = 0;
+	}
+	if (m_pyramidTexture != 0)
+	{
+		g_GLState.DeleteTextures(1, &m_pyramidTexture);
+		m_pyramidTexture = 0;
+	}
+	m_levelCount = 0;
+}
+
+/***********************************************************
+ *  BeginOccluders()
+ *
+ *  This method is used for starting the occluder depth pass.
+ *  The framebuffer and viewport in use are kept so that
+ *  EndOccluders() can put them back, the offscreen benchmark
+ *  does not render into the default framebuffer.
+ ***********************************************************/
+void HiZBuffer::BeginOccluders(const glm::mat4& viewProjection)
+{
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_savedFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, m_savedViewport);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, HIZ_WIDTH, HIZ_HEIGHT);
+	g_GLState.DepthMask(GL_TRUE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	g_GLState.Enable(GL_DEPTH_TEST);
+
+	g_GLState.UseProgram(m_depthProgram);
+	if (g_GLState.UniformChanged(m_depthProgram, m_viewProjectionLocation, glm::value_ptr(viewProjection), sizeof(viewProjection)))
+	{
+		glUniformMatrix4fv(m_viewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+	}
+}
+
+/***********************************************************
+ *  EndOccluders()
+ ***********************************************************/
+void HiZBuffer::EndOccluders()
+{
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)m_savedFramebuffer);
+	glViewport(m_savedViewport[0], m_savedViewport[1], m_savedViewport[2], m_savedViewport[3]);
+
+	BuildPyramid();
+}
+
+/***********************************************************
+ *  BuildPyramid()
+ *
+ *  This method is used for copying the occluder depth into
+ *  level 0 and reducing every level into the next, a source
+ *  level of -1 tells the shader to copy.  Each level waits
+ *  for the writes to the one before it.
+ ***********************************************************/
+void HiZBuffer::BuildPyramid()
+{
+	GpuProfileScope gpuScope("HiZBuild");
+
+	g_GLState.UseProgram(m_pyramidProgram);
+
+	int width = HIZ_WIDTH;
+	int height = HIZ_HEIGHT;
+	int sourceWidth = width;
+	int sourceHeight = height;
+	for (int level = 0; level < m_levelCount; level++)
+	{
+		// level 0 reads the depth texture, every other level the
+		// level above it in the pyramid
+		g_GLState.BindTexture(TEXTURE_UNIT_HIZ, GL_TEXTURE_2D, (level == 0) ? m_depthTexture : m_pyramidTexture);
+		const GLint sourceLevel = level - 1;
+		const GLint sourceSize[2] = { sourceWidth, sourceHeight };
+		if (g_GLState.UniformChanged(m_pyramidProgram, m_sourceLevelLocation, &sourceLevel, sizeof(sourceLevel)))
+		{
+			glUniform1i(m_sourceLevelLocation, sourceLevel);
+		}
+		if (g_GLState.UniformChanged(m_pyramidProgram, m_sourceSizeLocation, sourceSize, sizeof(sourceSize)))
+		{
+			glUniform2i(m_sourceSizeLocation, sourceSize[0], sourceSize[1]);
+		}
+		glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute(
+			(GLuint)((width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE),
+			(GLuint)((height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE),
+			1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		sourceWidth = width;
+		sourceHeight = height;
+		width = (width > 1) ? width / 2 : 1;
+		height = (height > 1) ? height / 2 : 1;
+	}
+}
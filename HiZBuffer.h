@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+// hizbuffer.h
+// ============
+// depth of the large occluders and its hierarchical-Z mip chain
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderUniforms.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// size of the occluder depth and the first pyramid level,
+// powers of two so every level halves exactly
+const int HIZ_WIDTH = 512;
+const int HIZ_HEIGHT = 256;
+
+// texture unit the pyramid is read from, after the texture arrays
+const int TEXTURE_UNIT_HIZ = TEXTURE_UNIT_ARRAYS + MAX_TEXTURE_ARRAYS;
+
+/***********************************************************
+ *  HiZBuffer
+ *
+ *  This class renders the depth of the large occluders at a
+ *  low resolution and reduces it into a mip chain where every
+ *  texel holds the farthest depth of the four below it.  An
+ *  object whose nearest depth is behind the farthest depth of
+ *  the texels its bounds cover is hidden, and a level where
+ *  the bounds cover at most two texels a side answers that
+ *  with four reads whatever the size on screen.
+ ***********************************************************/
+class HiZBuffer
+{
+public:
+	// constructor
+	HiZBuffer();
+	// destructor
+	~HiZBuffer();
+
+	// load the shaders and create the textures, false when a
+	// shader does not compile
+	bool Initialize();
+	// free the shaders, textures and framebuffer
+	void Destroy();
+	bool IsReady() const { return m_pyramidProgram != 0; }
+
+	// bind the occluder framebuffer and depth program and clear
+	// the depth, the caller then draws the occluders
+	void BeginOccluders(const glm::mat4& viewProjection);
+	// restore the framebuffer and viewport and build the mip
+	// chain from the occluder depth
+	void EndOccluders();
+
+	GLuint GetTexture() const { return m_pyramidTexture; }
+	int GetLevelCount() const { return m_levelCount; }
+
+private:
+	GLuint m_depthProgram;
+	GLint m_viewProjectionLocation;
+	GLuint m_pyramidProgram;
+	GLint m_sourceLocation;
+	GLint m_sourceLevelLocation;
+	GLint m_sourceSizeLocation;
+
+	GLuint m_framebuffer;
+	GLuint m_depthTexture;
+	GLuint m_pyramidTexture;
+	int m_levelCount;
+
+	// the framebuffer and viewport in use before the occluders
+	GLint m_savedFramebuffer;
+	GLint m_savedViewport[4];
+
+	void BuildPyramid();
+};
@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ============
+// short jobs on worker threads that steal work from each other
+///////////////////////////////////////////////////////////////////////////////
+
+#include "JobSystem.h"
+
+// declaration of global variables
+JobSystem g_JobSystem;
+
+namespace
+{
+	// ranges ParallelFor() makes per thread at most, a few
+	// more than one so a thread that finishes early can steal
+	const size_t JOBS_PER_THREAD = 4;
+
+	// deque of the calling thread, workers set their own and
+	// every other thread uses deque 0
+	thread_local int t_queueIndex = 0;
+}
+
+/***********************************************************
+ *  JobSystem()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+JobSystem::JobSystem()
+{
+	m_bStopping = false;
+	m_queuedJobs = 0;
+}
+
+/***********************************************************
+ *  ~JobSystem()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+JobSystem::~JobSystem()
+{
+	Stop();
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method is used for creating the deques and starting
+ *  the worker threads.  It does nothing when the system is
+ *  already running.
+ ***********************************************************/
+void JobSystem::Start(int threadCount)
+{
+	if (!m_queues.empty())
+	{
+		return;
+	}
+
+	if (threadCount <= 0)
+	{
+		threadCount = (int)std::thread::hardware_concurrency() - 1;
+		if (threadCount < 1)
+		{
+			threadCount = 1;
+		}
+	}
+
+	m_bStopping = false;
+	m_queuedJobs = 0;
+	for (int i = 0; i <= threadCount; i++)
+	{
+		m_queues.push_back(std::unique_ptr<WORK_QUEUE>(new WORK_QUEUE()));
+	}
+	for (int i = 1; i <= threadCount; i++)
+	{
+		m_threads.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+	}
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for stopping the worker threads once
+ *  their running jobs finish.  Queued jobs are dropped, so
+ *  nothing may still be waiting for a group.
+ ***********************************************************/
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_bStopping = true;
+	}
+	m_jobReady.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		m_threads[i].join();
+	}
+	m_threads.clear();
+	m_queues.clear();
+	m_queuedJobs = 0;
+}
+
+/***********************************************************
+ *  Run()
+ *
+ *  This method is used for queueing a job on the calling
+ *  thread's deque.  Before Start() the job runs right away.
+ ***********************************************************/
+void JobSystem::Run(JOB_COUNTER& counter, std::function<void()> job)
+{
+	if (m_queues.empty())
+	{
+		job();
+		return;
+	}
+
+	JOB queued;
+	queued.function = job;
+	queued.pCounter = &counter;
+	counter.pending++;
+	m_queuedJobs++;
+
+	WORK_QUEUE& queue = *m_queues[t_queueIndex];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(queued);
+	}
+
+	// taking the lock orders the new job before the check of
+	// a worker about to sleep
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_jobReady.notify_one();
+}
+
+/***********************************************************
+ *  Wait()
+ *
+ *  This method is used for waiting until every job of a
+ *  group has finished, running queued jobs of any group on
+ *  the calling thread in the meantime.
+ ***********************************************************/
+void JobSystem::Wait(JOB_COUNTER& counter)
+{
+	while (counter.pending > 0)
+	{
+		if (!RunOneJob(t_queueIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+/***********************************************************
+ *  ParallelFor()
+ *
+ *  This method is used for running a loop body over ranges
+ *  of [0, count) on several threads.  The calling thread
+ *  runs the first range itself and then helps with the rest.
+ ***********************************************************/
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	grain = (grain > 0) ? grain : 1;
+	if (m_threads.empty() || (count <= grain))
+	{
+		body(0, count);
+		return;
+	}
+
+	size_t jobCount = (count + grain - 1) / grain;
+	const size_t maxJobs = (size_t)GetThreadCount() * JOBS_PER_THREAD;
+	jobCount = (jobCount < maxJobs) ? jobCount : maxJobs;
+	const size_t step = (count + jobCount - 1) / jobCount;
+
+	JOB_COUNTER counter;
+	for (size_t begin = step; begin < count; begin += step)
+	{
+		const size_t end = (begin + step < count) ? begin + step : count;
+		Run(counter, [&body, begin, end]() { body(begin, end); });
+	}
+	body(0, step);
+	Wait(counter);
+}
+
+/***********************************************************
+ *  RunOneJob()
+ *
+ *  This method is used for running the newest job of the
+ *  thread's own deque, or else the oldest job of another.
+ ***********************************************************/
+bool JobSystem::RunOneJob(int queueIndex)
+{
+	JOB job;
+	if (!PopJob(queueIndex, job) && !StealJob(queueIndex, job))
+	{
+		return false;
+	}
+
+	job.function();
+	job.pCounter->pending--;
+	return true;
+}
+
+/***********************************************************
+ *  PopJob()
+ ***********************************************************/
+bool JobSystem::PopJob(int queueIndex, JOB& job)
+{
+	WORK_QUEUE& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+	{
+		return false;
+	}
+
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	m_queuedJobs--;
+	return true;
+}
+
+/***********************************************************
+ *  StealJob()
+ *
+ *  This method is used for taking the oldest job of another
+ *  deque, starting with the one after the thief's so the
+ *  thieves spread out.
+ ***********************************************************/
+bool JobSystem::StealJob(int thiefIndex, JOB& job)
+{
+	const int queueCount = (int)m_queues.size();
+	for (int i = 1; i < queueCount; i++)
+	{
+		WORK_QUEUE& queue = *m_queues[(thiefIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.jobs.empty())
+		{
+			continue;
+		}
+
+		job = queue.jobs.front();
+		queue.jobs.pop_front();
+		m_queuedJobs--;
+		return true;
+	}
+	return false;
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is run by every worker thread, it runs jobs
+ *  until there are none left anywhere and then sleeps until
+ *  one is queued or the system stops.
+ ***********************************************************/
+void JobSystem::WorkerLoop(int queueIndex)
+{
+	t_queueIndex = queueIndex;
+	for (;;)
+	{
+		if (RunOneJob(queueIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		while (!m_bStopping && (m_queuedJobs == 0))
+		{
+			m_jobReady.wait(lock);
+		}
+		if (m_bStopping)
+		{
+			return;
+		}
+	}
+}
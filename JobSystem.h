@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ============
+// short jobs on worker threads that steal work from each other
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// the jobs of a group that have not finished, the group is
+// done when it reaches zero
+struct JOB_COUNTER
+{
+	std::atomic<int> pending;
+
+	JOB_COUNTER() : pending(0) {}
+};
+
+/***********************************************************
+ *  JobSystem
+ *
+ *  This class runs short jobs, like the parts of a frame's
+ *  preparation, on one worker thread per spare core.  Every
+ *  worker has its own deque: it pushes and pops its own jobs
+ *  at the back, so it keeps working on what it just split,
+ *  and steals from the front of the others when its deque is
+ *  empty.  Threads that are not workers share one more deque.
+ *  A thread waiting for a group runs queued jobs meanwhile,
+ *  so jobs may wait for the jobs they start.
+ *
+ *  Unlike ThreadPool, which suits long jobs like decoding an
+ *  image, the jobs are expected to finish within a frame.
+ *  Jobs must not touch OpenGL, the context belongs to the
+ *  main thread.
+ ***********************************************************/
+class JobSystem
+{
+public:
+	// constructor
+	JobSystem();
+	// destructor
+	~JobSystem();
+
+	// start the worker threads, 0 uses one less than the
+	// number of hardware threads, as the waiting thread helps
+	void Start(int threadCount = 0);
+	// wait for the running jobs and stop the workers, queued
+	// jobs are dropped
+	void Stop();
+
+	// queue a job that counts against the passed in group
+	void Run(JOB_COUNTER& counter, std::function<void()> job);
+	// run queued jobs on the calling thread until the group
+	// is done
+	void Wait(JOB_COUNTER& counter);
+	// split [0, count) into ranges of at least grain items, run
+	// them as jobs and wait for all of them; a count no larger
+	// than the grain runs on the calling thread
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+	// the workers plus the thread that waits
+	int GetThreadCount() const { return (int)m_threads.size() + 1; }
+
+private:
+	struct JOB
+	{
+		std::function<void()> function;
+		JOB_COUNTER* pCounter;
+	};
+
+	// jobs of one thread, the owner uses the back and thieves
+	// the front
+	struct WORK_QUEUE
+	{
+		std::mutex mutex;
+		std::deque<JOB> jobs;
+	};
+
+	// deque 0 is shared by the threads that are not workers
+	std::vector<std::unique_ptr<WORK_QUEUE> > m_queues;
+	std::vector<std::thread> m_threads;
+	std::atomic<bool> m_bStopping;
+	// queued jobs of every deque, idle workers sleep while it
+	// is zero
+	std::atomic<int> m_queuedJobs;
+	std::mutex m_sleepMutex;
+	std::condition_variable m_jobReady;
+
+	// take a job from the thread's own deque or steal one and
+	// run it, false when every deque was empty
+	bool RunOneJob(int queueIndex);
+	bool PopJob(int queueIndex, JOB& job);
+	bool StealJob(int thiefIndex, JOB& job);
+	void WorkerLoop(int queueIndex);
+};
+
+// the job system shared by the renderer
+extern JobSystem g_JobSystem;
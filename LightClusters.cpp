@@ -0,0 +1,338 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ============
+// assign local lights to the clusters of the view frustum
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+#include "GLStateCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// declaration of local helpers
+namespace
+{
+	// the faintest light contribution still visible in 8-bit output
+	const float LIGHT_THRESHOLD = 1.0f / 256.0f;
+	// room for this many light indices is allocated up front
+	const size_t MIN_INDEX_CAPACITY = 1024;
+
+	// index of the tile holding a normalized device coordinate
+	int TileIndex(float ndc, int tileCount)
+	{
+		int tile = (int)std::floor((ndc * 0.5f + 0.5f) * (float)tileCount);
+		return std::min(std::max(tile, 0), tileCount - 1);
+	}
+}
+
+/***********************************************************
+ *  AttenuationRadius()
+ *
+ *  This function is used for solving the attenuation
+ *  1 / (constant + linear * d + quadratic * d^2) for the
+ *  distance where the brightest color of the light drops to
+ *  LIGHT_THRESHOLD.  A light that is already below the
+ *  threshold at its center gets a radius of 0.
+ ***********************************************************/
+float AttenuationRadius(float constant, float linear, float quadratic, float brightness)
+{
+	// distance where constant + linear * d + quadratic * d^2 = limit
+	const float limit = brightness / LIGHT_THRESHOLD;
+	if (constant >= limit)
+	{
+		return(0.0f);
+	}
+
+	if (quadratic > 0.0f)
+	{
+		float discriminant = linear * linear - 4.0f * quadratic * (constant - limit);
+		return((-linear + std::sqrt(discriminant)) / (2.0f * quadratic));
+	}
+	if (linear > 0.0f)
+	{
+		return((limit - constant) / linear);
+	}
+
+	// the light never fades out
+	return(-1.0f);
+}
+
+/***********************************************************
+ *  LightClusters()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightClusters::LightClusters()
+{
+	m_clusterBuffer = 0;
+	m_indexBuffer = 0;
+	m_indexCapacity = 0;
+	m_view = glm::mat4(1.0f);
+	m_projection = glm::mat4(1.0f);
+	m_viewportWidth = 0;
+	m_viewportHeight = 0;
+	m_tileScale = glm::vec2(0.0f);
+	m_depthScaleBias = glm::vec2(0.0f);
+}
+
+/***********************************************************
+ *  ~LightClusters()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightClusters::~LightClusters()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void LightClusters::Destroy()
+{
+	if (m_clusterBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_clusterBuffer);
+		m_clusterBuffer = 0;
+	}
+	if (m_indexBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_indexBuffer);
+		m_indexBuffer = 0;
+	}
+	m_indexCapacity = 0;
+	m_viewportWidth = 0;
+	m_viewportHeight = 0;
+}
+
+/***********************************************************
+ *  Assign()
+ *
+ *  This method is used for building the light list of every
+ *  cluster.  Each light is first reduced to the box of
+ *  clusters its sphere can reach, then the clusters are
+ *  counted, given a range of the index list with a prefix
+ *  sum, and filled, so the lists are packed with no limit on
+ *  the number of lights per cluster.
+ ***********************************************************/
+void LightClusters::Assign(
+	const std::vector<glm::vec4>& lightSpheres,
+	int firstLight,
+	bool bLightsChanged,
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	int viewportWidth,
+	int viewportHeight)
+{
+	if ((bLightsChanged == false) && (m_clusterBuffer != 0) &&
+		(view == m_view) && (projection == m_projection) &&
+		(viewportWidth == m_viewportWidth) && (viewportHeight == m_viewportHeight))
+	{
+		return;
+	}
+	m_view = view;
+	m_projection = projection;
+	m_viewportWidth = viewportWidth;
+	m_viewportHeight = viewportHeight;
+
+	// near and far planes of a perspective or orthographic projection
+	float nearPlane = 0.0f;
+	float farPlane = 0.0f;
+	if (projection[2][3] != 0.0f)
+	{
+		nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+		farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+	}
+	else
+	{
+		nearPlane = (projection[3][2] + 1.0f) / projection[2][2];
+		farPlane = (projection[3][2] - 1.0f) / projection[2][2];
+	}
+	// the depth slices are exponential, so they need a near plane in front of the camera
+	nearPlane = std::max(nearPlane, 0.01f);
+	farPlane = std::max(farPlane, nearPlane * 2.0f);
+
+	m_tileScale = glm::vec2(
+		(float)CLUSTER_GRID_X / (float)std::max(viewportWidth, 1),
+		(float)CLUSTER_GRID_Y / (float)std::max(viewportHeight, 1));
+	const float depthScale = (float)CLUSTER_GRID_Z / std::log(farPlane / nearPlane);
+	m_depthScaleBias = glm::vec2(depthScale, -depthScale * std::log(nearPlane));
+
+	// count the lights reaching every cluster
+	LIGHT_CLUSTER emptyCluster = { 0, 0 };
+	m_clusters.assign(CLUSTER_COUNT, emptyCluster);
+	m_lightRanges.resize(lightSpheres.size());
+	for (size_t i = 0; i < lightSpheres.size(); i++)
+	{
+		CLUSTER_RANGE& range = m_lightRanges[i];
+		if (!FindClusterRange(lightSpheres[i], nearPlane, farPlane, range))
+		{
+			range.minX = range.maxX = 0;
+			range.minY = range.maxY = 0;
+			range.minZ = range.maxZ = 0;
+			continue;
+		}
+
+		for (int z = range.minZ; z < range.maxZ; z++)
+		{
+			for (int y = range.minY; y < range.maxY; y++)
+			{
+				for (int x = range.minX; x < range.maxX; x++)
+				{
+					m_clusters[x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z)].count++;
+				}
+			}
+		}
+	}
+
+	// give every cluster its range of the index list
+	uint32_t total = 0;
+	for (int i = 0; i < CLUSTER_COUNT; i++)
+	{
+		m_clusters[i].offset = total;
+		total += m_clusters[i].count;
+		m_clusters[i].count = 0;
+	}
+
+	// fill the ranges, in light order within each cluster
+	m_lightIndices.resize(total);
+	for (size_t i = 0; i < m_lightRanges.size(); i++)
+	{
+		const CLUSTER_RANGE& range = m_lightRanges[i];
+		for (int z = range.minZ; z < range.maxZ; z++)
+		{
+			for (int y = range.minY; y < range.maxY; y++)
+			{
+				for (int x = range.minX; x < range.maxX; x++)
+				{
+					LIGHT_CLUSTER& cluster = m_clusters[x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z)];
+					m_lightIndices[cluster.offset + cluster.count++] = (uint32_t)(firstLight + (int)i);
+				}
+			}
+		}
+	}
+
+	Upload();
+}
+
+/***********************************************************
+ *  FindClusterRange()
+ *
+ *  This method is used for finding the box of clusters a
+ *  light sphere can reach.  The depth range comes from the
+ *  sphere's nearest and furthest view depth, the tile range
+ *  from projecting the corners of the box around it.  A
+ *  sphere reaching in front of the near plane can cover any
+ *  part of the screen, so it gets every tile.
+ ***********************************************************/
+bool LightClusters::FindClusterRange(
+	const glm::vec4& lightSphere,
+	float nearPlane,
+	float farPlane,
+	CLUSTER_RANGE& range) const
+{
+	const glm::vec4 center = m_view * glm::vec4(lightSphere.x, lightSphere.y, lightSphere.z, 1.0f);
+	const float radius = lightSphere.w;
+	const float depth = -center.z;
+
+	if ((depth + radius < nearPlane) || (depth - radius > farPlane))
+	{
+		return(false);
+	}
+
+	range.minZ = DepthSlice(std::max(depth - radius, nearPlane));
+	range.maxZ = DepthSlice(std::min(depth + radius, farPlane)) + 1;
+	range.minX = 0;
+	range.maxX = CLUSTER_GRID_X;
+	range.minY = 0;
+	range.maxY = CLUSTER_GRID_Y;
+
+	if (depth - radius <= nearPlane)
+	{
+		return(true);
+	}
+
+	float minX = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float minY = FLT_MAX;
+	float maxY = -FLT_MAX;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec4 clip = m_projection * glm::vec4(
+			center.x + ((corner & 1) ? radius : -radius),
+			center.y + ((corner & 2) ? radius : -radius),
+			center.z + ((corner & 4) ? radius : -radius),
+			1.0f);
+		float x = clip.x / clip.w;
+		float y = clip.y / clip.w;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+	}
+
+	if ((maxX < -1.0f) || (minX > 1.0f) || (maxY < -1.0f) || (minY > 1.0f))
+	{
+		return(false);
+	}
+
+	range.minX = TileIndex(minX, CLUSTER_GRID_X);
+	range.maxX = TileIndex(maxX, CLUSTER_GRID_X) + 1;
+	range.minY = TileIndex(minY, CLUSTER_GRID_Y);
+	range.maxY = TileIndex(maxY, CLUSTER_GRID_Y) + 1;
+	return(true);
+}
+
+/***********************************************************
+ *  DepthSlice()
+ *
+ *  This method is used for getting the depth slice of a view
+ *  depth, the same way the fragment shader does.
+ ***********************************************************/
+int LightClusters::DepthSlice(float depth) const
+{
+	int slice = (int)std::floor(std::log(depth) * m_depthScaleBias.x + m_depthScaleBias.y);
+	return std::min(std::max(slice, 0), CLUSTER_GRID_Z - 1);
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method is used for copying the cluster ranges and
+ *  the light index lists into their storage buffers.  The
+ *  index buffer grows by doubling and is otherwise reused.
+ ***********************************************************/
+void LightClusters::Upload()
+{
+	static_assert(sizeof(LIGHT_CLUSTER) == 8, "LIGHT_CLUSTER must match the std430 uvec2 layout");
+
+	if (m_clusterBuffer == 0)
+	{
+		glGenBuffers(1, &m_clusterBuffer);
+		g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_clusterBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(LIGHT_CLUSTER) * CLUSTER_COUNT, NULL, GL_DYNAMIC_DRAW);
+	}
+	g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_clusterBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LIGHT_CLUSTER) * CLUSTER_COUNT, m_clusters.data());
+
+	if ((m_indexBuffer == 0) || (m_lightIndices.size() > m_indexCapacity))
+	{
+		if (m_indexBuffer == 0)
+		{
+			glGenBuffers(1, &m_indexBuffer);
+		}
+		m_indexCapacity = std::max(std::max(m_indexCapacity * 2, m_lightIndices.size()), MIN_INDEX_CAPACITY);
+		g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_indexBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * m_indexCapacity, NULL, GL_DYNAMIC_DRAW);
+	}
+	g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_indexBuffer);
+	if (!m_lightIndices.empty())
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t) * m_lightIndices.size(), m_lightIndices.data());
+	}
+
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHT_CLUSTERS, m_clusterBuffer);
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHT_INDICES, m_indexBuffer);
+}
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ============
+// assign local lights to the clusters of the view frustum
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// size of the cluster grid, must match the fragment shader
+const int CLUSTER_GRID_X = 16;
+const int CLUSTER_GRID_Y = 9;
+const int CLUSTER_GRID_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+
+// binding points of the shader storage buffers used for
+// lighting, must match the fragment shader
+enum LIGHT_STORAGE_BINDING
+{
+	STORAGE_BINDING_LIGHTS = 0,
+	STORAGE_BINDING_LIGHT_CLUSTERS,
+	STORAGE_BINDING_LIGHT_INDICES
+};
+
+// get the distance at which a light's attenuation has faded
+// its brightest color below what 8-bit output can show, or
+// -1 when the attenuation never gets there
+float AttenuationRadius(float constant, float linear, float quadratic, float brightness);
+
+/***********************************************************
+ *  LightClusters
+ *
+ *  This class divides the view frustum into a grid of
+ *  clusters, screen tiles in x and y and exponential depth
+ *  slices in z, and lists the local lights whose attenuation
+ *  sphere reaches each cluster.  The per-cluster ranges and
+ *  the light index lists are kept in shader storage buffers,
+ *  so a fragment only shades the lights of its own cluster
+ *  however many lights the scene has.
+ ***********************************************************/
+class LightClusters
+{
+public:
+	// constructor
+	LightClusters();
+	// destructor
+	~LightClusters();
+
+	// free the storage buffers
+	void Destroy();
+
+	// assign the world space light spheres, radius in w, to the
+	// clusters of the passed in view.  Light i is written to the
+	// index lists as firstLight + i.  Nothing is done when the
+	// lights and the view are unchanged since the last call.
+	void Assign(
+		const std::vector<glm::vec4>& lightSpheres,
+		int firstLight,
+		bool bLightsChanged,
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		int viewportWidth,
+		int viewportHeight);
+
+	// scale from window pixels to cluster tiles
+	glm::vec2 GetTileScale() const { return m_tileScale; }
+	// scale and bias from log view depth to cluster slice
+	glm::vec2 GetDepthScaleBias() const { return m_depthScaleBias; }
+	// number of light index entries over all clusters
+	size_t GetIndexCount() const { return m_lightIndices.size(); }
+
+private:
+	// range of the light index list used by one cluster,
+	// std430 layout of a uvec2
+	struct LIGHT_CLUSTER
+	{
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	// range of clusters touched by one light, max exclusive
+	struct CLUSTER_RANGE
+	{
+		int minX, maxX;
+		int minY, maxY;
+		int minZ, maxZ;
+	};
+
+	std::vector<LIGHT_CLUSTER> m_clusters;
+	std::vector<uint32_t> m_lightIndices;
+	// scratch list of the cluster range of every light
+	std::vector<CLUSTER_RANGE> m_lightRanges;
+
+	GLuint m_clusterBuffer;
+	GLuint m_indexBuffer;
+	// number of indices the index buffer can hold
+	size_t m_indexCapacity;
+
+	// the view of the last assignment
+	glm::mat4 m_view;
+	glm::mat4 m_projection;
+	int m_viewportWidth;
+	int m_viewportHeight;
+
+	glm::vec2 m_tileScale;
+	glm::vec2 m_depthScaleBias;
+
+	bool FindClusterRange(
+		const glm::vec4& lightSphere,
+		float nearPlane,
+		float farPlane,
+		CLUSTER_RANGE& range) const;
+	int DepthSlice(float depth) const;
+	void Upload();
+};
@@ -1,5 +1,7 @@
 #include <iostream>         // error handling and output
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
+#include <string>
 
 #include <GL/glew.h>        // GLEW library
 #include "GLFW/glfw3.h"     // GLFW library
@@ -14,6 +16,12 @@
 #include "ShapeMeshes.h"
 #include "Camera.h"
 #include "ShaderManager.h"
+#include "SceneFile.h"
+#include "TextureCache.h"
+#include "Profiler.h"
+#include "GLStateCache.h"
+#include "Benchmark.h"
+#include "ShaderLoader.h"
 
 // Namespace for declaring global variables
 namespace
@@ -24,6 +32,9 @@ namespace
 	// Main GLFW window
 	GLFWwindow* g_Window = nullptr;
 
+	// simulated seconds per frame of a played back camera track
+	const float CAMERA_PLAYBACK_TIMESTEP = 1.0f / 60.0f;
+
 	// scene manager object for managing the 3D scene prepare and render
 	SceneManager* g_SceneManager = nullptr;
 	// shader manager object for dynamic interaction with the shader code
@@ -36,6 +47,9 @@ namespace
 // need to be pre-declared at the beginning of the source code.
 bool InitializeGLFW();
 bool InitializeGLEW();
+int BakeTextures(int argc, char* argv[]);
+int RunBenchmark(const BENCHMARK_OPTIONS& options);
+void RenderOffscreenFrame(GLsync frameFences[GPU_QUERY_FRAMES], int frame);
 
 
 /***********************************************************
@@ -46,6 +60,86 @@ bool InitializeGLEW();
  ***********************************************************/
 int main(int argc, char* argv[])
 {
+	// bake the texture cache offline and exit, no window needed
+	if ((argc > 1) && (strcmp(argv[1], "--bake-textures") == 0))
+	{
+		return(BakeTextures(argc - 2, argv + 2));
+	}
+
+	// render a fixed number of frames offscreen and report their timing
+	BENCHMARK_OPTIONS benchmarkOptions;
+	if (ParseBenchmarkOptions(argc, argv, benchmarkOptions))
+	{
+		return(RunBenchmark(benchmarkOptions));
+	}
+
+	// --trace <file> profiles the whole run into a chrome://tracing file,
+	// --record-camera <file> records the camera into a track and
+	// --play-camera <file> replays one instead of live input and
+	// --gpu-culling culls the scene in a compute shader,
+	// --occlusion-culling also culls what the large objects hide,
+	// --no-shader-cache always compiles the shaders,
+	// --bake-static merges the static objects per material,
+	// --no-lod always draws full detail,
+	// --pipelined-frames prepares the next frame while one is drawn and
+	// --cylinder-slices <n> sets the full detail cylinder
+	const char* traceFilename = NULL;
+	const char* recordCameraFilename = NULL;
+	const char* playCameraFilename = NULL;
+	bool bGpuCulling = false;
+	bool bOcclusionCulling = false;
+	bool bStaticBaking = false;
+	bool bLevelOfDetail = true;
+	bool bPipelinedFrames = false;
+	int cylinderSlices = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--gpu-culling") == 0)
+		{
+			bGpuCulling = true;
+		}
+		else if (strcmp(argv[i], "--occlusion-culling") == 0)
+		{
+			bOcclusionCulling = true;
+		}
+		else if (strcmp(argv[i], "--no-shader-cache") == 0)
+		{
+			SetProgramCacheEnabled(false);
+		}
+		else if (strcmp(argv[i], "--bake-static") == 0)
+		{
+			bStaticBaking = true;
+		}
+		else if (strcmp(argv[i], "--no-lod") == 0)
+		{
+			bLevelOfDetail = false;
+		}
+		else if (strcmp(argv[i], "--pipelined-frames") == 0)
+		{
+			bPipelinedFrames = true;
+		}
+		else if (i + 1 >= argc)
+		{
+			break;
+		}
+		else if (strcmp(argv[i], "--trace") == 0)
+		{
+			traceFilename = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--record-camera") == 0)
+		{
+			recordCameraFilename = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--play-camera") == 0)
+		{
+			playCameraFilename = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--cylinder-slices") == 0)
+		{
+			cylinderSlices = atoi(argv[i + 1]);
+		}
+	}
+
 	// if GLFW fails initialization, then terminate the application
 	if (InitializeGLFW() == false)
 	{
@@ -67,40 +161,107 @@ int main(int argc, char* argv[])
 		return(EXIT_FAILURE);
 	}
 
-	// load the shader code from the external GLSL files
-	g_ShaderManager->LoadShaders(
-		"C:/snhu/CS330Content/Utilities/shaders/vertexShader.glsl",
-		"C:/snhu/CS330Content/Utilities/shaders/fragmentShader.glsl");
+	// the GPU timers need the OpenGL context
+	g_Profiler.Initialize();
+	if (NULL != traceFilename)
+	{
+		g_Profiler.StartCapture();
+	}
+
+	if (NULL != playCameraFilename)
+	{
+		g_ViewManager->StartPlayback(playCameraFilename, CAMERA_PLAYBACK_TIMESTEP);
+	}
+	else if (NULL != recordCameraFilename)
+	{
+		g_ViewManager->StartRecording(recordCameraFilename);
+	}
+
+	// load the shader code from the external GLSL files, or
+	// its linked binary from the program cache
+	g_ShaderManager->m_programID = LoadShaderProgram(
+		"shaders/vertexShader.glsl",
+		"shaders/fragmentShader.glsl");
+	if (g_ShaderManager->m_programID == 0)
+	{
+		return(EXIT_FAILURE);
+	}
 	g_ShaderManager->use();
 
 	// try to create a new scene manager object and prepare the 3D scene
 	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager->SetStaticBaking(bStaticBaking);
+	if (cylinderSlices > 0)
+	{
+		g_SceneManager->SetCylinderTessellation(cylinderSlices);
+	}
 	g_SceneManager->PrepareScene();
+	g_SceneManager->SetLevelOfDetail(bLevelOfDetail);
+	g_SceneManager->SetPipelinedFrames(bPipelinedFrames);
+	if (bOcclusionCulling)
+	{
+		g_SceneManager->SetOcclusionCulling(true);
+	}
+	else if (bGpuCulling)
+	{
+		g_SceneManager->SetGpuCulling(true);
+	}
 
 	// loop will keep running until the application is closed 
 	// or until an error has occurred
 	while (!glfwWindowShouldClose(g_Window))
 	{
+		g_Profiler.BeginFrame();
+
 		// Enable z-depth
-		glEnable(GL_DEPTH_TEST);
+		g_GLState.Enable(GL_DEPTH_TEST);
 
 		// Clear the frame and z buffers
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+		g_GLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// convert from 3D object space to 2D view
 		g_ViewManager->PrepareSceneView();
+		g_SceneManager->SetViewParameters(
+			g_ViewManager->GetViewMatrix(),
+			g_ViewManager->GetProjectionMatrix(),
+			g_ViewManager->GetViewPosition());
 
 		// refresh the 3D scene
 		g_SceneManager->RenderScene();
 
 
 		// Flips the the back buffer with the front buffer every frame.
-		glfwSwapBuffers(g_Window);
+		{
+			ProfileScope swapScope("SwapBuffers");
+			glfwSwapBuffers(g_Window);
+		}
 
 		// query the latest GLFW events
 		glfwPollEvents();
+
+		g_Profiler.EndFrame();
+		g_GLState.EndFrame();
+
+		// show the rolling frame time percentiles, the GL calls
+		// and the draws of the last frame in the title
+		std::string profileSummary;
+		if (g_Profiler.GetSummary(profileSummary))
+		{
+			const GL_STATE_STATS& glStats = g_GLState.GetFrameStats();
+			profileSummary += " | GL calls " + std::to_string(glStats.issued) +
+				", " + std::to_string(glStats.suppressed) + " skipped | " +
+				g_SceneManager->GetRenderSummary();
+			glfwSetWindowTitle(g_Window, (std::string(WINDOW_TITLE) + " | " + profileSummary).c_str());
+		}
+	}
+
+	if (NULL != traceFilename)
+	{
+		g_Profiler.StopCapture(traceFilename);
 	}
+	g_Profiler.Destroy();
+	g_ViewManager->StopRecording();
 
 	// clear the allocated manager objects from memory
 	if (NULL != g_SceneManager)
@@ -123,6 +284,220 @@ int main(int argc, char* argv[])
 	exit(EXIT_SUCCESS); 
 }
 
+/***********************************************************
+ *  BakeTextures()
+ *
+ *  This function is used for filling the texture cache ahead
+ *  of time.  Every argument is either an image or a scene
+ *  file, in which case all of the scene's textures are baked.
+ *  Images that already have a current entry are skipped.
+ ***********************************************************/
+int BakeTextures(int argc, char* argv[])
+{
+	TextureCache cache;
+	std::vector<std::string> images;
+
+	for (int i = 0; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		const std::string extension = ".scene";
+		bool bScene = (argument.size() > extension.size()) &&
+			(argument.compare(argument.size() - extension.size(), extension.size(), extension) == 0);
+
+		if (bScene)
+		{
+			SceneFile scene;
+			if (!scene.LoadText(argument.c_str()))
+			{
+				std::cout << "Could not load scene file:" << argument << std::endl;
+				return(EXIT_FAILURE);
+			}
+			for (size_t j = 0; j < scene.m_textures.size(); j++)
+			{
+				images.push_back(scene.m_textures[j].filename);
+			}
+		}
+		else
+		{
+			images.push_back(argument);
+		}
+	}
+
+	if (images.empty())
+	{
+		std::cout << "Usage: --bake-textures <image or .scene file>..." << std::endl;
+		return(EXIT_FAILURE);
+	}
+
+	int failures = 0;
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (cache.IsCurrent(images[i]))
+		{
+			std::cout << "Texture cache is current:" << images[i] << std::endl;
+			continue;
+		}
+		if (!cache.Bake(images[i]))
+		{
+			failures++;
+		}
+	}
+
+	return((failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/***********************************************************
+ *  RunBenchmark()
+ *
+ *  This function is used for timing the render loop without
+ *  a visible window, so it can run in automation, also on
+ *  software renderers like Mesa llvmpipe.  The scene renders
+ *  into an offscreen framebuffer until the textures finished
+ *  streaming in, then for the warm-up frames, and then the
+ *  measured frames are recorded and written as JSON.
+ ***********************************************************/
+int RunBenchmark(const BENCHMARK_OPTIONS& options)
+{
+	// the most frames rendered while waiting for the textures
+	const int MAX_STREAMING_FRAMES = 10000;
+
+	if (InitializeGLFW() == false)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	g_ShaderManager = new ShaderManager();
+	g_ViewManager = new ViewManager(
+		g_ShaderManager);
+
+	g_Window = g_ViewManager->CreateOffscreenWindow(WINDOW_TITLE, options.width, options.height);
+	if ((NULL == g_Window) || (InitializeGLEW() == false) || !g_ViewManager->CreateOffscreenTarget())
+	{
+		return(EXIT_FAILURE);
+	}
+	// nothing is presented, so never wait for a display refresh
+	glfwSwapInterval(0);
+	g_Profiler.Initialize();
+
+	if (!options.cameraTrackFilename.empty() &&
+		!g_ViewManager->StartPlayback(options.cameraTrackFilename.c_str(), CAMERA_PLAYBACK_TIMESTEP))
+	{
+		return(EXIT_FAILURE);
+	}
+
+	SetProgramCacheEnabled(options.bShaderCache);
+	int64_t loadShadersStart = g_Profiler.Now();
+	g_ShaderManager->m_programID = LoadShaderProgram(
+		"shaders/vertexShader.glsl",
+		"shaders/fragmentShader.glsl");
+	if (g_ShaderManager->m_programID == 0)
+	{
+		return(EXIT_FAILURE);
+	}
+	g_ShaderManager->use();
+	float loadShadersMilliseconds = (float)(g_Profiler.Now() - loadShadersStart) / 1000.0f;
+
+	int64_t prepareStart = g_Profiler.Now();
+	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager->SetStaticBaking(options.bStaticBaking);
+	g_SceneManager->PrepareScene();
+	g_SceneManager->SetLevelOfDetail(options.bLevelOfDetail);
+	g_SceneManager->SetPipelinedFrames(options.bPipelinedFrames);
+	if (options.bGpuCulling && !g_SceneManager->SetGpuCulling(true))
+	{
+		return(EXIT_FAILURE);
+	}
+	if (options.bOcclusionCulling && !g_SceneManager->SetOcclusionCulling(true))
+	{
+		return(EXIT_FAILURE);
+	}
+	float prepareSceneMilliseconds = (float)(g_Profiler.Now() - prepareStart) / 1000.0f;
+
+	GLsync frameFences[GPU_QUERY_FRAMES] = { 0 };
+	int frame = 0;
+	while (g_SceneManager->IsStreaming() && (frame < MAX_STREAMING_FRAMES))
+	{
+		RenderOffscreenFrame(frameFences, frame++);
+	}
+	for (int i = 0; i < options.warmupFrames; i++)
+	{
+		RenderOffscreenFrame(frameFences, frame++);
+	}
+
+	// the measured frames always start at the beginning of the track
+	g_ViewManager->RestartPlayback();
+	g_Profiler.StartFrameRecording();
+	for (int i = 0; i < options.frames; i++)
+	{
+		RenderOffscreenFrame(frameFences, frame++);
+	}
+	g_Profiler.FinishFrames();
+
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	bool bWritten = WriteBenchmarkResults(
+		options,
+		g_Profiler.GetRecordedFrames(),
+		loadShadersMilliseconds,
+		prepareSceneMilliseconds,
+		(NULL != renderer) ? renderer : "");
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		if (frameFences[i] != 0)
+		{
+			glDeleteSync(frameFences[i]);
+		}
+	}
+	g_Profiler.Destroy();
+	delete g_SceneManager;
+	g_SceneManager = NULL;
+	delete g_ViewManager;
+	g_ViewManager = NULL;
+	delete g_ShaderManager;
+	g_ShaderManager = NULL;
+	glfwTerminate();
+
+	return(bWritten ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/***********************************************************
+ *  RenderOffscreenFrame()
+ *
+ *  This function is used for rendering one benchmark frame.
+ *  With nothing presented there is no swap chain to hold the
+ *  CPU back, so a fence per frame in flight does it instead.
+ *  The wait is outside the timed frame.
+ ***********************************************************/
+void RenderOffscreenFrame(GLsync frameFences[GPU_QUERY_FRAMES], int frame)
+{
+	GLsync& fence = frameFences[frame % GPU_QUERY_FRAMES];
+	if (fence != 0)
+	{
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	g_Profiler.BeginFrame();
+
+	g_GLState.Enable(GL_DEPTH_TEST);
+	g_GLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	g_ViewManager->PrepareSceneView();
+	g_SceneManager->SetViewParameters(
+		g_ViewManager->GetViewMatrix(),
+		g_ViewManager->GetProjectionMatrix(),
+		g_ViewManager->GetViewPosition());
+	g_SceneManager->RenderScene();
+
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	g_Profiler.EndFrame();
+	g_GLState.EndFrame();
+}
+
 /***********************************************************
  *	InitializeGLFW()
  * 
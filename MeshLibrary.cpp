@@ -0,0 +1,728 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.cpp
+// ============
+// keep every mesh in shared buffers and draw them singly, instanced
+// or as indirect commands
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshLibrary.h"
+#include "MeshOptimizer.h"
+#include "GLStateCache.h"
+
+#include <cmath>
+#include <cstddef>
+
+// declaration of local helpers
+namespace
+{
+	// number of slices around the full detail cylinder
+	const int CYLINDER_SLICES = 36;
+	// the coarser cylinder levels halve the slices down to this
+	const int CYLINDER_MIN_SLICES = 6;
+	// viewport height fractions below which each coarser
+	// cylinder level takes over
+	const float CYLINDER_LOD_SCREEN_SIZES[] = { 0.15f, 0.05f };
+	const int CYLINDER_LOD_COUNT = sizeof(CYLINDER_LOD_SCREEN_SIZES) / sizeof(CYLINDER_LOD_SCREEN_SIZES[0]);
+
+	void AddVertex(MESH_DATA& mesh, glm::vec3 position, glm::vec3 normal, glm::vec2 textureCoordinate)
+	{
+		MESH_VERTEX vertex;
+		vertex.position = position;
+		vertex.normal = normal;
+		vertex.textureCoordinate = textureCoordinate;
+		mesh.vertices.push_back(vertex);
+	}
+
+	// add a flat triangle, the corners must be counter-clockwise
+	// when seen from the outside of the mesh
+	void AddTriangle(MESH_DATA& mesh, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+	{
+		GLuint base = (GLuint)mesh.vertices.size();
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+		AddVertex(mesh, p0, normal, glm::vec2(0.0f, 0.0f));
+		AddVertex(mesh, p1, normal, glm::vec2(1.0f, 0.0f));
+		AddVertex(mesh, p2, normal, glm::vec2(0.5f, 1.0f));
+		mesh.indices.push_back(base);
+		mesh.indices.push_back(base + 1);
+		mesh.indices.push_back(base + 2);
+	}
+
+	// add a flat quad, the corners must be counter-clockwise
+	// when seen from the outside of the mesh
+	void AddQuad(MESH_DATA& mesh, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+	{
+		GLuint base = (GLuint)mesh.vertices.size();
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+		AddVertex(mesh, p0, normal, glm::vec2(0.0f, 0.0f));
+		AddVertex(mesh, p1, normal, glm::vec2(1.0f, 0.0f));
+		AddVertex(mesh, p2, normal, glm::vec2(1.0f, 1.0f));
+		AddVertex(mesh, p3, normal, glm::vec2(0.0f, 1.0f));
+		mesh.indices.push_back(base);
+		mesh.indices.push_back(base + 1);
+		mesh.indices.push_back(base + 2);
+		mesh.indices.push_back(base);
+		mesh.indices.push_back(base + 2);
+		mesh.indices.push_back(base + 3);
+	}
+
+	// flat plane facing up, 2 units wide and deep
+	void GeneratePlane(MESH_DATA& mesh)
+	{
+		AddQuad(mesh,
+			glm::vec3(-1.0f, 0.0f, 1.0f), glm::vec3(1.0f, 0.0f, 1.0f),
+			glm::vec3(1.0f, 0.0f, -1.0f), glm::vec3(-1.0f, 0.0f, -1.0f));
+	}
+
+	// unit box centered on the origin
+	void GenerateBox(MESH_DATA& mesh)
+	{
+		const float h = 0.5f;
+		AddQuad(mesh, glm::vec3(-h, -h, h), glm::vec3(h, -h, h), glm::vec3(h, h, h), glm::vec3(-h, h, h));
+		AddQuad(mesh, glm::vec3(h, -h, -h), glm::vec3(-h, -h, -h), glm::vec3(-h, h, -h), glm::vec3(h, h, -h));
+		AddQuad(mesh, glm::vec3(h, -h, h), glm::vec3(h, -h, -h), glm::vec3(h, h, -h), glm::vec3(h, h, h));
+		AddQuad(mesh, glm::vec3(-h, -h, -h), glm::vec3(-h, -h, h), glm::vec3(-h, h, h), glm::vec3(-h, h, -h));
+		AddQuad(mesh, glm::vec3(-h, h, h), glm::vec3(h, h, h), glm::vec3(h, h, -h), glm::vec3(-h, h, -h));
+		AddQuad(mesh, glm::vec3(-h, -h, -h), glm::vec3(h, -h, -h), glm::vec3(h, -h, h), glm::vec3(-h, -h, h));
+	}
+
+	// pyramid with a triangular base, centered on the origin
+	void GeneratePyramid3(MESH_DATA& mesh)
+	{
+		glm::vec3 left(-0.5f, -0.5f, 0.5f);
+		glm::vec3 right(0.5f, -0.5f, 0.5f);
+		glm::vec3 back(0.0f, -0.5f, -0.5f);
+		glm::vec3 top(0.0f, 0.5f, 0.0f);
+		AddTriangle(mesh, left, right, top);
+		AddTriangle(mesh, right, back, top);
+		AddTriangle(mesh, back, left, top);
+		AddTriangle(mesh, left, back, right);
+	}
+
+	// triangular prism along the z axis, centered on the origin
+	void GeneratePrism(MESH_DATA& mesh)
+	{
+		glm::vec3 frontLeft(-0.5f, -0.5f, 0.5f);
+		glm::vec3 frontRight(0.5f, -0.5f, 0.5f);
+		glm::vec3 frontTop(0.0f, 0.5f, 0.5f);
+		glm::vec3 backLeft(-0.5f, -0.5f, -0.5f);
+		glm::vec3 backRight(0.5f, -0.5f, -0.5f);
+		glm::vec3 backTop(0.0f, 0.5f, -0.5f);
+		AddTriangle(mesh, frontLeft, frontRight, frontTop);
+		AddTriangle(mesh, backRight, backLeft, backTop);
+		AddQuad(mesh, backLeft, backRight, frontRight, frontLeft);
+		AddQuad(mesh, frontRight, backRight, backTop, frontTop);
+		AddQuad(mesh, frontTop, backTop, backLeft, frontLeft);
+	}
+
+	// cylinder of radius 1 standing on the origin, 1 unit tall,
+	// with smooth sides and flat caps
+	void GenerateCylinder(MESH_DATA& mesh, int slices)
+	{
+		const float twoPi = 6.28318530718f;
+
+		// sides, one column of two vertices per slice edge
+		GLuint base = (GLuint)mesh.vertices.size();
+		for (int i = 0; i <= slices; i++)
+		{
+			float angle = twoPi * (float)i / (float)slices;
+			float x = cosf(angle);
+			float z = -sinf(angle);
+			float u = (float)i / (float)slices;
+			AddVertex(mesh, glm::vec3(x, 0.0f, z), glm::vec3(x, 0.0f, z), glm::vec2(u, 0.0f));
+			AddVertex(mesh, glm::vec3(x, 1.0f, z), glm::vec3(x, 0.0f, z), glm::vec2(u, 1.0f));
+		}
+		for (int i = 0; i < slices; i++)
+		{
+			GLuint bottom = base + i * 2;
+			mesh.indices.push_back(bottom);
+			mesh.indices.push_back(bottom + 2);
+			mesh.indices.push_back(bottom + 3);
+			mesh.indices.push_back(bottom);
+			mesh.indices.push_back(bottom + 3);
+			mesh.indices.push_back(bottom + 1);
+		}
+
+		// caps, a center vertex and a ring for each
+		for (int cap = 0; cap < 2; cap++)
+		{
+			float y = (cap == 0) ? 1.0f : 0.0f;
+			glm::vec3 normal(0.0f, (cap == 0) ? 1.0f : -1.0f, 0.0f);
+			GLuint center = (GLuint)mesh.vertices.size();
+			AddVertex(mesh, glm::vec3(0.0f, y, 0.0f), normal, glm::vec2(0.5f, 0.5f));
+			for (int i = 0; i <= slices; i++)
+			{
+				float angle = twoPi * (float)i / (float)slices;
+				float x = cosf(angle);
+				float z = -sinf(angle);
+				AddVertex(mesh, glm::vec3(x, y, z), normal, glm::vec2(0.5f + 0.5f * x, 0.5f - 0.5f * z));
+			}
+			for (int i = 0; i < slices; i++)
+			{
+				GLuint ring = center + 1 + i;
+				mesh.indices.push_back(center);
+				mesh.indices.push_back((cap == 0) ? ring : ring + 1);
+				mesh.indices.push_back((cap == 0) ? ring + 1 : ring);
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  MeshLibrary()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MeshLibrary::MeshLibrary()
+{
+	m_vertexArray = 0;
+	m_vertexBuffer = 0;
+	m_indexBuffer = 0;
+	m_vertexCapacity = 0;
+	m_indexCapacity = 0;
+	m_vertexCount = 0;
+	m_indexCount = 0;
+	m_instanceBuffer = 0;
+	m_stats = MESH_LIBRARY_STATS();
+	m_cylinderSlices = CYLINDER_SLICES;
+}
+
+/***********************************************************
+ *  ~MeshLibrary()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MeshLibrary::~MeshLibrary()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  SetCylinderTessellation()
+ *
+ *  This method is used for choosing the slices around the
+ *  generated cylinder at full detail.
+ ***********************************************************/
+void MeshLibrary::SetCylinderTessellation(int slices)
+{
+	m_cylinderSlices = (slices > CYLINDER_MIN_SLICES) ? slices : CYLINDER_MIN_SLICES;
+}
+
+/***********************************************************
+ *  Load()
+ *
+ *  This method is used for generating every basic mesh and
+ *  adding it to the shared buffers, so the basic meshes get
+ *  the IDs of their MESH_TYPE.  The generated vertices are
+ *  kept so they can be reused on the CPU.
+ ***********************************************************/
+void MeshLibrary::Load()
+{
+	Destroy();
+
+	MESH_DATA basicMeshes[MESH_COUNT];
+	GeneratePlane(basicMeshes[MESH_PLANE]);
+	GenerateBox(basicMeshes[MESH_BOX]);
+	GeneratePyramid3(basicMeshes[MESH_PYRAMID3]);
+	GenerateCylinder(basicMeshes[MESH_CYLINDER], m_cylinderSlices);
+	GeneratePrism(basicMeshes[MESH_PRISM]);
+
+	// size the buffers for all of them at once
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (int i = 0; i < MESH_COUNT; i++)
+	{
+		vertexCount += basicMeshes[i].vertices.size();
+		indexCount += basicMeshes[i].indices.size();
+	}
+	Reserve(vertexCount, indexCount);
+
+	for (int i = 0; i < MESH_COUNT; i++)
+	{
+		AddMesh(basicMeshes[i]);
+	}
+
+	// the cylinder is the only curved mesh, the flat ones have
+	// nothing to take away
+	int slices = m_cylinderSlices;
+	for (int level = 0; (level < CYLINDER_LOD_COUNT) && (slices / 2 >= CYLINDER_MIN_SLICES); level++)
+	{
+		slices /= 2;
+		MESH_DATA cylinder;
+		GenerateCylinder(cylinder, slices);
+		AddLod(MESH_CYLINDER, cylinder, CYLINDER_LOD_SCREEN_SIZES[level]);
+	}
+}
+
+/***********************************************************
+ *  AddMesh()
+ *
+ *  This method is used for suballocating a mesh from the
+ *  shared vertex and index buffers.  The triangles are first
+ *  reordered for the vertex cache and the vertices for fetch
+ *  order, then the vertices are packed.  Indices stay
+ *  relative to the mesh, its base vertex is added when it is
+ *  drawn.  A released mesh with room for the new one gives
+ *  it its ID and range, otherwise the mesh goes after the
+ *  others.  The returned ID is the mesh's index in the
+ *  library, or -1 for an empty mesh.
+ ***********************************************************/
+int MeshLibrary::AddMesh(const MESH_DATA& sourceMesh)
+{
+	if (sourceMesh.vertices.empty() || sourceMesh.indices.empty())
+	{
+		return(-1);
+	}
+
+	MESH_DATA mesh = sourceMesh;
+	m_stats.vertexCount += mesh.vertices.size();
+	m_stats.triangleCount += mesh.indices.size() / 3;
+	m_stats.cacheMissesBefore += CountVertexCacheMisses(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIMULATED_SIZE);
+	OptimizeVertexCache(mesh);
+	OptimizeVertexFetch(mesh);
+	m_stats.cacheMissesAfter += CountVertexCacheMisses(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIMULATED_SIZE);
+
+	for (size_t r = 0; r < m_releasedMeshes.size(); r++)
+	{
+		const int meshID = m_releasedMeshes[r];
+		const MESH_RANGE& range = m_meshes[meshID];
+		if ((mesh.vertices.size() <= range.vertexCapacity) && (mesh.indices.size() <= range.indexCapacity))
+		{
+			m_releasedMeshes.erase(m_releasedMeshes.begin() + r);
+			WriteMesh(meshID, mesh);
+			return(meshID);
+		}
+	}
+
+	Reserve(m_vertexCount + mesh.vertices.size(), m_indexCount + mesh.indices.size());
+
+	MESH_RANGE range;
+	range.firstIndex = (GLuint)m_indexCount;
+	range.indexCount = 0;
+	range.baseVertex = (GLint)m_vertexCount;
+	range.vertexCapacity = mesh.vertices.size();
+	range.indexCapacity = mesh.indices.size();
+	m_vertexCount += mesh.vertices.size();
+	m_indexCount += mesh.indices.size();
+
+	m_meshes.push_back(range);
+	m_meshData.push_back(MESH_DATA());
+	m_localBounds.push_back(AABB());
+	m_dequantizations.push_back(MESH_DEQUANTIZATION());
+	m_packedBounds.push_back(AABB());
+	m_nextLods.push_back(-1);
+	m_nextLodScreenSizes.push_back(0.0f);
+
+	const int meshID = (int)m_meshes.size() - 1;
+	WriteMesh(meshID, mesh);
+	return(meshID);
+}
+
+/***********************************************************
+ *  WriteMesh()
+ *
+ *  This method is used for packing an optimized mesh into
+ *  the range of a mesh ID, which must have room for it, and
+ *  keeping its vertices and bounds.
+ ***********************************************************/
+void MeshLibrary::WriteMesh(int meshID, const MESH_DATA& mesh)
+{
+	std::vector<PACKED_VERTEX> packedVertices;
+	MESH_DEQUANTIZATION dequantization;
+	QuantizeMesh(mesh, packedVertices, dequantization);
+
+	MESH_RANGE& range = m_meshes[meshID];
+	range.indexCount = (GLsizei)mesh.indices.size();
+
+	g_GLState.BindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * sizeof(PACKED_VERTEX),
+		packedVertices.size() * sizeof(PACKED_VERTEX), packedVertices.data());
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, m_indexBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, range.firstIndex * sizeof(GLuint),
+		mesh.indices.size() * sizeof(GLuint), mesh.indices.data());
+
+	// bounds of the vertices, for culling
+	AABB bounds;
+	bounds.min = mesh.vertices[0].position;
+	bounds.max = mesh.vertices[0].position;
+	for (size_t v = 1; v < mesh.vertices.size(); v++)
+	{
+		bounds.min = glm::min(bounds.min, mesh.vertices[v].position);
+		bounds.max = glm::max(bounds.max, mesh.vertices[v].position);
+	}
+
+	// the same bounds in the space of the packed positions
+	const glm::mat4& toPacked = dequantization.position;
+	AABB packedBounds;
+	packedBounds.min = (bounds.min - glm::vec3(toPacked[3])) / toPacked[0][0];
+	packedBounds.max = (bounds.max - glm::vec3(toPacked[3])) / toPacked[0][0];
+
+	m_meshData[meshID] = mesh;
+	m_localBounds[meshID] = bounds;
+	m_dequantizations[meshID] = dequantization;
+	m_packedBounds[meshID] = packedBounds;
+	m_nextLods[meshID] = -1;
+	m_nextLodScreenSizes[meshID] = 0.0f;
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method is used for making the shared buffers hold at
+ *  least the passed in number of vertices and indices.  A
+ *  buffer that has to grow is replaced by one twice as large
+ *  and the meshes already in it are copied over on the GPU.
+ *  The vertex array is created with the first buffers and
+ *  pointed at the new ones whenever they change.
+ ***********************************************************/
+void MeshLibrary::Reserve(size_t vertexCount, size_t indexCount)
+{
+	bool bBuffersChanged = false;
+
+	if (vertexCount > m_vertexCapacity)
+	{
+		size_t capacity = (m_vertexCapacity * 2 > vertexCount) ? m_vertexCapacity * 2 : vertexCount;
+		GrowBuffer(m_vertexBuffer, m_vertexCount * sizeof(PACKED_VERTEX), capacity * sizeof(PACKED_VERTEX));
+		m_vertexCapacity = capacity;
+		bBuffersChanged = true;
+	}
+	if (indexCount > m_indexCapacity)
+	{
+		size_t capacity = (m_indexCapacity * 2 > indexCount) ? m_indexCapacity * 2 : indexCount;
+		GrowBuffer(m_indexBuffer, m_indexCount * sizeof(GLuint), capacity * sizeof(GLuint));
+		m_indexCapacity = capacity;
+		bBuffersChanged = true;
+	}
+	if (!bBuffersChanged)
+	{
+		return;
+	}
+
+	bool bNewVertexArray = (m_vertexArray == 0);
+	if (bNewVertexArray)
+	{
+		glGenVertexArrays(1, &m_vertexArray);
+	}
+	g_GLState.BindVertexArray(m_vertexArray);
+
+	g_GLState.BindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	// the packed values are normalized to [-1, 1] or [0, 1] as
+	// they are read
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_SHORT, GL_TRUE, sizeof(PACKED_VERTEX),
+		(const void*)offsetof(PACKED_VERTEX, position));
+	glEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+	glVertexAttribPointer(ATTRIBUTE_NORMAL, 2, GL_BYTE, GL_TRUE, sizeof(PACKED_VERTEX),
+		(const void*)offsetof(PACKED_VERTEX, normal));
+	glEnableVertexAttribArray(ATTRIBUTE_TEXTURE_COORDINATE);
+	glVertexAttribPointer(ATTRIBUTE_TEXTURE_COORDINATE, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PACKED_VERTEX),
+		(const void*)offsetof(PACKED_VERTEX, textureCoordinate));
+	g_GLState.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+	// a library loaded again keeps its instance buffer
+	if (bNewVertexArray && (m_instanceBuffer != 0))
+	{
+		SetInstanceBuffer(m_instanceBuffer);
+	}
+}
+
+/***********************************************************
+ *  GrowBuffer()
+ *
+ *  This method is used for replacing a buffer with a larger
+ *  one that starts with the used bytes of the old buffer.
+ ***********************************************************/
+void MeshLibrary::GrowBuffer(GLuint& buffer, size_t usedSize, size_t newSize)
+{
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_STATIC_DRAW);
+
+	if (buffer != 0)
+	{
+		if (usedSize > 0)
+		{
+			g_GLState.BindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+		}
+		g_GLState.DeleteBuffers(1, &buffer);
+	}
+	buffer = newBuffer;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the shared vertex array
+ *  and buffers and forgetting every mesh.  The instance
+ *  buffer belongs to the caller and is not freed.
+ ***********************************************************/
+void MeshLibrary::Destroy()
+{
+	if (m_vertexArray != 0)
+	{
+		g_GLState.DeleteVertexArrays(1, &m_vertexArray);
+	}
+	if (m_vertexBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_vertexBuffer);
+	}
+	if (m_indexBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_indexBuffer);
+	}
+	m_vertexArray = 0;
+	m_vertexBuffer = 0;
+	m_indexBuffer = 0;
+	m_vertexCapacity = 0;
+	m_indexCapacity = 0;
+	m_vertexCount = 0;
+	m_indexCount = 0;
+
+	m_meshes.clear();
+	m_meshData.clear();
+	m_localBounds.clear();
+	m_dequantizations.clear();
+	m_packedBounds.clear();
+	m_nextLods.clear();
+	m_nextLodScreenSizes.clear();
+	m_releasedMeshes.clear();
+	m_stats = MESH_LIBRARY_STATS();
+}
+
+/***********************************************************
+ *  AddLod()
+ *
+ *  This method is used for adding a coarser version of a
+ *  mesh after its last level of detail.  The new level is a
+ *  mesh of its own and is drawn instead of the one before it
+ *  once the object is smaller on screen than the passed in
+ *  size.  Procedural meshes pass a lower tessellation, other
+ *  meshes a simplified copy.  Returns the ID of the new mesh,
+ *  or -1 when it could not be added.
+ ***********************************************************/
+int MeshLibrary::AddLod(int meshID, const MESH_DATA& mesh, float screenSize)
+{
+	if (!IsLoaded(meshID))
+	{
+		return(-1);
+	}
+
+	// every level must take over at a smaller size than the
+	// level before it
+	int last = meshID;
+	while (m_nextLods[last] >= 0)
+	{
+		if (screenSize >= m_nextLodScreenSizes[last])
+		{
+			return(-1);
+		}
+		last = m_nextLods[last];
+	}
+
+	int lodID = AddMesh(mesh);
+	if (lodID < 0)
+	{
+		return(-1);
+	}
+	m_nextLods[last] = lodID;
+	m_nextLodScreenSizes[last] = screenSize;
+	return(lodID);
+}
+
+/***********************************************************
+ *  ReleaseMesh()
+ *
+ *  This method is used for dropping a mesh that is no longer
+ *  drawn, along with its levels of detail.  Its range in the
+ *  shared buffers stays allocated and is filled again by the
+ *  next AddMesh() that fits in it, so meshes baked again do
+ *  not use up the 8 bit mesh IDs of the draw list.
+ ***********************************************************/
+void MeshLibrary::ReleaseMesh(int meshID)
+{
+	while (IsLoaded(meshID))
+	{
+		const int nextLod = m_nextLods[meshID];
+		m_meshes[meshID].indexCount = 0;
+		m_meshData[meshID] = MESH_DATA();
+		m_nextLods[meshID] = -1;
+		m_nextLodScreenSizes[meshID] = 0.0f;
+		m_releasedMeshes.push_back(meshID);
+		meshID = nextLod;
+	}
+}
+
+/***********************************************************
+ *  GetLodCount()
+ *
+ *  This method is used for counting the levels of detail of
+ *  a mesh, including the mesh itself.
+ ***********************************************************/
+int MeshLibrary::GetLodCount(int meshID) const
+{
+	int count = 1;
+	while (m_nextLods[meshID] >= 0)
+	{
+		meshID = m_nextLods[meshID];
+		count++;
+	}
+	return(count);
+}
+
+/***********************************************************
+ *  GetLodMesh()
+ *
+ *  This method is used for getting the mesh of a level of
+ *  detail, the last level for levels past the end.
+ ***********************************************************/
+int MeshLibrary::GetLodMesh(int meshID, int level) const
+{
+	while ((level > 0) && (m_nextLods[meshID] >= 0))
+	{
+		meshID = m_nextLods[meshID];
+		level--;
+	}
+	return(meshID);
+}
+
+/***********************************************************
+ *  GetLodScreenSize()
+ *
+ *  This method is used for getting the screen size below
+ *  which the level after the passed in one is drawn, or 0
+ *  for the last level.
+ ***********************************************************/
+float MeshLibrary::GetLodScreenSize(int meshID, int level) const
+{
+	return(m_nextLodScreenSizes[GetLodMesh(meshID, level)]);
+}
+
+/***********************************************************
+ *  SetInstanceBuffer()
+ *
+ *  This method is used for pointing the per-instance vertex
+ *  attributes of the shared vertex array at the passed in
+ *  buffer of MESH_INSTANCE records.  The attributes advance
+ *  once per instance instead of once per vertex.  The
+ *  buffer is kept and attached again if the vertex array is
+ *  ever created again.
+ ***********************************************************/
+void MeshLibrary::SetInstanceBuffer(GLuint instanceBuffer)
+{
+	const GLsizei stride = sizeof(MESH_INSTANCE);
+
+	m_instanceBuffer = instanceBuffer;
+	if (m_vertexArray == 0)
+	{
+		return;
+	}
+
+	g_GLState.BindVertexArray(m_vertexArray);
+	g_GLState.BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+	// a mat4 attribute is passed as four vec4 columns
+	for (int column = 0; column < 4; column++)
+	{
+		GLuint location = ATTRIBUTE_INSTANCE_MODEL + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+			(const void*)(offsetof(MESH_INSTANCE, model) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_COLOR);
+	glVertexAttribPointer(ATTRIBUTE_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, stride,
+		(const void*)offsetof(MESH_INSTANCE, color));
+	glVertexAttribDivisor(ATTRIBUTE_INSTANCE_COLOR, 1);
+
+	glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_UV_SCALE);
+	glVertexAttribPointer(ATTRIBUTE_INSTANCE_UV_SCALE, 2, GL_FLOAT, GL_FALSE, stride,
+		(const void*)offsetof(MESH_INSTANCE, uvScale));
+	glVertexAttribDivisor(ATTRIBUTE_INSTANCE_UV_SCALE, 1);
+
+	glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_UV_OFFSET);
+	glVertexAttribPointer(ATTRIBUTE_INSTANCE_UV_OFFSET, 2, GL_FLOAT, GL_FALSE, stride,
+		(const void*)offsetof(MESH_INSTANCE, uvOffset));
+	glVertexAttribDivisor(ATTRIBUTE_INSTANCE_UV_OFFSET, 1);
+
+	// the material index and texture layer are read as integers
+	glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_MATERIAL_LAYER);
+	glVertexAttribIPointer(ATTRIBUTE_INSTANCE_MATERIAL_LAYER, 2, GL_INT, stride,
+		(const void*)offsetof(MESH_INSTANCE, materialIndex));
+	glVertexAttribDivisor(ATTRIBUTE_INSTANCE_MATERIAL_LAYER, 1);
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for binding the shared vertex array,
+ *  every mesh is drawn from it.
+ ***********************************************************/
+void MeshLibrary::Bind() const
+{
+	g_GLState.BindVertexArray(m_vertexArray);
+}
+
+/***********************************************************
+ *  Draw()
+ *
+ *  This method is used for drawing one copy of a mesh with
+ *  the transform and colors currently set in the shader.
+ ***********************************************************/
+void MeshLibrary::Draw(int meshID) const
+{
+	if (!IsLoaded(meshID))
+	{
+		return;
+	}
+
+	const MESH_RANGE& range = m_meshes[meshID];
+	Bind();
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+		(const void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+}
+
+/***********************************************************
+ *  DrawInstanced()
+ *
+ *  This method is used for drawing a range of instances of a
+ *  mesh with one draw call.  The base instance selects where
+ *  the range starts in the instance buffer, so every mesh
+ *  can share one buffer.
+ ***********************************************************/
+void MeshLibrary::DrawInstanced(int meshID, int firstInstance, int instanceCount) const
+{
+	if (!IsLoaded(meshID) || (instanceCount <= 0))
+	{
+		return;
+	}
+
+	const MESH_RANGE& range = m_meshes[meshID];
+	Bind();
+	glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+		(const void*)(range.firstIndex * sizeof(GLuint)), instanceCount, range.baseVertex, (GLuint)firstInstance);
+}
+
+/***********************************************************
+ *  MakeDrawCommand()
+ *
+ *  This method is used for filling the indirect draw command
+ *  of a range of instances of a mesh, as DrawInstanced()
+ *  would draw them.
+ ***********************************************************/
+bool MeshLibrary::MakeDrawCommand(int meshID, int firstInstance, int instanceCount, DRAW_ELEMENTS_COMMAND& command) const
+{
+	if (!IsLoaded(meshID) || (instanceCount <= 0))
+	{
+		return(false);
+	}
+
+	const MESH_RANGE& range = m_meshes[meshID];
+	command.count = (GLuint)range.indexCount;
+	command.instanceCount = (GLuint)instanceCount;
+	command.firstIndex = range.firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = (GLuint)firstInstance;
+	return(true);
+}
@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshlibrary.h
+// ============
+// keep every mesh in shared buffers and draw them singly, instanced
+// or as indirect commands
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneFile.h"
+#include "BoundingVolumeHierarchy.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// version of the basic mesh generators, raise it when they
+// change so files holding generated geometry are rebuilt
+const uint32_t MESH_GENERATION_VERSION = 1;
+
+// vertex attribute locations, must match the vertex shader
+enum MESH_ATTRIBUTE
+{
+	ATTRIBUTE_POSITION = 0,
+	ATTRIBUTE_NORMAL = 1,
+	ATTRIBUTE_TEXTURE_COORDINATE = 2,
+	// the instance model matrix takes four locations, one per column
+	ATTRIBUTE_INSTANCE_MODEL = 3,
+	ATTRIBUTE_INSTANCE_COLOR = 7,
+	ATTRIBUTE_INSTANCE_UV_SCALE = 8,
+	ATTRIBUTE_INSTANCE_MATERIAL_LAYER = 9,
+	ATTRIBUTE_INSTANCE_UV_OFFSET = 10
+};
+
+// one vertex of a basic mesh
+struct MESH_VERTEX
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 textureCoordinate;
+};
+
+// the generated vertices and triangle indices of a mesh
+struct MESH_DATA
+{
+	std::vector<MESH_VERTEX> vertices;
+	std::vector<GLuint> indices;
+};
+
+// one vertex as it is stored in the vertex buffer, see
+// QuantizeMesh(): snorm16 position inside the mesh bounds,
+// octahedral snorm8 normal and unorm16 texture coordinate
+struct PACKED_VERTEX
+{
+	int16_t position[3];
+	int8_t normal[2];
+	uint16_t textureCoordinate[2];
+};
+static_assert(sizeof(PACKED_VERTEX) == 12, "PACKED_VERTEX must match the vertex array layout");
+
+// the values that turn the packed vertices of a mesh back into
+// its own units, the position matrix goes between the model
+// matrix and the vertex, the texture coordinate is the packed
+// one times the UV scale plus the UV offset, and both are then
+// multiplied by the UV scale of the object
+struct MESH_DEQUANTIZATION
+{
+	glm::mat4 position;
+	glm::vec2 uvScale;
+	glm::vec2 uvOffset;
+};
+
+// vertex storage of every mesh added so far, and the vertices a
+// small FIFO cache transforms to draw them in the order they
+// were passed in and in the optimized order
+struct MESH_LIBRARY_STATS
+{
+	size_t vertexCount;
+	size_t triangleCount;
+	size_t cacheMissesBefore;
+	size_t cacheMissesAfter;
+};
+
+/***********************************************************
+ *  MESH_INSTANCE
+ *
+ *  Per-instance vertex data for instanced draws.  Everything
+ *  a single draw would otherwise pass through uniforms is
+ *  here, except the texture array, which must be the same for
+ *  every instance of a draw.  A texture layer of -1 means the
+ *  instance uses its color instead of a texture.  The record
+ *  is padded to the 16 byte multiple of its std430 layout.
+ ***********************************************************/
+struct MESH_INSTANCE
+{
+	glm::mat4 model;
+	glm::vec4 color;
+	glm::vec2 uvScale;
+	int32_t materialIndex;
+	int32_t textureLayer;
+	glm::vec2 uvOffset;
+	int32_t padding[2];
+};
+
+// one indirect draw, laid out as glMultiDrawElementsIndirect
+// reads it
+struct DRAW_ELEMENTS_COMMAND
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/***********************************************************
+ *  MeshLibrary
+ *
+ *  This class keeps every mesh in one vertex buffer and one
+ *  index buffer behind a single vertex array, starting with
+ *  the generated plane, box, pyramid, cylinder and prism.  A
+ *  mesh is a range of the index buffer plus a base vertex, so
+ *  drawing a different mesh never changes the vertex state,
+ *  and the draws of a whole pass can be one
+ *  glMultiDrawElementsIndirect call.  Instances read their
+ *  MESH_INSTANCE record from an instance buffer through the
+ *  base instance of the draw.
+ *
+ *  Added meshes are reordered for the vertex cache and stored
+ *  as 12 byte PACKED_VERTEX records instead of 32 byte
+ *  MESH_VERTEX ones.  Whoever draws a mesh multiplies its
+ *  model matrix and UV scale by the mesh's dequantization.
+ ***********************************************************/
+class MeshLibrary
+{
+public:
+	// constructor
+	MeshLibrary();
+	// destructor
+	~MeshLibrary();
+
+	// slices around the full detail cylinder, the coarser
+	// levels halve them, must be set before Load()
+	void SetCylinderTessellation(int slices);
+	int GetCylinderTessellation() const { return m_cylinderSlices; }
+	// generate every basic mesh and upload it
+	void Load();
+	// optimize and pack a mesh, add it to the shared buffers
+	// and get its ID
+	int AddMesh(const MESH_DATA& mesh);
+	// add a coarser level of detail after the last one of a
+	// mesh, drawn once the object covers less than the passed
+	// in fraction of the viewport height, and get its ID
+	int AddLod(int meshID, const MESH_DATA& mesh, float screenSize);
+	// stop drawing a mesh added with AddMesh(), its ID and its
+	// room in the shared buffers go to a later AddMesh()
+	void ReleaseMesh(int meshID);
+	// free the vertex array and buffers
+	void Destroy();
+
+	// attach an instance buffer of MESH_INSTANCE records to
+	// the vertex array, needed before any instanced draw
+	void SetInstanceBuffer(GLuint instanceBuffer);
+
+	// bind the vertex array every mesh is drawn from
+	void Bind() const;
+	// draw one copy of a mesh
+	void Draw(int meshID) const;
+	// draw the passed in range of instances of a mesh
+	void DrawInstanced(int meshID, int firstInstance, int instanceCount) const;
+	// fill the indirect command drawing a range of instances
+	bool MakeDrawCommand(int meshID, int firstInstance, int instanceCount, DRAW_ELEMENTS_COMMAND& command) const;
+
+	GLuint GetInstanceBuffer() const { return m_instanceBuffer; }
+	int GetMeshCount() const { return (int)m_meshes.size(); }
+	bool IsLoaded(int meshID) const { return (meshID >= 0) && (meshID < (int)m_meshes.size()) && (m_meshes[meshID].indexCount > 0); }
+	const MESH_DATA& GetMeshData(int meshID) const { return m_meshData[meshID]; }
+	const AABB& GetLocalBounds(int meshID) const { return m_localBounds[meshID]; }
+	// what an instance of the mesh needs to unpack its vertices
+	const MESH_DEQUANTIZATION& GetDequantization(int meshID) const { return m_dequantizations[meshID]; }
+	// bounds of the packed vertices, before the dequantization
+	const AABB& GetPackedBounds(int meshID) const { return m_packedBounds[meshID]; }
+	const MESH_LIBRARY_STATS& GetStats() const { return m_stats; }
+	int GetTriangleCount(int meshID) const { return (int)m_meshes[meshID].indexCount / 3; }
+
+	// levels of detail of a mesh, level 0 is the mesh itself
+	int GetLodCount(int meshID) const;
+	int GetLodMesh(int meshID, int level) const;
+	// fraction of the viewport height below which the level
+	// after the passed in one is drawn
+	float GetLodScreenSize(int meshID, int level) const;
+
+private:
+	// where a mesh lives in the shared buffers, and the room
+	// it has there for a mesh reusing its ID
+	struct MESH_RANGE
+	{
+		GLuint firstIndex;
+		GLsizei indexCount;
+		GLint baseVertex;
+		size_t vertexCapacity;
+		size_t indexCapacity;
+	};
+
+	std::vector<MESH_RANGE> m_meshes;
+	std::vector<MESH_DATA> m_meshData;
+	std::vector<AABB> m_localBounds;
+	std::vector<MESH_DEQUANTIZATION> m_dequantizations;
+	std::vector<AABB> m_packedBounds;
+	MESH_LIBRARY_STATS m_stats;
+
+	// the next coarser level of every mesh, or -1, and the
+	// screen size it takes over at
+	std::vector<int> m_nextLods;
+	std::vector<float> m_nextLodScreenSizes;
+	// released meshes whose IDs and ranges can be reused
+	std::vector<int> m_releasedMeshes;
+	int m_cylinderSlices;
+
+	GLuint m_vertexArray;
+	GLuint m_vertexBuffer;
+	GLuint m_indexBuffer;
+	// vertices and indices the buffers can hold and hold now
+	size_t m_vertexCapacity;
+	size_t m_indexCapacity;
+	size_t m_vertexCount;
+	size_t m_indexCount;
+	GLuint m_instanceBuffer;
+
+	void Reserve(size_t vertexCount, size_t indexCount);
+	void GrowBuffer(GLuint& buffer, size_t usedSize, size_t newSize);
+	// pack an optimized mesh into the range of a mesh ID
+	void WriteMesh(int meshID, const MESH_DATA& mesh);
+};
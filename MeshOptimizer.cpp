@@ -0,0 +1,370 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.cpp
+// ============
+// reorder mesh triangles and vertices for the GPU and pack the vertices
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshOptimizer.h"
+
+#include <cmath>
+#include <cstdint>
+
+// declaration of local helpers
+namespace
+{
+	// weights of the vertex score, from Tom Forsyth's "Linear-Speed
+	// Vertex Cache Optimisation"
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	// marks a vertex that no triangle has used yet
+	const GLuint UNUSED_VERTEX = 0xFFFFFFFF;
+
+	// how much drawing a triangle that uses a vertex is worth,
+	// vertices near the front of the cache and vertices with few
+	// triangles left score highest, -1 when no triangle is left
+	float VertexScore(int cachePosition, int activeTriangles)
+	{
+		if (activeTriangles == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// the last triangle's vertices get a fixed score so
+				// the next triangle does not simply reuse its edge
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				float scale = 1.0f / (float)(VERTEX_CACHE_SIZE - 3);
+				score = powf(1.0f - (float)(cachePosition - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+		score += VALENCE_BOOST_SCALE * powf((float)activeTriangles, -VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	int16_t PackSnorm16(float value)
+	{
+		value = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+		return (int16_t)floorf(value * 32767.0f + 0.5f);
+	}
+
+	int8_t PackSnorm8(float value)
+	{
+		value = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+		return (int8_t)floorf(value * 127.0f + 0.5f);
+	}
+
+	uint16_t PackUnorm16(float value)
+	{
+		value = (value < 0.0f) ? 0.0f : ((value > 1.0f) ? 1.0f : value);
+		return (uint16_t)floorf(value * 65535.0f + 0.5f);
+	}
+
+	// map a unit vector onto the octahedron and unfold it into
+	// the [-1, 1] square, the vertex shader reverses this
+	glm::vec2 EncodeOctahedral(glm::vec3 normal)
+	{
+		normal = normal / (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z));
+		glm::vec2 encoded(normal.x, normal.y);
+		if (normal.z < 0.0f)
+		{
+			encoded.x = (1.0f - fabsf(normal.y)) * ((normal.x >= 0.0f) ? 1.0f : -1.0f);
+			encoded.y = (1.0f - fabsf(normal.x)) * ((normal.y >= 0.0f) ? 1.0f : -1.0f);
+		}
+		return encoded;
+	}
+}
+
+/***********************************************************
+ *  OptimizeVertexCache()
+ *
+ *  This method is used for reordering the triangles of a mesh
+ *  with Forsyth's greedy algorithm.  Every step draws the
+ *  triangle with the highest score among those using a cached
+ *  vertex, then moves its vertices to the front of a simulated
+ *  LRU cache and rescores the triangles around the cache.
+ ***********************************************************/
+void OptimizeVertexCache(MESH_DATA& mesh)
+{
+	const size_t triangleCount = mesh.indices.size() / 3;
+	const size_t vertexCount = mesh.vertices.size();
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// the triangles using each vertex, the first active count
+	// entries of a vertex's range are the triangles not yet drawn
+	std::vector<int> activeTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		activeTriangles[mesh.indices[i]]++;
+	}
+	std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		firstTriangle[v + 1] = firstTriangle[v] + activeTriangles[v];
+	}
+	std::vector<int> vertexTriangles(firstTriangle[vertexCount]);
+	std::vector<size_t> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		vertexTriangles[fill[mesh.indices[i]]++] = (int)(i / 3);
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = VertexScore(-1, activeTriangles[v]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScores[t] = vertexScores[mesh.indices[t * 3]] +
+			vertexScores[mesh.indices[t * 3 + 1]] +
+			vertexScores[mesh.indices[t * 3 + 2]];
+	}
+
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<GLuint> newIndices;
+	newIndices.reserve(triangleCount * 3);
+	std::vector<GLuint> cache;
+	std::vector<GLuint> newCache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	newCache.reserve(VERTEX_CACHE_SIZE + 3);
+	int bestTriangle = 0;
+	size_t nextUnemitted = 0;
+
+	for (size_t step = 0; step < triangleCount; step++)
+	{
+		// nothing in the cache has a triangle left, carry on with
+		// the first triangle not yet drawn
+		if (bestTriangle < 0)
+		{
+			while (emitted[nextUnemitted])
+			{
+				nextUnemitted++;
+			}
+			bestTriangle = (int)nextUnemitted;
+		}
+
+		const GLuint* corners = &mesh.indices[bestTriangle * 3];
+		emitted[bestTriangle] = 1;
+		for (int c = 0; c < 3; c++)
+		{
+			const GLuint v = corners[c];
+			newIndices.push_back(v);
+
+			// move the triangle past the active range of the vertex
+			if (activeTriangles[v] == 0)
+			{
+				continue;
+			}
+			activeTriangles[v]--;
+			const size_t begin = firstTriangle[v];
+			const size_t last = begin + activeTriangles[v];
+			for (size_t k = begin; k <= last; k++)
+			{
+				if (vertexTriangles[k] == bestTriangle)
+				{
+					vertexTriangles[k] = vertexTriangles[last];
+					vertexTriangles[last] = bestTriangle;
+					break;
+				}
+			}
+		}
+
+		// the triangle's vertices go to the front of the cache
+		newCache.clear();
+		for (int c = 0; c < 3; c++)
+		{
+			if ((c == 0) || ((corners[c] != corners[0]) && ((c == 1) || (corners[c] != corners[1]))))
+			{
+				newCache.push_back(corners[c]);
+			}
+		}
+		for (size_t i = 0; i < cache.size(); i++)
+		{
+			if ((cache[i] != corners[0]) && (cache[i] != corners[1]) && (cache[i] != corners[2]))
+			{
+				newCache.push_back(cache[i]);
+			}
+		}
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			const GLuint v = newCache[i];
+			cachePositions[v] = (i < (size_t)VERTEX_CACHE_SIZE) ? (int)i : -1;
+			vertexScores[v] = VertexScore(cachePositions[v], activeTriangles[v]);
+		}
+
+		// rescore the triangles around the cache, including the
+		// vertices that just fell out of it, and pick the best
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			const GLuint v = newCache[i];
+			for (size_t k = firstTriangle[v]; k < firstTriangle[v] + activeTriangles[v]; k++)
+			{
+				const int t = vertexTriangles[k];
+				triangleScores[t] = vertexScores[mesh.indices[t * 3]] +
+					vertexScores[mesh.indices[t * 3 + 1]] +
+					vertexScores[mesh.indices[t * 3 + 2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (newCache.size() > (size_t)VERTEX_CACHE_SIZE)
+		{
+			newCache.resize(VERTEX_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+	}
+
+	mesh.indices.swap(newIndices);
+}
+
+/***********************************************************
+ *  OptimizeVertexFetch()
+ *
+ *  This method is used for renumbering the vertices of a mesh
+ *  in the order its triangles first use them.
+ ***********************************************************/
+void OptimizeVertexFetch(MESH_DATA& mesh)
+{
+	std::vector<GLuint> remap(mesh.vertices.size(), UNUSED_VERTEX);
+	std::vector<MESH_VERTEX> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+	{
+		GLuint& index = mesh.indices[i];
+		if (remap[index] == UNUSED_VERTEX)
+		{
+			remap[index] = (GLuint)vertices.size();
+			vertices.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	mesh.vertices.swap(vertices);
+}
+
+/***********************************************************
+ *  CountVertexCacheMisses()
+ *
+ *  This method is used for counting the vertices a FIFO
+ *  post-transform cache would miss while drawing the passed
+ *  in indices, the number of vertex shader runs.
+ ***********************************************************/
+size_t CountVertexCacheMisses(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize)
+{
+	// the miss count when each vertex last entered the cache,
+	// 0 for a vertex never loaded
+	std::vector<size_t> loadedAt(vertexCount, 0);
+	size_t misses = 0;
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		size_t& loaded = loadedAt[indices[i]];
+		if ((loaded == 0) || (misses - loaded >= (size_t)cacheSize))
+		{
+			misses++;
+			loaded = misses;
+		}
+	}
+	return misses;
+}
+
+/***********************************************************
+ *  QuantizeMesh()
+ *
+ *  This method is used for packing the vertices of a mesh.
+ *  Positions are stored as snorm16 inside the cube around the
+ *  mesh bounds, so the dequantization matrix is a uniform
+ *  scale and a translation and leaves the normals alone.
+ *  Normals are octahedral snorm8 pairs and texture
+ *  coordinates are unorm16 across the mesh's range, which
+ *  starts at the whole unit at or below the smallest one.
+ *  That start is the UV offset, added back before the UV
+ *  scale of the object since the scale can make it fall
+ *  between two texture repeats.
+ ***********************************************************/
+void QuantizeMesh(
+	const MESH_DATA& mesh,
+	std::vector<PACKED_VERTEX>& packedVertices,
+	MESH_DEQUANTIZATION& dequantization)
+{
+	packedVertices.resize(mesh.vertices.size());
+	dequantization.position = glm::mat4(1.0f);
+	dequantization.uvScale = glm::vec2(1.0f);
+	dequantization.uvOffset = glm::vec2(0.0f);
+	if (mesh.vertices.empty())
+	{
+		return;
+	}
+
+	glm::vec3 positionMin = mesh.vertices[0].position;
+	glm::vec3 positionMax = mesh.vertices[0].position;
+	glm::vec2 uvMin = mesh.vertices[0].textureCoordinate;
+	glm::vec2 uvMax = mesh.vertices[0].textureCoordinate;
+	for (size_t i = 1; i < mesh.vertices.size(); i++)
+	{
+		const MESH_VERTEX& vertex = mesh.vertices[i];
+		positionMin = glm::min(positionMin, vertex.position);
+		positionMax = glm::max(positionMax, vertex.position);
+		uvMin.x = (vertex.textureCoordinate.x < uvMin.x) ? vertex.textureCoordinate.x : uvMin.x;
+		uvMin.y = (vertex.textureCoordinate.y < uvMin.y) ? vertex.textureCoordinate.y : uvMin.y;
+		uvMax.x = (vertex.textureCoordinate.x > uvMax.x) ? vertex.textureCoordinate.x : uvMax.x;
+		uvMax.y = (vertex.textureCoordinate.y > uvMax.y) ? vertex.textureCoordinate.y : uvMax.y;
+	}
+
+	const glm::vec3 center = (positionMin + positionMax) * 0.5f;
+	const glm::vec3 extent = (positionMax - positionMin) * 0.5f;
+	float halfSize = (extent.x > extent.y) ? extent.x : extent.y;
+	halfSize = (extent.z > halfSize) ? extent.z : halfSize;
+	halfSize = (halfSize > 0.0f) ? halfSize : 1.0f;
+
+	const glm::vec2 uvOrigin(floorf(uvMin.x), floorf(uvMin.y));
+	glm::vec2 uvRange = uvMax - uvOrigin;
+	uvRange.x = (uvRange.x > 0.0f) ? uvRange.x : 1.0f;
+	uvRange.y = (uvRange.y > 0.0f) ? uvRange.y : 1.0f;
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const MESH_VERTEX& vertex = mesh.vertices[i];
+		PACKED_VERTEX& packed = packedVertices[i];
+
+		glm::vec3 position = (vertex.position - center) / halfSize;
+		packed.position[0] = PackSnorm16(position.x);
+		packed.position[1] = PackSnorm16(position.y);
+		packed.position[2] = PackSnorm16(position.z);
+
+		glm::vec2 normal = EncodeOctahedral(vertex.normal);
+		packed.normal[0] = PackSnorm8(normal.x);
+		packed.normal[1] = PackSnorm8(normal.y);
+
+		glm::vec2 textureCoordinate = (vertex.textureCoordinate - uvOrigin) / uvRange;
+		packed.textureCoordinate[0] = PackUnorm16(textureCoordinate.x);
+		packed.textureCoordinate[1] = PackUnorm16(textureCoordinate.y);
+	}
+
+	dequantization.position = glm::mat4(halfSize);
+	dequantization.position[3] = glm::vec4(center, 1.0f);
+	dequantization.uvScale = uvRange;
+	dequantization.uvOffset = uvOrigin;
+}
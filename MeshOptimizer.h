@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshoptimizer.h
+// ============
+// reorder mesh triangles and vertices for the GPU and pack the vertices
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MeshLibrary.h"
+
+#include <cstddef>
+#include <vector>
+
+// entries of the post-transform vertex cache the triangle order
+// is optimized for
+const int VERTEX_CACHE_SIZE = 32;
+// entries of the FIFO cache used to measure an order, smaller
+// than the optimized size so the result holds on older GPUs
+const int VERTEX_CACHE_SIMULATED_SIZE = 16;
+
+// reorder the triangles so vertices shared by neighbouring
+// triangles are still in the post-transform cache
+void OptimizeVertexCache(MESH_DATA& mesh);
+// renumber the vertices in the order the triangles first use
+// them, so vertex fetches walk the buffer front to back, and
+// drop vertices no triangle uses
+void OptimizeVertexFetch(MESH_DATA& mesh);
+// count the vertices a FIFO cache of the passed in size would
+// have to transform to draw the triangles
+size_t CountVertexCacheMisses(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize);
+
+// pack the vertices of a mesh and get the values that unpack them
+void QuantizeMesh(
+	const MESH_DATA& mesh,
+	std::vector<PACKED_VERTEX>& packedVertices,
+	MESH_DEQUANTIZATION& dequantization);
@@ -0,0 +1,457 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.cpp
+// ============
+// CPU scope timers, GPU timer queries and frame time statistics
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// the profiler shared by every module
+Profiler g_Profiler;
+
+// declaration of local helpers
+namespace
+{
+	// events kept by one capture, about a minute of a busy frame
+	const size_t MAX_CAPTURE_EVENTS = 2000000;
+	// trace thread of the GPU scopes
+	const int GPU_TRACE_THREAD = 1000;
+	// microseconds between two summaries
+	const int64_t SUMMARY_INTERVAL = 1000000;
+
+	std::thread::id g_MainThread = std::this_thread::get_id();
+	std::atomic<int> g_NextThread(1);
+
+	// small number for the calling thread, 0 is the main thread
+	int ThreadIndex()
+	{
+		static thread_local int threadIndex = -1;
+		if (threadIndex < 0)
+		{
+			threadIndex = (std::this_thread::get_id() == g_MainThread) ? 0 : g_NextThread++;
+		}
+		return(threadIndex);
+	}
+}
+
+/***********************************************************
+ *  Profiler()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+Profiler::Profiler()
+{
+	m_startTime = 0;
+	m_startTime = Now();
+
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+	{
+		m_frameTimes[i] = 0.0f;
+	}
+	m_frameTimeCount = 0;
+	m_frameTimeNext = 0;
+	m_frameStart = 0;
+	m_lastSummary = 0;
+	m_frame = 0;
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		memset(&m_querySets[i], 0, sizeof(GPU_QUERY_SET));
+	}
+	m_gpuScopeDepth = 0;
+	m_openQuery = -1;
+	m_bGpuTimers = false;
+	m_droppedGpuResults = 0;
+
+	m_bRecordFrames = false;
+	m_firstRecordedFrame = 0;
+
+	m_bCapturing = false;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for creating the timer queries of
+ *  every frame in flight.
+ ***********************************************************/
+void Profiler::Initialize()
+{
+	if (m_bGpuTimers || !GLEW_VERSION_3_3)
+	{
+		return;
+	}
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		glGenQueries(MAX_GPU_SCOPES, m_querySets[i].queries);
+		m_querySets[i].count = 0;
+	}
+	m_bGpuTimers = true;
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void Profiler::Destroy()
+{
+	if (!m_bGpuTimers)
+	{
+		return;
+	}
+
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		glDeleteQueries(MAX_GPU_SCOPES, m_querySets[i].queries);
+		memset(&m_querySets[i], 0, sizeof(GPU_QUERY_SET));
+	}
+	m_bGpuTimers = false;
+}
+
+/***********************************************************
+ *  Now()
+ ***********************************************************/
+int64_t Profiler::Now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() - m_startTime;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting the frame timer and
+ *  reading back the GPU queries this frame is about to
+ *  reuse, which were issued GPU_QUERY_FRAMES frames ago.
+ ***********************************************************/
+void Profiler::BeginFrame()
+{
+	m_frameStart = Now();
+
+	if (m_bGpuTimers)
+	{
+		GPU_QUERY_SET& querySet = m_querySets[m_frame % GPU_QUERY_FRAMES];
+		ReadGpuQueries(querySet);
+		querySet.count = 0;
+		querySet.frame = m_frame;
+	}
+}
+
+/***********************************************************
+ *  EndFrame()
+ ***********************************************************/
+void Profiler::EndFrame()
+{
+	int64_t frameEnd = Now();
+	RecordEvent("Frame", m_frameStart, frameEnd);
+
+	m_frameTimes[m_frameTimeNext] = (float)(frameEnd - m_frameStart) / 1000.0f;
+	if (m_bRecordFrames)
+	{
+		FRAME_TIMING timing;
+		timing.cpuMilliseconds = m_frameTimes[m_frameTimeNext];
+		timing.gpuMilliseconds = -1.0f;
+		m_recordedFrames.push_back(timing);
+	}
+	m_frameTimeNext = (m_frameTimeNext + 1) % PROFILER_HISTORY;
+	m_frameTimeCount = std::min(m_frameTimeCount + 1, PROFILER_HISTORY);
+	m_frame++;
+}
+
+/***********************************************************
+ *  RecordEvent()
+ *
+ *  This method is used for keeping a finished CPU scope in
+ *  the running capture.  Outside a capture it does nothing.
+ ***********************************************************/
+void Profiler::RecordEvent(const char* name, int64_t start, int64_t end)
+{
+	if (!m_bCapturing)
+	{
+		return;
+	}
+
+	PROFILE_EVENT profileEvent;
+	profileEvent.name = name;
+	profileEvent.start = start;
+	profileEvent.duration = end - start;
+	profileEvent.thread = ThreadIndex();
+
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+	if (m_events.size() < MAX_CAPTURE_EVENTS)
+	{
+		m_events.push_back(profileEvent);
+	}
+}
+
+/***********************************************************
+ *  BeginGpuScope()
+ *
+ *  This method is used for starting a GPU timer.  A scope
+ *  opened inside another one is not timed on its own, its
+ *  time is part of the outer scope.
+ ***********************************************************/
+void Profiler::BeginGpuScope(const char* name)
+{
+	m_gpuScopeDepth++;
+	if (!m_bGpuTimers || (m_gpuScopeDepth > 1))
+	{
+		return;
+	}
+
+	GPU_QUERY_SET& querySet = m_querySets[m_frame % GPU_QUERY_FRAMES];
+	if (querySet.count >= MAX_GPU_SCOPES)
+	{
+		return;
+	}
+
+	m_openQuery = querySet.count++;
+	querySet.names[m_openQuery] = name;
+	querySet.starts[m_openQuery] = Now();
+	glBeginQuery(GL_TIME_ELAPSED, querySet.queries[m_openQuery]);
+}
+
+/***********************************************************
+ *  EndGpuScope()
+ ***********************************************************/
+void Profiler::EndGpuScope()
+{
+	m_gpuScopeDepth--;
+	if ((m_gpuScopeDepth == 0) && (m_openQuery >= 0))
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		m_openQuery = -1;
+	}
+}
+
+/***********************************************************
+ *  ReadGpuQueries()
+ *
+ *  This method is used for collecting the results of a set
+ *  of GPU queries.  A query that is still not finished is
+ *  dropped rather than waited for.  In a capture the GPU
+ *  time is placed at the CPU time the scope was issued.
+ ***********************************************************/
+void Profiler::ReadGpuQueries(GPU_QUERY_SET& querySet)
+{
+	bool bComplete = true;
+	double frameMilliseconds = 0.0;
+
+	for (int i = 0; i < querySet.count; i++)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(querySet.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			m_droppedGpuResults++;
+			bComplete = false;
+			continue;
+		}
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(querySet.queries[i], GL_QUERY_RESULT, &nanoseconds);
+		frameMilliseconds += (double)nanoseconds / 1000000.0;
+
+		size_t total = 0;
+		while ((total < m_gpuTotals.size()) && (strcmp(m_gpuTotals[total].name, querySet.names[i]) != 0))
+		{
+			total++;
+		}
+		if (total == m_gpuTotals.size())
+		{
+			GPU_SCOPE_TOTAL scopeTotal;
+			scopeTotal.name = querySet.names[i];
+			scopeTotal.milliseconds = 0.0;
+			scopeTotal.samples = 0;
+			m_gpuTotals.push_back(scopeTotal);
+		}
+		m_gpuTotals[total].milliseconds += (double)nanoseconds / 1000000.0;
+		m_gpuTotals[total].samples++;
+
+		if (m_bCapturing)
+		{
+			PROFILE_EVENT profileEvent;
+			profileEvent.name = querySet.names[i];
+			profileEvent.start = querySet.starts[i];
+			profileEvent.duration = (int64_t)(nanoseconds / 1000);
+			profileEvent.thread = GPU_TRACE_THREAD;
+
+			std::lock_guard<std::mutex> lock(m_eventMutex);
+			if (m_events.size() < MAX_CAPTURE_EVENTS)
+			{
+				m_events.push_back(profileEvent);
+			}
+		}
+	}
+
+	// the frame was recorded once EndFrame() ran for it
+	if (m_bRecordFrames && bComplete && (querySet.count > 0) && (querySet.frame >= m_firstRecordedFrame))
+	{
+		size_t recorded = (size_t)(querySet.frame - m_firstRecordedFrame);
+		if (recorded < m_recordedFrames.size())
+		{
+			m_recordedFrames[recorded].gpuMilliseconds = (float)frameMilliseconds;
+		}
+	}
+}
+
+/***********************************************************
+ *  StartFrameRecording()
+ ***********************************************************/
+void Profiler::StartFrameRecording()
+{
+	m_recordedFrames.clear();
+	m_firstRecordedFrame = m_frame;
+	m_bRecordFrames = true;
+}
+
+/***********************************************************
+ *  FinishFrames()
+ *
+ *  This method is used for collecting the GPU queries of the
+ *  last frames, which are otherwise only read when their set
+ *  is reused.  It waits for the GPU, so it is only meant for
+ *  the end of a run.
+ ***********************************************************/
+void Profiler::FinishFrames()
+{
+	if (!m_bGpuTimers)
+	{
+		return;
+	}
+
+	glFinish();
+	for (int i = 0; i < GPU_QUERY_FRAMES; i++)
+	{
+		ReadGpuQueries(m_querySets[i]);
+		m_querySets[i].count = 0;
+	}
+}
+
+/***********************************************************
+ *  StartCapture()
+ ***********************************************************/
+void Profiler::StartCapture()
+{
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+	m_events.clear();
+	m_bCapturing = true;
+
+	std::cout << "Profiler capture started" << std::endl;
+}
+
+/***********************************************************
+ *  StopCapture()
+ *
+ *  This method is used for ending the capture and writing
+ *  its events as a chrome://tracing JSON file, one complete
+ *  event per scope with a named track per thread and one for
+ *  the GPU.
+ ***********************************************************/
+bool Profiler::StopCapture(const char* filename)
+{
+	m_bCapturing = false;
+
+	std::lock_guard<std::mutex> lock(m_eventMutex);
+
+	FILE* file = fopen(filename, "w");
+	if (NULL == file)
+	{
+		std::cout << "Could not write profiler trace:" << filename << std::endl;
+		return(false);
+	}
+
+	// name the tracks of every thread that recorded events
+	std::vector<int> threads;
+	for (size_t i = 0; i < m_events.size(); i++)
+	{
+		if (std::find(threads.begin(), threads.end(), m_events[i].thread) == threads.end())
+		{
+			threads.push_back(m_events[i].thread);
+		}
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		std::string threadName = (threads[i] == 0) ? "Main" :
+			((threads[i] == GPU_TRACE_THREAD) ? "GPU" : "Worker " + std::to_string(threads[i]));
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+			threads[i], threadName.c_str());
+	}
+	for (size_t i = 0; i < m_events.size(); i++)
+	{
+		const PROFILE_EVENT& profileEvent = m_events[i];
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d}%s\n",
+			profileEvent.name,
+			(long long)profileEvent.start,
+			(long long)profileEvent.duration,
+			profileEvent.thread,
+			(i + 1 < m_events.size()) ? "," : "");
+	}
+	fprintf(file, "]}\n");
+	fclose(file);
+
+	std::cout << "Saved profiler trace:" << filename << ", events:" << m_events.size() << std::endl;
+
+	m_events.clear();
+	m_events.shrink_to_fit();
+	return(true);
+}
+
+/***********************************************************
+ *  GetSummary()
+ *
+ *  This method is used for formatting the 50th, 95th and
+ *  99th percentile and the worst of the recent frame times,
+ *  followed by the average time of every GPU scope since the
+ *  last summary.
+ ***********************************************************/
+bool Profiler::GetSummary(std::string& summary)
+{
+	int64_t now = Now();
+	if ((m_frameTimeCount == 0) || (now - m_lastSummary < SUMMARY_INTERVAL))
+	{
+		return(false);
+	}
+	m_lastSummary = now;
+
+	std::vector<float> frameTimes(m_frameTimes, m_frameTimes + m_frameTimeCount);
+	std::sort(frameTimes.begin(), frameTimes.end());
+	const int last = m_frameTimeCount - 1;
+
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(1)
+		<< "frame ms p50 " << frameTimes[last * 50 / 100]
+		<< " p95 " << frameTimes[last * 95 / 100]
+		<< " p99 " << frameTimes[last * 99 / 100]
+		<< " max " << frameTimes[last];
+
+	text << std::setprecision(2);
+	for (size_t i = 0; i < m_gpuTotals.size(); i++)
+	{
+		if (m_gpuTotals[i].samples > 0)
+		{
+			text << " | gpu " << m_gpuTotals[i].name << " " << (m_gpuTotals[i].milliseconds / m_gpuTotals[i].samples);
+		}
+		m_gpuTotals[i].milliseconds = 0.0;
+		m_gpuTotals[i].samples = 0;
+	}
+	if (m_droppedGpuResults > 0)
+	{
+		text << " | " << m_droppedGpuResults << " late gpu results";
+		m_droppedGpuResults = 0;
+	}
+
+	summary = text.str();
+	return(true);
+}
@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.h
+// ============
+// CPU scope timers, GPU timer queries and frame time statistics
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// frames kept for the rolling frame time percentiles
+const int PROFILER_HISTORY = 240;
+// GPU scopes that can be timed in one frame
+const int MAX_GPU_SCOPES = 16;
+// frames of GPU queries in flight, a query is read back this
+// many frames after it was issued
+const int GPU_QUERY_FRAMES = 2;
+
+// one timed scope, times are in microseconds since the
+// profiler was created
+struct PROFILE_EVENT
+{
+	const char* name;
+	int64_t start;
+	int64_t duration;
+	int thread;
+};
+
+// CPU and GPU time of one recorded frame, the GPU time is the
+// sum of the frame's GPU scopes, or -1 when a result was late
+struct FRAME_TIMING
+{
+	float cpuMilliseconds;
+	float gpuMilliseconds;
+};
+
+/***********************************************************
+ *  Profiler
+ *
+ *  This class collects the timing of the frame.  CPU scopes
+ *  record their start and duration through ProfileScope.  GPU
+ *  scopes wrap a GL_TIME_ELAPSED query, and every frame uses
+ *  its own set of queries that is only read back when it is
+ *  reused GPU_QUERY_FRAMES frames later, so reading results
+ *  never waits on the GPU; results still not available then
+ *  are dropped.  GPU scopes must not nest.
+ *
+ *  Frame times are kept for rolling percentiles, and while a
+ *  capture is running every event is kept so it can be saved
+ *  as a chrome://tracing JSON file.
+ ***********************************************************/
+class Profiler
+{
+public:
+	// constructor
+	Profiler();
+
+	// create the GPU queries, needs the OpenGL context
+	void Initialize();
+	// free the GPU queries
+	void Destroy();
+
+	// mark the start and end of a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// microseconds since the profiler was created
+	int64_t Now() const;
+	// add a finished CPU scope, may be called from any thread
+	void RecordEvent(const char* name, int64_t start, int64_t end);
+
+	// time the GPU work issued between these calls
+	void BeginGpuScope(const char* name);
+	void EndGpuScope();
+
+	// keep every event until the capture is stopped and saved
+	void StartCapture();
+	bool StopCapture(const char* filename);
+	bool IsCapturing() const { return m_bCapturing; }
+
+	// get the frame time percentiles and GPU scope averages,
+	// true about once a second when new text is ready
+	bool GetSummary(std::string& summary);
+
+	// keep the timing of every frame from now on
+	void StartFrameRecording();
+	// wait for the GPU and read back every outstanding query,
+	// so the recorded frames are complete
+	void FinishFrames();
+	const std::vector<FRAME_TIMING>& GetRecordedFrames() const { return m_recordedFrames; }
+
+private:
+	// the GPU queries issued in one frame
+	struct GPU_QUERY_SET
+	{
+		GLuint queries[MAX_GPU_SCOPES];
+		const char* names[MAX_GPU_SCOPES];
+		int64_t starts[MAX_GPU_SCOPES];
+		int count;
+		// the frame the queries were issued in
+		uint64_t frame;
+	};
+
+	// GPU time of one scope name since the last summary
+	struct GPU_SCOPE_TOTAL
+	{
+		const char* name;
+		double milliseconds;
+		int samples;
+	};
+
+	int64_t m_startTime;
+
+	// rolling frame times in milliseconds
+	float m_frameTimes[PROFILER_HISTORY];
+	int m_frameTimeCount;
+	int m_frameTimeNext;
+	int64_t m_frameStart;
+	int64_t m_lastSummary;
+	uint64_t m_frame;
+
+	GPU_QUERY_SET m_querySets[GPU_QUERY_FRAMES];
+	// nesting depth of the GPU scopes and the query timing the
+	// outermost one, or -1
+	int m_gpuScopeDepth;
+	int m_openQuery;
+	bool m_bGpuTimers;
+	std::vector<GPU_SCOPE_TOTAL> m_gpuTotals;
+	int m_droppedGpuResults;
+
+	// timing of every frame since StartFrameRecording()
+	bool m_bRecordFrames;
+	uint64_t m_firstRecordedFrame;
+	std::vector<FRAME_TIMING> m_recordedFrames;
+
+	// events of the running capture
+	std::atomic<bool> m_bCapturing;
+	std::mutex m_eventMutex;
+	std::vector<PROFILE_EVENT> m_events;
+
+	void ReadGpuQueries(GPU_QUERY_SET& querySet);
+};
+
+// the profiler shared by every module
+extern Profiler g_Profiler;
+
+/***********************************************************
+ *  ProfileScope
+ *
+ *  Times the CPU work from its construction to the end of
+ *  the enclosing block.  The name must be a string literal.
+ ***********************************************************/
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name)
+	{
+		m_name = name;
+		m_start = g_Profiler.Now();
+	}
+	~ProfileScope()
+	{
+		g_Profiler.RecordEvent(m_name, m_start, g_Profiler.Now());
+	}
+
+private:
+	const char* m_name;
+	int64_t m_start;
+};
+
+/***********************************************************
+ *  GpuProfileScope
+ *
+ *  Times the GPU work issued from its construction to the
+ *  end of the enclosing block.
+ ***********************************************************/
+class GpuProfileScope
+{
+public:
+	explicit GpuProfileScope(const char* name) { g_Profiler.BeginGpuScope(name); }
+	~GpuProfileScope() { g_Profiler.EndGpuScope(); }
+};
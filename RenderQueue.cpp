@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.cpp
+// ============
+// collect draw packets and sort them by render state
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+
+/***********************************************************
+ *  RenderQueue()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+RenderQueue::RenderQueue()
+{
+	m_stats.packets = 0;
+	m_stats.unsortedStateChanges = 0;
+	m_stats.sortedStateChanges = 0;
+}
+
+/***********************************************************
+ *  MakeKey()
+ *
+ *  This method is used for packing the state of a draw into
+ *  a sort key.  Field values that do not fit are clamped to
+ *  the largest value of their field.  Transparent packets
+ *  have their depth inverted and placed right under the
+ *  pipeline, so every transparent packet sorts back to
+ *  front before its texture, mesh or material is looked at.
+ ***********************************************************/
+uint64_t RenderQueue::MakeKey(
+	int pipeline,
+	int texture,
+	int mesh,
+	int material,
+	float depth)
+{
+	if (depth < 0.0f)
+		depth = 0.0f;
+	if (depth > 1.0f)
+		depth = 1.0f;
+	uint64_t depthBits = (uint64_t)(depth * (float)DEPTH_MASK);
+
+	uint64_t pipelineBits = (pipeline < 0) ? 0 : ((uint64_t)pipeline > PIPELINE_MASK ? PIPELINE_MASK : (uint64_t)pipeline);
+	uint64_t textureBits = (texture < 0) ? 0 : ((uint64_t)texture > TEXTURE_MASK ? TEXTURE_MASK : (uint64_t)texture);
+	uint64_t meshBits = (mesh < 0) ? 0 : ((uint64_t)mesh > MESH_MASK ? MESH_MASK : (uint64_t)mesh);
+	uint64_t materialBits = (material < 0) ? 0 : ((uint64_t)material > MATERIAL_MASK ? MATERIAL_MASK : (uint64_t)material);
+
+	if (pipelineBits == PIPELINE_TRANSPARENT)
+	{
+		return (pipelineBits << PIPELINE_SHIFT) |
+			((DEPTH_MASK - depthBits) << TRANSPARENT_DEPTH_SHIFT) |
+			(textureBits << TRANSPARENT_TEXTURE_SHIFT) |
+			(meshBits << TRANSPARENT_MESH_SHIFT) |
+			(materialBits << TRANSPARENT_MATERIAL_SHIFT);
+	}
+	return (pipelineBits << PIPELINE_SHIFT) |
+		(textureBits << TEXTURE_SHIFT) |
+		(meshBits << MESH_SHIFT) |
+		(materialBits << MATERIAL_SHIFT) |
+		depthBits;
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void RenderQueue::Clear()
+{
+	m_packets.clear();
+}
+
+/***********************************************************
+ *  Reserve()
+ ***********************************************************/
+void RenderQueue::Reserve(size_t count)
+{
+	m_packets.reserve(count);
+	m_sortBuffer.reserve(count);
+}
+
+/***********************************************************
+ *  Submit()
+ ***********************************************************/
+void RenderQueue::Submit(uint64_t key, uint32_t command)
+{
+	DRAW_PACKET packet;
+	packet.key = key;
+	packet.command = command;
+	m_packets.push_back(packet);
+}
+
+/***********************************************************
+ *  Resize()
+ ***********************************************************/
+void RenderQueue::Resize(size_t count)
+{
+	m_packets.resize(count);
+}
+
+/***********************************************************
+ *  Set()
+ ***********************************************************/
+void RenderQueue::Set(size_t index, uint64_t key, uint32_t command)
+{
+	m_packets[index].key = key;
+	m_packets[index].command = command;
+}
+
+/***********************************************************
+ *  Sort()
+ *
+ *  This method is used for sorting the packets by key with a
+ *  least significant digit radix sort, one byte per pass.
+ *  Passes where every key has the same byte are skipped, so
+ *  unused key fields cost nothing.  The sort is stable, so
+ *  packets with equal keys keep their submit order.
+ ***********************************************************/
+void RenderQueue::Sort()
+{
+	const size_t count = m_packets.size();
+
+	m_stats.packets = (int)count;
+	m_stats.unsortedStateChanges = CountStateChanges();
+
+	m_sortBuffer.resize(count);
+	for (int pass = 0; pass < 8; pass++)
+	{
+		const int shift = pass * 8;
+
+		size_t offsets[256] = { 0 };
+		for (size_t i = 0; i < count; i++)
+		{
+			offsets[(m_packets[i].key >> shift) & 0xFF]++;
+		}
+
+		// every key shares this byte, the pass would not move anything
+		if ((count == 0) || (offsets[(m_packets[0].key >> shift) & 0xFF] == count))
+		{
+			continue;
+		}
+
+		size_t total = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = offsets[digit];
+			offsets[digit] = total;
+			total += digitCount;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const DRAW_PACKET& packet = m_packets[i];
+			m_sortBuffer[offsets[(packet.key >> shift) & 0xFF]++] = packet;
+		}
+		m_packets.swap(m_sortBuffer);
+	}
+
+	m_stats.sortedStateChanges = CountStateChanges();
+}
+
+/***********************************************************
+ *  CountStateChanges()
+ *
+ *  This method is used for counting how many state fields
+ *  change from one packet to the next.  The first packet
+ *  counts as setting every field once.
+ ***********************************************************/
+int RenderQueue::CountStateChanges() const
+{
+	int changes = 0;
+
+	for (size_t i = 0; i < m_packets.size(); i++)
+	{
+		uint64_t key = m_packets[i].key;
+		if (i == 0)
+		{
+			changes += 4;
+			continue;
+		}
+
+		uint64_t previous = m_packets[i - 1].key;
+		changes += (GetPipeline(key) != GetPipeline(previous)) ? 1 : 0;
+		changes += (GetTexture(key) != GetTexture(previous)) ? 1 : 0;
+		changes += (GetMesh(key) != GetMesh(previous)) ? 1 : 0;
+		changes += (GetMaterial(key) != GetMaterial(previous)) ? 1 : 0;
+	}
+
+	return(changes);
+}
@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.h
+// ============
+// collect draw packets and sort them by render state
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the pipeline states a draw packet can request, in draw order
+enum RENDER_PIPELINE
+{
+	PIPELINE_OPAQUE = 0,
+	PIPELINE_TRANSPARENT
+};
+
+// one queued draw, the command is an index the caller resolves
+struct DRAW_PACKET
+{
+	uint64_t key;
+	uint32_t command;
+};
+
+// state change counts of the last sorted frame
+struct RENDER_QUEUE_STATS
+{
+	int packets;
+	// state changes if the packets were drawn in submit order
+	int unsortedStateChanges;
+	// state changes after sorting
+	int sortedStateChanges;
+};
+
+/***********************************************************
+ *  RenderQueue
+ *
+ *  This class collects the draw packets of a frame and sorts
+ *  them with a radix sort on their 64-bit keys.  From the
+ *  most significant bits down a key holds:
+ *
+ *    63..56  pipeline state
+ *    55..44  texture
+ *    43..36  mesh
+ *    35..24  material
+ *    23..0   depth
+ *
+ *  so that packets sharing expensive state end up next to
+ *  each other.  The mesh sits above the material because
+ *  draws of the same mesh and texture are merged into one
+ *  instanced draw, where the material is per-instance data
+ *  and changing it costs nothing.
+ *
+ *  Transparent packets must blend back to front whatever
+ *  their state, so their inverted depth moves up under the
+ *  pipeline:
+ *
+ *    63..56  pipeline state
+ *    55..32  inverted depth
+ *    31..20  texture
+ *    19..12  mesh
+ *    11..0   material
+ ***********************************************************/
+class RenderQueue
+{
+public:
+	// constructor
+	RenderQueue();
+
+	// build a sort key, depth is 0 at the camera and 1 at the
+	// far end of the sorted range
+	static uint64_t MakeKey(
+		int pipeline,
+		int texture,
+		int mesh,
+		int material,
+		float depth);
+
+	// the fields that must match for neighbouring packets to
+	// share an instanced draw, the pipeline, texture and mesh;
+	// a batch of transparent packets keeps their depth order
+	static uint64_t BatchState(uint64_t key)
+	{
+		return ((uint64_t)GetPipeline(key) << PIPELINE_SHIFT) |
+			((uint64_t)GetTexture(key) << TEXTURE_SHIFT) |
+			((uint64_t)GetMesh(key) << MESH_SHIFT);
+	}
+	static int GetPipeline(uint64_t key) { return (int)(key >> PIPELINE_SHIFT); }
+	static int GetTexture(uint64_t key) { return (int)((key >> (IsTransparent(key) ? TRANSPARENT_TEXTURE_SHIFT : TEXTURE_SHIFT)) & TEXTURE_MASK); }
+	static int GetMesh(uint64_t key) { return (int)((key >> (IsTransparent(key) ? TRANSPARENT_MESH_SHIFT : MESH_SHIFT)) & MESH_MASK); }
+	static int GetMaterial(uint64_t key) { return (int)((key >> (IsTransparent(key) ? TRANSPARENT_MATERIAL_SHIFT : MATERIAL_SHIFT)) & MATERIAL_MASK); }
+
+	// remove all the packets, keeps the memory
+	void Clear();
+	void Reserve(size_t count);
+	// add a draw packet
+	void Submit(uint64_t key, uint32_t command);
+	// hold the passed in number of packets, for filling them
+	// with Set() from several threads at once
+	void Resize(size_t count);
+	void Set(size_t index, uint64_t key, uint32_t command);
+	// sort the packets by key and update the statistics
+	void Sort();
+
+	size_t Count() const { return m_packets.size(); }
+	const DRAW_PACKET& GetPacket(size_t index) const { return m_packets[index]; }
+	const RENDER_QUEUE_STATS& GetStats() const { return m_stats; }
+
+	// count the pipeline, texture, mesh and material changes
+	// between neighbouring packets in the current order
+	int CountStateChanges() const;
+
+private:
+	static const int MATERIAL_SHIFT = 24;
+	static const int MESH_SHIFT = 36;
+	static const int TEXTURE_SHIFT = 44;
+	static const int PIPELINE_SHIFT = 56;
+	static const uint64_t DEPTH_MASK = 0xFFFFFF;
+	static const uint64_t MATERIAL_MASK = 0xFFF;
+	static const uint64_t MESH_MASK = 0xFF;
+	static const uint64_t TEXTURE_MASK = 0xFFF;
+	static const uint64_t PIPELINE_MASK = 0xFF;
+	// the field positions of transparent packets
+	static const int TRANSPARENT_MATERIAL_SHIFT = 0;
+	static const int TRANSPARENT_MESH_SHIFT = 12;
+	static const int TRANSPARENT_TEXTURE_SHIFT = 20;
+	static const int TRANSPARENT_DEPTH_SHIFT = 32;
+
+	static bool IsTransparent(uint64_t key) { return (key >> PIPELINE_SHIFT) == PIPELINE_TRANSPARENT; }
+
+	std::vector<DRAW_PACKET> m_packets;
+	// scratch buffer for the radix sort passes
+	std::vector<DRAW_PACKET> m_sortBuffer;
+	RENDER_QUEUE_STATS m_stats;
+};
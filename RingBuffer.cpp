@@ -0,0 +1,182 @@
+///////////////////////////////////////////////////////////////////////////////
+// ringbuffer.cpp
+// ============
+// persistently mapped buffer the CPU streams each frame's draw data into
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RingBuffer.h"
+#include "GLStateCache.h"
+
+#include <iostream>
+
+// declaration of local helpers
+namespace
+{
+	// smallest region, so a growing scene does not reallocate
+	// on every new object
+	const size_t MIN_REGION_SIZE = 64 * 1024;
+	// longest single wait for a fence, in nanoseconds
+	const GLuint64 FENCE_WAIT_TIMEOUT = 1000000000;
+}
+
+/***********************************************************
+ *  RingBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+RingBuffer::RingBuffer()
+{
+	m_buffer = 0;
+	m_pMapped = NULL;
+	m_regionSize = 0;
+	m_region = 0;
+	m_head = 0;
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+	{
+		m_fences[i] = 0;
+	}
+	m_stallCount = 0;
+	m_generation = 0;
+}
+
+/***********************************************************
+ *  ~RingBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+RingBuffer::~RingBuffer()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void RingBuffer::Destroy()
+{
+	for (int i = 0; i < RING_BUFFER_FRAMES; i++)
+	{
+		if (m_fences[i] != 0)
+		{
+			glDeleteSync(m_fences[i]);
+			m_fences[i] = 0;
+		}
+	}
+	if (m_buffer != 0)
+	{
+		// deleting the buffer also unmaps it
+		g_GLState.DeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+	}
+	m_pMapped = NULL;
+	m_regionSize = 0;
+	m_head = 0;
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for replacing the buffer with one
+ *  whose regions hold the passed in number of bytes.  The old
+ *  buffer is deleted right away, OpenGL keeps its storage
+ *  until the draws still reading it have finished.  Deleting
+ *  it also detaches it from every vertex array, so the
+ *  generation changes even when the new buffer gets the
+ *  same name.
+ ***********************************************************/
+void RingBuffer::Create(size_t regionSize)
+{
+	Destroy();
+	m_generation++;
+
+	m_regionSize = (regionSize > MIN_REGION_SIZE) ? regionSize : MIN_REGION_SIZE;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = (GLsizeiptr)(m_regionSize * RING_BUFFER_FRAMES);
+
+	glGenBuffers(1, &m_buffer);
+	g_GLState.BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+	m_pMapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+	if (NULL == m_pMapped)
+	{
+		std::cout << "Could not map the per-frame ring buffer" << std::endl;
+		g_GLState.DeleteBuffers(1, &m_buffer);
+		m_buffer = 0;
+		m_regionSize = 0;
+	}
+}
+
+/***********************************************************
+ *  WaitForRegion()
+ *
+ *  This method is used for making sure the GPU is done with
+ *  a region before it is written.  The fence is polled first,
+ *  only a region still in use flushes and waits.
+ ***********************************************************/
+void RingBuffer::WaitForRegion(int region)
+{
+	if (m_fences[region] == 0)
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(m_fences[region], 0, 0);
+	if (result == GL_TIMEOUT_EXPIRED)
+	{
+		m_stallCount++;
+		do
+		{
+			result = glClientWaitSync(m_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+		} while (result == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(m_fences[region]);
+	m_fences[region] = 0;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ ***********************************************************/
+void RingBuffer::BeginFrame(size_t regionSize)
+{
+	if ((m_buffer == 0) || (regionSize > m_regionSize))
+	{
+		// double the size so the buffer is not recreated every
+		// frame while the scene grows
+		Create((regionSize > m_regionSize * 2) ? regionSize : m_regionSize * 2);
+	}
+
+	m_region = (m_region + 1) % RING_BUFFER_FRAMES;
+	WaitForRegion(m_region);
+	m_head = (size_t)m_region * m_regionSize;
+}
+
+/***********************************************************
+ *  Allocate()
+ ***********************************************************/
+void* RingBuffer::Allocate(size_t size, size_t alignment, size_t& offset)
+{
+	if (NULL == m_pMapped)
+	{
+		return(NULL);
+	}
+
+	size_t start = ((m_head + alignment - 1) / alignment) * alignment;
+	if (start + size > ((size_t)m_region + 1) * m_regionSize)
+	{
+		return(NULL);
+	}
+	m_head = start + size;
+	offset = start;
+	return(m_pMapped + start);
+}
+
+/***********************************************************
+ *  EndFrame()
+ ***********************************************************/
+void RingBuffer::EndFrame()
+{
+	if ((m_buffer != 0) && (m_fences[m_region] == 0))
+	{
+		m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// ringbuffer.h
+// ============
+// persistently mapped buffer the CPU streams each frame's draw data into
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// frames the CPU may run ahead of the GPU, one region each
+const int RING_BUFFER_FRAMES = 3;
+
+/***********************************************************
+ *  RingBuffer
+ *
+ *  This class keeps one buffer, created with glBufferStorage
+ *  and mapped persistent and coherent for its whole life,
+ *  split into RING_BUFFER_FRAMES regions.  Every frame writes
+ *  its data into the next region with plain memory copies,
+ *  so there are no glBufferSubData calls and no driver side
+ *  copies, and fences the region after its last draw.  A
+ *  region is written again RING_BUFFER_FRAMES frames later,
+ *  by then the GPU has normally finished reading it; when it
+ *  has not the CPU waits and the wait is counted.
+ ***********************************************************/
+class RingBuffer
+{
+public:
+	// constructor
+	RingBuffer();
+	// destructor
+	~RingBuffer();
+
+	// move to the next region, grown first when it is smaller
+	// than the passed in number of bytes
+	void BeginFrame(size_t regionSize);
+	// get room in the current region, aligned to a multiple of
+	// the alignment from the start of the buffer, or NULL when
+	// the region is full; offset receives its buffer offset
+	void* Allocate(size_t size, size_t alignment, size_t& offset);
+	// fence the current region, after the last command that
+	// reads it
+	void EndFrame();
+	// free the buffer and the fences
+	void Destroy();
+
+	GLuint GetBuffer() const { return m_buffer; }
+	// changes whenever the buffer is created again, OpenGL may
+	// hand out the old name for the new buffer, so vertex
+	// arrays that point at it have to compare this instead
+	unsigned int GetGeneration() const { return m_generation; }
+	// frames that had to wait for the GPU to finish a region
+	int GetStallCount() const { return m_stallCount; }
+
+private:
+	GLuint m_buffer;
+	unsigned char* m_pMapped;
+	size_t m_regionSize;
+	int m_region;
+	// next free byte of the current region, from the buffer start
+	size_t m_head;
+	GLsync m_fences[RING_BUFFER_FRAMES];
+	int m_stallCount;
+	unsigned int m_generation;
+
+	void Create(size_t regionSize);
+	void WaitForRegion(int region);
+};
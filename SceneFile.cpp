@@ -0,0 +1,716 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.cpp
+// ============
+// load 3D scene descriptions from text or memory-mapped binary files
+//
+//	Text format, one statement per line, '#' starts a comment:
+//
+//	  texture <tag> <image file>
+//	  node [name=<name>] [parent=<name>] [scale=x,y,z]
+//	       [rotation=x,y,z] [position=x,y,z]
+//	  object mesh=<plane|box|pyramid3|cylinder|prism> [material=<tag>]
+//	         [texture=<tag>] [color=r,g,b,a] [uv=u,v] [name=<name>]
+//	         [parent=<name>] [scale=x,y,z] [rotation=x,y,z] [position=x,y,z]
+//
+//	A node is a transform without a mesh.  Transforms are relative to
+//	the parent, which has to be declared earlier in the file.
+//
+//	The binary format is a small header, tag tables and node names
+//	followed by one 16-byte aligned array per draw list and node list
+//	field.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneFile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+// declaration of the binary format and local helpers
+namespace
+{
+	const char SCENE_BINARY_MAGIC[4] = { 'S', 'C', 'N', 'B' };
+	const uint32_t SCENE_BINARY_VERSION = 4;
+	const int SCENE_TAG_LENGTH = 32;
+	const int SCENE_PATH_LENGTH = 224;
+	const uint32_t SCENE_ARRAY_ALIGNMENT = 16;
+
+	const char* g_MeshNames[MESH_COUNT] = { "plane", "box", "pyramid3", "cylinder", "prism" };
+
+	// one entry per draw list and node list array, in file order
+	enum SCENE_ARRAY
+	{
+		ARRAY_MESH = 0,
+		ARRAY_MATERIAL,
+		ARRAY_TEXTURE,
+		ARRAY_COLOR,
+		ARRAY_UVSCALE,
+		ARRAY_NODE,
+		ARRAY_PARENT,
+		ARRAY_SCALE,
+		ARRAY_ROTATION,
+		ARRAY_POSITION,
+		ARRAY_COUNT
+	};
+
+	// the first array that holds one entry per node instead of per object
+	const int FIRST_NODE_ARRAY = ARRAY_PARENT;
+
+	const uint32_t g_ArrayElementSize[ARRAY_COUNT] =
+	{
+		sizeof(uint8_t),
+		sizeof(int16_t),
+		sizeof(int16_t),
+		sizeof(glm::vec4),
+		sizeof(glm::vec2),
+		sizeof(int32_t),
+		sizeof(int32_t),
+		sizeof(glm::vec3),
+		sizeof(glm::vec3),
+		sizeof(glm::vec3)
+	};
+
+	struct BINARY_HEADER
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t objectCount;
+		uint32_t nodeCount;
+		uint32_t textureCount;
+		uint32_t materialCount;
+		// size and modification time of the text scene the
+		// file was written from, or 0 when it has none
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint32_t arrayOffsets[ARRAY_COUNT];
+	};
+
+	// size and modification time of a file, false when it
+	// cannot be read
+	bool GetFileStamp(const char* filename, uint64_t& size, int64_t& time)
+	{
+		struct stat info;
+		if ((NULL == filename) || (stat(filename, &info) != 0))
+			return false;
+		size = (uint64_t)info.st_size;
+		time = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	uint32_t ArrayLength(const BINARY_HEADER& header, int array)
+	{
+		return (array >= FIRST_NODE_ARRAY) ? header.nodeCount : header.objectCount;
+	}
+
+	// copy a whole array out of the mapped file into a vector
+	template <typename T>
+	void ReadArray(std::vector<T>& dest, const uint8_t* data, const BINARY_HEADER& header, int array)
+	{
+		uint32_t length = ArrayLength(header, array);
+		dest.resize(length);
+		if (length > 0)
+			memcpy(&dest[0], data + header.arrayOffsets[array], length * sizeof(T));
+	}
+
+	struct BINARY_TEXTURE
+	{
+		char tag[SCENE_TAG_LENGTH];
+		char filename[SCENE_PATH_LENGTH];
+	};
+
+	struct BINARY_MATERIAL
+	{
+		char tag[SCENE_TAG_LENGTH];
+	};
+
+	// one per node, empty for unnamed nodes
+	struct BINARY_NODE_NAME
+	{
+		char name[SCENE_TAG_LENGTH];
+	};
+
+	/***********************************************************
+	 *  MappedFile
+	 *
+	 *  Read-only memory mapping of a whole file.
+	 ***********************************************************/
+	class MappedFile
+	{
+	public:
+		MappedFile() : m_data(NULL), m_size(0)
+#ifdef _WIN32
+			, m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+		{
+		}
+		~MappedFile() { Close(); }
+
+		bool Open(const char* filename)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (m_file == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+				return false;
+			m_size = (size_t)fileSize.QuadPart;
+
+			m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (m_mapping == NULL)
+				return false;
+			m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+			int fd = open(filename, O_RDONLY);
+			if (fd < 0)
+				return false;
+
+			struct stat fileInfo;
+			if (fstat(fd, &fileInfo) != 0 || fileInfo.st_size == 0)
+			{
+				close(fd);
+				return false;
+			}
+			m_size = (size_t)fileInfo.st_size;
+
+			void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			close(fd);
+			if (data == MAP_FAILED)
+				return false;
+			m_data = (const uint8_t*)data;
+#endif
+			return (m_data != NULL);
+		}
+
+		void Close()
+		{
+#ifdef _WIN32
+			if (m_data != NULL)
+				UnmapViewOfFile(m_data);
+			if (m_mapping != NULL)
+				CloseHandle(m_mapping);
+			if (m_file != INVALID_HANDLE_VALUE)
+				CloseHandle(m_file);
+			m_mapping = NULL;
+			m_file = INVALID_HANDLE_VALUE;
+#else
+			if (m_data != NULL)
+				munmap((void*)m_data, m_size);
+#endif
+			m_data = NULL;
+			m_size = 0;
+		}
+
+		const uint8_t* Data() const { return m_data; }
+		size_t Size() const { return m_size; }
+
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+#ifdef _WIN32
+		HANDLE m_file;
+		HANDLE m_mapping;
+#endif
+	};
+
+	// parse a comma separated list of exactly count floats
+	bool ParseFloats(const std::string& value, float* out, int count)
+	{
+		const char* text = value.c_str();
+		for (int i = 0; i < count; i++)
+		{
+			char* end = NULL;
+			out[i] = strtof(text, &end);
+			if (end == text)
+				return false;
+			text = end;
+			if (i < count - 1)
+			{
+				if (*text != ',')
+					return false;
+				text++;
+			}
+		}
+		return (*text == '\0');
+	}
+
+	uint32_t AlignOffset(uint32_t offset)
+	{
+		return (offset + SCENE_ARRAY_ALIGNMENT - 1) & ~(SCENE_ARRAY_ALIGNMENT - 1);
+	}
+
+	// copy a string into a fixed size, zero padded field
+	void CopyFixedString(char* dest, size_t destSize, const std::string& source)
+	{
+		memset(dest, 0, destSize);
+		strncpy(dest, source.c_str(), destSize - 1);
+	}
+
+	std::string ReadFixedString(const char* source, size_t sourceSize)
+	{
+		size_t length = 0;
+		while ((length < sourceSize) && (source[length] != '\0'))
+			length++;
+		return std::string(source, length);
+	}
+}
+
+/***********************************************************
+ *  SCENE_DRAW_LIST::Clear()
+ ***********************************************************/
+void SCENE_DRAW_LIST::Clear()
+{
+	meshIDs.clear();
+	materialIDs.clear();
+	textureIDs.clear();
+	colors.clear();
+	uvScales.clear();
+	nodeIDs.clear();
+}
+
+/***********************************************************
+ *  SCENE_DRAW_LIST::Reserve()
+ ***********************************************************/
+void SCENE_DRAW_LIST::Reserve(size_t count)
+{
+	meshIDs.reserve(count);
+	materialIDs.reserve(count);
+	textureIDs.reserve(count);
+	colors.reserve(count);
+	uvScales.reserve(count);
+	nodeIDs.reserve(count);
+}
+
+/***********************************************************
+ *  SCENE_NODE_LIST::Clear()
+ ***********************************************************/
+void SCENE_NODE_LIST::Clear()
+{
+	parents.clear();
+	scales.clear();
+	rotations.clear();
+	positions.clear();
+	names.clear();
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for resetting all the loaded scene data.
+ ***********************************************************/
+void SceneFile::Clear()
+{
+	m_textures.clear();
+	m_materialTags.clear();
+	m_objects.Clear();
+	m_nodes.Clear();
+}
+
+/***********************************************************
+ *  FindTexture()
+ *
+ *  This method is used for getting the index of a declared
+ *  texture by tag, or -1 if it was never declared.
+ ***********************************************************/
+int SceneFile::FindTexture(const std::string& tag) const
+{
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].tag.compare(tag) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+/***********************************************************
+ *  FindNode()
+ *
+ *  This method is used for getting the index of a named node,
+ *  or -1 if no node has that name yet.
+ ***********************************************************/
+int SceneFile::FindNode(const std::string& name) const
+{
+	for (size_t i = 0; i < m_nodes.names.size(); i++)
+	{
+		if (m_nodes.names[i].compare(name) == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+/***********************************************************
+ *  AddMaterialTag()
+ *
+ *  This method is used for getting the index of a material
+ *  tag, adding it to the table the first time it is seen.
+ ***********************************************************/
+int SceneFile::AddMaterialTag(const std::string& tag)
+{
+	for (size_t i = 0; i < m_materialTags.size(); i++)
+	{
+		if (m_materialTags[i].compare(tag) == 0)
+			return (int)i;
+	}
+	m_materialTags.push_back(tag);
+	return (int)m_materialTags.size() - 1;
+}
+
+/***********************************************************
+ *  LoadText()
+ *
+ *  This method is used for parsing a text scene description.
+ ***********************************************************/
+bool SceneFile::LoadText(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open scene file:" << filename << std::endl;
+		return false;
+	}
+
+	Clear();
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		// strip comments
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream tokens(line);
+		std::string keyword;
+		if (!(tokens >> keyword))
+			continue;
+
+		if (keyword == "texture")
+		{
+			TEXTURE_ENTRY texture;
+			if (!(tokens >> texture.tag >> texture.filename) || (FindTexture(texture.tag) >= 0))
+			{
+				std::cout << filename << "(" << lineNumber << "): bad texture declaration" << std::endl;
+				return false;
+			}
+			m_textures.push_back(texture);
+		}
+		else if ((keyword == "object") || (keyword == "node"))
+		{
+			bool bObject = (keyword == "object");
+			int meshID = -1;
+			int materialID = -1;
+			int textureID = -1;
+			int parent = -1;
+			std::string name;
+			glm::vec4 color(1.0f, 1.0f, 1.0f, 1.0f);
+			glm::vec2 uvScale(1.0f, 1.0f);
+			glm::vec3 scale(1.0f, 1.0f, 1.0f);
+			glm::vec3 rotation(0.0f, 0.0f, 0.0f);
+			glm::vec3 position(0.0f, 0.0f, 0.0f);
+
+			std::string field;
+			bool bValid = true;
+			while (bValid && (tokens >> field))
+			{
+				size_t equals = field.find('=');
+				if (equals == std::string::npos)
+				{
+					bValid = false;
+					break;
+				}
+				std::string key = field.substr(0, equals);
+				std::string value = field.substr(equals + 1);
+
+				if (key == "name")
+					bValid = (FindNode(value) < 0) && !value.empty() && (value.size() < SCENE_TAG_LENGTH);
+				else if (key == "parent")
+				{
+					parent = FindNode(value);
+					bValid = (parent >= 0);
+				}
+				else if (key == "scale")
+					bValid = ParseFloats(value, &scale.x, 3);
+				else if (key == "rotation")
+					bValid = ParseFloats(value, &rotation.x, 3);
+				else if (key == "position")
+					bValid = ParseFloats(value, &position.x, 3);
+				else if (!bObject)
+					bValid = false;
+				else if (key == "mesh")
+				{
+					for (int i = 0; i < MESH_COUNT; i++)
+					{
+						if (value == g_MeshNames[i])
+							meshID = i;
+					}
+					bValid = (meshID >= 0);
+				}
+				else if (key == "material")
+					materialID = AddMaterialTag(value);
+				else if (key == "texture")
+				{
+					textureID = FindTexture(value);
+					bValid = (textureID >= 0);
+				}
+				else if (key == "color")
+					bValid = ParseFloats(value, &color.x, 4);
+				else if (key == "uv")
+					bValid = ParseFloats(value, &uvScale.x, 2);
+				else
+					bValid = false;
+
+				if (key == "name")
+					name = value;
+			}
+
+			if (!bValid || (bObject && meshID < 0))
+			{
+				std::cout << filename << "(" << lineNumber << "): bad " << keyword << " field \"" << field << "\"" << std::endl;
+				return false;
+			}
+
+			int nodeID = (int)m_nodes.Count();
+			m_nodes.parents.push_back(parent);
+			m_nodes.scales.push_back(scale);
+			m_nodes.rotations.push_back(rotation);
+			m_nodes.positions.push_back(position);
+			m_nodes.names.push_back(name);
+
+			if (bObject)
+			{
+				m_objects.meshIDs.push_back((uint8_t)meshID);
+				m_objects.materialIDs.push_back((int16_t)materialID);
+				m_objects.textureIDs.push_back((int16_t)textureID);
+				m_objects.colors.push_back(color);
+				m_objects.uvScales.push_back(uvScale);
+				m_objects.nodeIDs.push_back(nodeID);
+			}
+		}
+		else
+		{
+			std::cout << filename << "(" << lineNumber << "): unknown keyword \"" << keyword << "\"" << std::endl;
+			return false;
+		}
+	}
+
+	std::cout << "Loaded scene:" << filename << ", objects:" << m_objects.Count() << ", nodes:" << m_nodes.Count() << std::endl;
+
+	return true;
+}
+
+/***********************************************************
+ *  LoadBinary()
+ *
+ *  This method is used for loading a binary scene description.
+ *  The file is mapped into memory and each array is copied
+ *  straight into the draw list.  When the text scene it was
+ *  written from is passed in and can be read, the file is
+ *  only used if the text scene's size and modification time
+ *  still match the ones it was written with.
+ ***********************************************************/
+bool SceneFile::LoadBinary(const char* filename, const char* sourceFilename)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	const uint8_t* data = file.Data();
+	size_t size = file.Size();
+
+	if (size < sizeof(BINARY_HEADER))
+		return false;
+
+	BINARY_HEADER header;
+	memcpy(&header, data, sizeof(header));
+	if ((memcmp(header.magic, SCENE_BINARY_MAGIC, sizeof(header.magic)) != 0) ||
+		(header.version != SCENE_BINARY_VERSION))
+	{
+		std::cout << "Unsupported binary scene file:" << filename << std::endl;
+		return false;
+	}
+
+	uint64_t sourceSize = 0;
+	int64_t sourceTime = 0;
+	if (GetFileStamp(sourceFilename, sourceSize, sourceTime) &&
+		((header.sourceSize != sourceSize) || (header.sourceTime != sourceTime)))
+	{
+		return false;
+	}
+
+	size_t tablesSize = sizeof(BINARY_HEADER) +
+		(size_t)header.textureCount * sizeof(BINARY_TEXTURE) +
+		(size_t)header.materialCount * sizeof(BINARY_MATERIAL) +
+		(size_t)header.nodeCount * sizeof(BINARY_NODE_NAME);
+	if (size < tablesSize)
+		return false;
+	for (int i = 0; i < ARRAY_COUNT; i++)
+	{
+		if (size < (size_t)header.arrayOffsets[i] + (size_t)ArrayLength(header, i) * g_ArrayElementSize[i])
+		{
+			std::cout << "Truncated binary scene file:" << filename << std::endl;
+			return false;
+		}
+	}
+
+	Clear();
+
+	const BINARY_TEXTURE* textures = (const BINARY_TEXTURE*)(data + sizeof(BINARY_HEADER));
+	m_textures.resize(header.textureCount);
+	for (uint32_t i = 0; i < header.textureCount; i++)
+	{
+		m_textures[i].tag = ReadFixedString(textures[i].tag, SCENE_TAG_LENGTH);
+		m_textures[i].filename = ReadFixedString(textures[i].filename, SCENE_PATH_LENGTH);
+	}
+
+	const BINARY_MATERIAL* materials = (const BINARY_MATERIAL*)(textures + header.textureCount);
+	m_materialTags.resize(header.materialCount);
+	for (uint32_t i = 0; i < header.materialCount; i++)
+	{
+		m_materialTags[i] = ReadFixedString(materials[i].tag, SCENE_TAG_LENGTH);
+	}
+
+	const BINARY_NODE_NAME* nodeNames = (const BINARY_NODE_NAME*)(materials + header.materialCount);
+	m_nodes.names.resize(header.nodeCount);
+	for (uint32_t i = 0; i < header.nodeCount; i++)
+	{
+		m_nodes.names[i] = ReadFixedString(nodeNames[i].name, SCENE_TAG_LENGTH);
+	}
+
+	ReadArray(m_objects.meshIDs, data, header, ARRAY_MESH);
+	ReadArray(m_objects.materialIDs, data, header, ARRAY_MATERIAL);
+	ReadArray(m_objects.textureIDs, data, header, ARRAY_TEXTURE);
+	ReadArray(m_objects.colors, data, header, ARRAY_COLOR);
+	ReadArray(m_objects.uvScales, data, header, ARRAY_UVSCALE);
+	ReadArray(m_objects.nodeIDs, data, header, ARRAY_NODE);
+	ReadArray(m_nodes.parents, data, header, ARRAY_PARENT);
+	ReadArray(m_nodes.scales, data, header, ARRAY_SCALE);
+	ReadArray(m_nodes.rotations, data, header, ARRAY_ROTATION);
+	ReadArray(m_nodes.positions, data, header, ARRAY_POSITION);
+
+	// reject out of range references rather than trusting the file
+	bool bValid = true;
+	for (uint32_t i = 0; i < header.objectCount; i++)
+	{
+		bValid = bValid &&
+			(m_objects.meshIDs[i] < MESH_COUNT) &&
+			(m_objects.materialIDs[i] < (int)header.materialCount) &&
+			(m_objects.textureIDs[i] < (int)header.textureCount) &&
+			(m_objects.nodeIDs[i] >= 0) && (m_objects.nodeIDs[i] < (int)header.nodeCount);
+	}
+	for (uint32_t i = 0; i < header.nodeCount; i++)
+	{
+		// parents must come before their children
+		bValid = bValid && (m_nodes.parents[i] < (int)i);
+	}
+	if (!bValid)
+	{
+		std::cout << "Corrupt binary scene file:" << filename << std::endl;
+		Clear();
+		return false;
+	}
+
+	std::cout << "Loaded binary scene:" << filename << ", objects:" << header.objectCount << ", nodes:" << header.nodeCount << std::endl;
+
+	return true;
+}
+
+/***********************************************************
+ *  SaveBinary()
+ *
+ *  This method is used for writing the loaded scene out in
+ *  the binary format, along with the size and modification
+ *  time of the text scene it was loaded from.
+ ***********************************************************/
+bool SceneFile::SaveBinary(const char* filename, const char* sourceFilename) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write binary scene file:" << filename << std::endl;
+		return false;
+	}
+
+	BINARY_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_BINARY_MAGIC, sizeof(header.magic));
+	header.version = SCENE_BINARY_VERSION;
+	header.objectCount = (uint32_t)m_objects.Count();
+	header.nodeCount = (uint32_t)m_nodes.Count();
+	header.textureCount = (uint32_t)m_textures.size();
+	header.materialCount = (uint32_t)m_materialTags.size();
+	GetFileStamp(sourceFilename, header.sourceSize, header.sourceTime);
+
+	uint32_t offset = sizeof(BINARY_HEADER) +
+		header.textureCount * sizeof(BINARY_TEXTURE) +
+		header.materialCount * sizeof(BINARY_MATERIAL) +
+		header.nodeCount * sizeof(BINARY_NODE_NAME);
+	for (int i = 0; i < ARRAY_COUNT; i++)
+	{
+		offset = AlignOffset(offset);
+		header.arrayOffsets[i] = offset;
+		offset += ArrayLength(header, i) * g_ArrayElementSize[i];
+	}
+
+	file.write((const char*)&header, sizeof(header));
+
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		BINARY_TEXTURE texture;
+		CopyFixedString(texture.tag, sizeof(texture.tag), m_textures[i].tag);
+		CopyFixedString(texture.filename, sizeof(texture.filename), m_textures[i].filename);
+		file.write((const char*)&texture, sizeof(texture));
+	}
+	for (size_t i = 0; i < m_materialTags.size(); i++)
+	{
+		BINARY_MATERIAL material;
+		CopyFixedString(material.tag, sizeof(material.tag), m_materialTags[i]);
+		file.write((const char*)&material, sizeof(material));
+	}
+	for (size_t i = 0; i < m_nodes.names.size(); i++)
+	{
+		BINARY_NODE_NAME nodeName;
+		CopyFixedString(nodeName.name, sizeof(nodeName.name), m_nodes.names[i]);
+		file.write((const char*)&nodeName, sizeof(nodeName));
+	}
+
+	const void* arrays[ARRAY_COUNT] =
+	{
+		m_objects.meshIDs.data(),
+		m_objects.materialIDs.data(),
+		m_objects.textureIDs.data(),
+		m_objects.colors.data(),
+		m_objects.uvScales.data(),
+		m_objects.nodeIDs.data(),
+		m_nodes.parents.data(),
+		m_nodes.scales.data(),
+		m_nodes.rotations.data(),
+		m_nodes.positions.data()
+	};
+	for (int i = 0; i < ARRAY_COUNT; i++)
+	{
+		// zero pad up to the aligned array offset
+		static const char padding[SCENE_ARRAY_ALIGNMENT] = { 0 };
+		file.write(padding, header.arrayOffsets[i] - (uint32_t)file.tellp());
+		file.write((const char*)arrays[i], ArrayLength(header, i) * g_ArrayElementSize[i]);
+	}
+
+	return file.good();
+}
@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.h
+// ============
+// load 3D scene descriptions from text or memory-mapped binary files
+//
+//	Text scenes are easy to edit by hand, binary scenes are a straight
+//	image of the draw list arrays so they can be mapped and copied
+//	without any parsing.
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// the basic meshes that can be referenced from a scene file
+enum SCENE_MESH
+{
+	MESH_PLANE = 0,
+	MESH_BOX,
+	MESH_PYRAMID3,
+	MESH_CYLINDER,
+	MESH_PRISM,
+	MESH_COUNT
+};
+
+/***********************************************************
+ *  SCENE_DRAW_LIST
+ *
+ *  Structure-of-arrays list of the objects in a scene.  Every
+ *  array holds one entry per object, so walking the list
+ *  touches memory strictly front to back.  A material or
+ *  texture ID of -1 means the object has none.  The node ID
+ *  is the object's entry in the scene node list.
+ ***********************************************************/
+struct SCENE_DRAW_LIST
+{
+	std::vector<uint8_t> meshIDs;
+	std::vector<int16_t> materialIDs;
+	std::vector<int16_t> textureIDs;
+	std::vector<glm::vec4> colors;
+	std::vector<glm::vec2> uvScales;
+	std::vector<int32_t> nodeIDs;
+
+	size_t Count() const { return meshIDs.size(); }
+	void Clear();
+	void Reserve(size_t count);
+};
+
+/***********************************************************
+ *  SCENE_NODE_LIST
+ *
+ *  Structure-of-arrays list of the scene transforms.  Every
+ *  node comes after its parent, roots have a parent of -1.
+ *  Unnamed nodes have an empty name.
+ ***********************************************************/
+struct SCENE_NODE_LIST
+{
+	std::vector<int32_t> parents;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> positions;
+	std::vector<std::string> names;
+
+	size_t Count() const { return parents.size(); }
+	void Clear();
+};
+
+/***********************************************************
+ *  SceneFile
+ *
+ *  This class reads and writes scene descriptions.  Material
+ *  and texture IDs in the loaded draw list are indexes into
+ *  the file's own tag tables, they are remapped to loaded
+ *  resources by the scene manager.
+ ***********************************************************/
+class SceneFile
+{
+public:
+	struct TEXTURE_ENTRY
+	{
+		std::string tag;
+		std::string filename;
+	};
+
+	// load a text scene description
+	bool LoadText(const char* filename);
+	// load a binary scene description through a memory mapping,
+	// false when it is out of date with its text scene
+	bool LoadBinary(const char* filename, const char* sourceFilename = NULL);
+	// write the loaded scene out in the binary format, stamped
+	// with the text scene it was loaded from
+	bool SaveBinary(const char* filename, const char* sourceFilename = NULL) const;
+
+	// textures referenced by the scene, in declaration order
+	std::vector<TEXTURE_ENTRY> m_textures;
+	// material tags referenced by the scene, in first-use order
+	std::vector<std::string> m_materialTags;
+	// the scene objects
+	SCENE_DRAW_LIST m_objects;
+	// the scene transforms
+	SCENE_NODE_LIST m_nodes;
+
+private:
+	void Clear();
+	int FindTexture(const std::string& tag) const;
+	int FindNode(const std::string& name) const;
+	int AddMaterialTag(const std::string& tag);
+};
@@ -8,22 +8,60 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "SceneManager.h"
-
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#endif
+#include "Profiler.h"
+#include "GLStateCache.h"
+#include "JobSystem.h"
 
 #include <glm/gtx/transform.hpp>
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstring>
+#include <sstream>
+
 // declaration of global variables
 namespace
 {
-	const char* g_ModelName = "model";
-	const char* g_ColorValueName = "objectColor";
-	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
-	const char* g_UseLightingName = "bUseLighting";
+	// camera distance that maps to the far end of the sort key
+	// depth range, matches the far plane of the projection
+	const float SORT_DEPTH_RANGE = 100.0f;
+
+	// an opaque object whose world bounds are at least this
+	// large on two axes is drawn into the occluder depth
+	const float OCCLUDER_MIN_SIZE = 2.0f;
+
+	// how far past a level's screen size an object has to get
+	// before its level changes, so objects near a switch point
+	// do not pop back and forth
+	const float LOD_HYSTERESIS = 0.15f;
+
+	// objects per job when the frame preparation splits a loop
+	// over the objects, fewer are not worth a job of their own
+	const size_t OBJECTS_PER_JOB = 256;
+
+	// the scene description loaded by PrepareScene()
+	const char* SCENE_FILENAME = "scenes/house.scene";
+
+	// the scene shaders the variants are compiled from, the
+	// general program is loaded from them in MainCode
+	const char* SCENE_VERTEX_SHADER = "shaders/vertexShader.glsl";
+	const char* SCENE_FRAGMENT_SHADER = "shaders/fragmentShader.glsl";
+
+	// true when the binary file exists and is newer than its text source,
+	// one written in the same second as an edit may predate it
+	bool IsBinarySceneCurrent(const std::string& binaryFilename, const char* textFilename)
+	{
+		struct stat binaryInfo;
+		struct stat textInfo;
+		if (stat(binaryFilename.c_str(), &binaryInfo) != 0)
+			return false;
+		if (stat(textFilename, &textInfo) != 0)
+			return true;
+		return (binaryInfo.st_mtime > textInfo.st_mtime);
+	}
 }
 
 /***********************************************************
@@ -34,14 +72,48 @@ namespace
 SceneManager::SceneManager(ShaderManager *pShaderManager)
 {
 	m_pShaderManager = pShaderManager;
-	m_basicMeshes = new ShapeMeshes();
-
-	m_numLights = 0;
-	//init lights
-	for (int i = 0; i < MAX_LIGHTS; i++)
+	m_frameCommandOffset = 0;
+	m_instanceBufferGeneration = 0;
+	m_frameInstanceBase = 0;
+	m_frameParameterBase = 0;
+	m_bGpuCulling = false;
+	m_bGpuObjectsDirty = true;
+	m_bOcclusionCulling = false;
+	m_bLightingEnabled = false;
+	m_bStaticBaking = false;
+	m_bStaticBakingCache = true;
+	m_bakedNode = -1;
+	m_bLevelOfDetail = true;
+	m_preparePacket = 0;
+	m_bPipelinedFrames = false;
+	m_bPacketPending = false;
+	for (int i = 0; i < 2; i++)
 	{
-		m_lights[i].enabled = false;
+		m_framePackets[i].viewMatrix = glm::mat4(1.0f);
+		m_framePackets[i].projectionMatrix = glm::mat4(1.0f);
+		m_framePackets[i].viewPosition = glm::vec3(0.0f);
+		m_framePackets[i].drawTriangles = 0;
+		m_framePackets[i].queueStats = RENDER_QUEUE_STATS();
+		m_framePackets[i].bStale = true;
 	}
+	m_frameQueueStats = RENDER_QUEUE_STATS();
+	m_frameDraws = 0;
+	m_frameTriangles = 0;
+	m_frameCullStats = CULL_STATS();
+
+	m_modelMatrix = glm::mat4(1.0f);
+	m_uvScale = glm::vec2(1.0f);
+	m_viewMatrix = glm::mat4(1.0f);
+	m_projectionMatrix = glm::mat4(1.0f);
+	m_viewPosition = glm::vec3(0.0f);
+
+	m_materialBuffer = 0;
+	m_firstDirtyMaterial = 0;
+
+	m_globalLightCount = 0;
+	m_lightBuffer = 0;
+	m_lightCapacity = 0;
+	m_bLightsDirty = true;
 }
 
 /***********************************************************
@@ -51,172 +123,106 @@ SceneManager::SceneManager(ShaderManager *pShaderManager)
  ***********************************************************/
 SceneManager::~SceneManager()
 {
+	// no job reads the scene any more once RenderScene() returns
+	g_JobSystem.Stop();
+
 	m_pShaderManager = NULL;
-	delete m_basicMeshes;
-	m_basicMeshes = NULL;
+	m_meshes.Destroy();
+
+	m_frameData.Destroy();
+	if (m_lightBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_lightBuffer);
+		m_lightBuffer = 0;
+	}
+	m_lightClusters.Destroy();
+	m_gpuCulling.Destroy();
+	m_hiZ.Destroy();
+	m_shaderVariants.Destroy();
+	if (m_materialBuffer != 0)
+	{
+		g_GLState.DeleteBuffers(1, &m_materialBuffer);
+		m_materialBuffer = 0;
+	}
 }
 
 /***********************************************************
  *  CreateGLTexture()
  *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL,
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
- ***********************************************************/
-bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
-{
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename,
-		&width,
-		&height,
-		&colorChannels,
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
-			return false;
-		}
-
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
-		m_loadedTextures++;
-
-		return true;
-	}
-
-	std::cout << "Could not load image:" << filename << std::endl;
-
-	// Error loading the image
-	return false;
+ *  This method is used for queueing a texture image to be
+ *  loaded into the texture array matching its size.  The
+ *  returned texture index is used to select the texture when
+ *  drawing, or -1 when the image could not be read.
+ ***********************************************************/
+int SceneManager::CreateGLTexture(const char* filename, std::string tag)
+{
+	return(m_textureManager.AddTexture(filename, tag));
 }
 
 /***********************************************************
  *  BindGLTextures()
  *
- *  This method is used for binding the loaded textures to
- *  OpenGL texture memory slots.  There are up to 16 slots.
+ *  This method is used for creating the texture arrays and
+ *  binding each one to its own texture unit.  The images are
+ *  decoded in the background and appear over the following
+ *  frames, the arrays stay bound and draws only select an
+ *  array and layer.
  ***********************************************************/
 void SceneManager::BindGLTextures()
 {
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
-	}
+	m_textureManager.Build();
+	m_textureManager.Bind();
 }
 
 /***********************************************************
  *  DestroyGLTextures()
  *
  *  This method is used for freeing the memory in all the
- *  used texture memory slots.
+ *  used texture arrays.
  ***********************************************************/
 void SceneManager::DestroyGLTextures()
 {
-	GLuint* textureIDs = new GLuint[m_loadedTextures];
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		glGenTextures(1, &m_textureIDs[i].ID);
-	}
-
-	glDeleteTextures(m_loadedTextures, textureIDs);
-
-	delete[] textureIDs;
+	m_textureManager.Destroy();
 }
 
 /***********************************************************
- *  FindTextureID()
+ *  FindTextureSlot()
  *
- *  This method is used for getting an ID for the previously
- *  loaded texture bitmap associated with the passed in tag.
+ *  This method is used for getting the texture index for the
+ *  previously loaded texture associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
+int SceneManager::FindTextureSlot(std::string tag)
 {
-	int textureID = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
-	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureID = m_textureIDs[index].ID;
-			bFound = true;
-		}
-		else
-			index++;
-	}
-
-	return(textureID);
+	return(m_textureManager.FindTexture(tag));
 }
 
 /***********************************************************
- *  FindTextureSlot()
+ *  AddMaterial()
  *
- *  This method is used for getting a slot index for the previously
- *  loaded texture bitmap associated with the passed in tag.
+ *  This method is used for adding a material to the material
+ *  table.  The returned handle is the material's index in the
+ *  table and never changes, so draws can refer to materials
+ *  by a single integer.
  ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
+int SceneManager::AddMaterial(const OBJECT_MATERIAL& material)
 {
-	int textureSlot = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
+	if ((int)m_objectMaterials.size() >= MAX_MATERIALS)
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureSlot = index;
-			bFound = true;
-		}
-		else
-			index++;
+		std::cout << "Material table is full, could not add material:" << material.tag << std::endl;
+		return(-1);
 	}
 
-	return(textureSlot);
+	m_objectMaterials.push_back(material);
+
+	return((int)m_objectMaterials.size() - 1);
 }
 
+/***********************************************************
+ *  DefineMaterials()
+ *
+ *  This method is used for adding the scene materials to the
+ *  material table.
+ ***********************************************************/
 void SceneManager::DefineMaterials()
 {
 	//grass
@@ -227,7 +233,7 @@ void SceneManager::DefineMaterials()
 	grassMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
 	grassMaterial.shininess = 2.0f;
 	grassMaterial.tag = "grass";
-	m_objectMaterials.push_back(grassMaterial);
+	AddMaterial(grassMaterial);
 
 	//wood
 	OBJECT_MATERIAL woodMaterial;
@@ -237,7 +243,7 @@ void SceneManager::DefineMaterials()
 	woodMaterial.specularColor = glm::vec3(0.3f, 0.3f, 0.3f);
 	woodMaterial.shininess = 16.0f;
 	woodMaterial.tag = "wood";
-	m_objectMaterials.push_back(woodMaterial);
+	AddMaterial(woodMaterial);
 
 	//stone
 	OBJECT_MATERIAL stoneMaterial;
@@ -247,7 +253,7 @@ void SceneManager::DefineMaterials()
 	stoneMaterial.specularColor = glm::vec3(0.2f, 0.2f, 0.2f);
 	stoneMaterial.shininess = 8.0f;
 	stoneMaterial.tag = "stone";
-	m_objectMaterials.push_back(stoneMaterial);
+	AddMaterial(stoneMaterial);
 
 	//concrete
 	OBJECT_MATERIAL concreteMaterial;
@@ -257,7 +263,7 @@ void SceneManager::DefineMaterials()
 	concreteMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
 	concreteMaterial.shininess = 4.0f;
 	concreteMaterial.tag = "concrete";
-	m_objectMaterials.push_back(concreteMaterial);
+	AddMaterial(concreteMaterial);
 
 	//santas runway
 	OBJECT_MATERIAL roofMaterial;
@@ -267,7 +273,7 @@ void SceneManager::DefineMaterials()
 	roofMaterial.specularColor = glm::vec3(0.2f, 0.2f, 0.2f);
 	roofMaterial.shininess = 8.0f;
 	roofMaterial.tag = "roof";
-	m_objectMaterials.push_back(roofMaterial);
+	AddMaterial(roofMaterial);
 
 	//windows
 	OBJECT_MATERIAL windowMaterial;
@@ -277,7 +283,7 @@ void SceneManager::DefineMaterials()
 	windowMaterial.specularColor = glm::vec3(0.8f, 0.8f, 0.9f);
 	windowMaterial.shininess = 128.0f;
 	windowMaterial.tag = "window";
-	m_objectMaterials.push_back(windowMaterial);
+	AddMaterial(windowMaterial);
 
 	//door
 	OBJECT_MATERIAL doorMaterial;
@@ -287,7 +293,7 @@ void SceneManager::DefineMaterials()
 	doorMaterial.specularColor = glm::vec3(0.3f, 0.3f, 0.3f);
 	doorMaterial.shininess = 32.0f;
 	doorMaterial.tag = "door";
-	m_objectMaterials.push_back(doorMaterial);
+	AddMaterial(doorMaterial);
 }
 
 /***********************************************************
@@ -325,285 +331,1387 @@ bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
 	return(bFound);
 }
 
-//scenelights()
-void SceneManager::SetupSceneLights()
+/***********************************************************
+ *  FindMaterialIndex()
+ *
+ *  This method is used for getting the index of a previously
+ *  defined material by tag, or -1 if it is not defined.
+ ***********************************************************/
+int SceneManager::FindMaterialIndex(std::string tag)
 {
-	m_numLights = 0;
+	for (int index = 0; index < (int)m_objectMaterials.size(); index++)
+	{
+		if (m_objectMaterials[index].tag.compare(tag) == 0)
+		{
+			return(index);
+		}
+	}
 
-	//light 0, trying to replicate sun
-	m_lights[0].type = 0;
-	m_lights[0].direction = glm::normalize(glm::vec3(-0.7f, -0.5f, -0.5f));
-	m_lights[0].ambientColor = glm::vec3(0.2f, 0.2f, 0.25f);  
-	m_lights[0].diffuseColor = glm::vec3(0.9f, 0.85f, 0.7f); 
-	m_lights[0].specularColor = glm::vec3(1.0f, 0.95f, 0.8f);
-	m_lights[0].enabled = true;
-	m_numLights++;
+	return(-1);
+}
 
-	//light 1, porch light
-	m_lights[1].type = 1;  
-	m_lights[1].position = glm::vec3(-0.5f, 3.5f, 3.5f);
-	m_lights[1].ambientColor = glm::vec3(0.1f, 0.1f, 0.08f);
-	m_lights[1].diffuseColor = glm::vec3(0.8f, 0.75f, 0.5f); 
-	m_lights[1].specularColor = glm::vec3(0.9f, 0.85f, 0.7f);
-	m_lights[1].constant = 1.0f;
-	m_lights[1].linear = 0.09f;
-	m_lights[1].quadratic = 0.032f;
-	m_lights[1].enabled = true;
-	m_numLights++;
+/***********************************************************
+ *  CreateMaterialBuffer()
+ *
+ *  This method is used for creating the uniform buffer that
+ *  holds the material table and attaching it to its binding
+ *  point.  The buffer is sized for MAX_MATERIALS so adding
+ *  materials never reallocates it.
+ ***********************************************************/
+void SceneManager::CreateMaterialBuffer()
+{
+	static_assert(sizeof(GPU_MATERIAL) == 48, "GPU_MATERIAL must match the std140 Material layout");
 
-	//garage light
-	m_lights[2].type = 1;
-	m_lights[2].position = glm::vec3(-4.0f, 3.0f, 4.5f);
-	m_lights[2].ambientColor = glm::vec3(0.08f, 0.08f, 0.1f);
-	m_lights[2].diffuseColor = glm::vec3(0.7f, 0.7f, 0.8f); 
-	m_lights[2].specularColor = glm::vec3(0.8f, 0.8f, 0.9f);
-	m_lights[2].constant = 1.0f;
-	m_lights[2].linear = 0.07f;
-	m_lights[2].quadratic = 0.017f;
-	m_lights[2].enabled = true;
-	m_numLights++;
+	if (m_materialBuffer == 0)
+	{
+		glGenBuffers(1, &m_materialBuffer);
+		g_GLState.BindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(GPU_MATERIAL) * MAX_MATERIALS, NULL, GL_STATIC_DRAW);
+		g_GLState.BindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	g_GLState.BindBufferBase(GL_UNIFORM_BUFFER, BLOCK_BINDING_MATERIALS, m_materialBuffer);
 
-	//light 3, filler light
-	m_lights[3].type = 1;
-	m_lights[3].position = glm::vec3(8.0f, 10.0f, 5.0f);
-	m_lights[3].ambientColor = glm::vec3(0.15f, 0.15f, 0.2f);
-	m_lights[3].diffuseColor = glm::vec3(0.4f, 0.4f, 0.5f);
-	m_lights[3].specularColor = glm::vec3(0.2f, 0.2f, 0.3f);
-	m_lights[3].constant = 1.0f;
-	m_lights[3].linear = 0.014f;
-	m_lights[3].quadratic = 0.0007f;
-	m_lights[3].enabled = true;
-	m_numLights++;
+	m_firstDirtyMaterial = 0;
+	UploadMaterials();
 }
 
-//light uniforms
-void SceneManager::SetLightingUniforms()
+/***********************************************************
+ *  UploadMaterials()
+ *
+ *  This method is used for packing and uploading the materials
+ *  added since the last upload.  Nothing is sent when the
+ *  table has not grown.
+ ***********************************************************/
+void SceneManager::UploadMaterials()
 {
-	if (m_pShaderManager == nullptr) return;
-
-
-	//pass num of active lights to shader
-	m_pShaderManager->setIntValue("numLights", m_numLights);
+	int count = (int)m_objectMaterials.size();
+	if ((m_materialBuffer == 0) || (m_firstDirtyMaterial >= count))
+	{
+		return;
+	}
 
-	for (int i = 0; i < m_numLights && i < MAX_LIGHTS; i++)
+	std::vector<GPU_MATERIAL> packed(count - m_firstDirtyMaterial);
+	for (int i = m_firstDirtyMaterial; i < count; i++)
 	{
-		std::string lightBase = "lights[" + std::to_string(i) + "].";
+		const OBJECT_MATERIAL& material = m_objectMaterials[i];
+		GPU_MATERIAL& gpuMaterial = packed[i - m_firstDirtyMaterial];
+		gpuMaterial = GPU_MATERIAL();
+		gpuMaterial.ambientColor = material.ambientColor;
+		gpuMaterial.ambientStrength = material.ambientStrength;
+		gpuMaterial.diffuseColor = material.diffuseColor;
+		gpuMaterial.shininess = material.shininess;
+		gpuMaterial.specularColor = material.specularColor;
+	}
 
-		//set light type 0,1,2 so on
-		m_pShaderManager->setIntValue(lightBase + "type", m_lights[i].type);
+	g_GLState.BindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER,
+		sizeof(GPU_MATERIAL) * m_firstDirtyMaterial,
+		sizeof(GPU_MATERIAL) * packed.size(),
+		&packed[0]);
 
-		m_pShaderManager->setVec3Value(lightBase + "ambientColor", m_lights[i].ambientColor);
-		m_pShaderManager->setVec3Value(lightBase + "diffuseColor", m_lights[i].diffuseColor);
-		m_pShaderManager->setVec3Value(lightBase + "specularColor", m_lights[i].specularColor);
-		m_pShaderManager->setBoolValue(lightBase + "enabled", m_lights[i].enabled);
+	m_firstDirtyMaterial = count;
+}
 
-		if (m_lights[i].type >= 1) 
+/***********************************************************
+ *  LoadSceneFile()
+ *
+ *  This method is used for loading a scene description into
+ *  the draw list.  The binary form of the scene is used when
+ *  it was written from the current text form, otherwise the
+ *  text form is parsed and the binary form is written for
+ *  the next run.  Materials must be defined before the
+ *  scene is loaded.
+ ***********************************************************/
+bool SceneManager::LoadSceneFile(const char* filename)
+{
+	SceneFile scene;
+	std::string binaryFilename = std::string(filename) + ".bin";
+	if (!scene.LoadBinary(binaryFilename.c_str(), filename))
+	{
+		if (!scene.LoadText(filename))
 		{
-			m_pShaderManager->setVec3Value(lightBase + "position", m_lights[i].position);
-			m_pShaderManager->setFloatValue(lightBase + "constant", m_lights[i].constant);
-			m_pShaderManager->setFloatValue(lightBase + "linear", m_lights[i].linear);
-			m_pShaderManager->setFloatValue(lightBase + "quadratic", m_lights[i].quadratic);
+			return(false);
 		}
+		scene.SaveBinary(binaryFilename.c_str(), filename);
+	}
 
-		if (m_lights[i].type == 0 || m_lights[i].type == 2)  // Directional or spotlight
-		{
-			m_pShaderManager->setVec3Value(lightBase + "direction", m_lights[i].direction);
-		}
+	// load the scene textures and map file texture indexes to
+	// texture manager indexes
+	std::vector<int16_t> textureSlots(scene.m_textures.size(), -1);
+	for (size_t i = 0; i < scene.m_textures.size(); i++)
+	{
+		textureSlots[i] = (int16_t)CreateGLTexture(scene.m_textures[i].filename.c_str(), scene.m_textures[i].tag);
+	}
+	BindGLTextures();
 
-		
-		if (m_lights[i].type == 2) 
+	// map file material indexes to defined materials
+	std::vector<int16_t> materialIndices(scene.m_materialTags.size(), -1);
+	for (size_t i = 0; i < scene.m_materialTags.size(); i++)
+	{
+		materialIndices[i] = (int16_t)FindMaterialIndex(scene.m_materialTags[i]);
+		if (materialIndices[i] < 0)
 		{
-			m_pShaderManager->setFloatValue(lightBase + "cutOff", m_lights[i].cutOff);
-			m_pShaderManager->setFloatValue(lightBase + "outerCutOff", m_lights[i].outerCutOff);
+			std::cout << "Scene uses undefined material:" << scene.m_materialTags[i] << std::endl;
 		}
 	}
-}
 
-//gotta enable lighting i suppose
-void SceneManager::EnableLighting()
-{
-	if (m_pShaderManager)
+	// build the transform hierarchy, file nodes map one to one
+	const SCENE_NODE_LIST& nodes = scene.m_nodes;
+	m_transforms.Clear();
+	m_transforms.Reserve(nodes.Count());
+	m_nodeNames = nodes.names;
+	for (size_t i = 0; i < nodes.Count(); i++)
 	{
-		m_pShaderManager->setBoolValue(g_UseLightingName, true);
-		SetLightingUniforms();
+		m_transforms.AddNode(nodes.parents[i], nodes.scales[i], nodes.rotations[i], nodes.positions[i]);
 	}
-}
+	m_bakedNode = m_bStaticBaking ? m_transforms.AddNode(-1, glm::vec3(1.0f), glm::vec3(0.0f), glm::vec3(0.0f)) : -1;
+	m_transforms.Update();
 
-//need to turn off lights unless you want an $800 electric bill like mine
-void SceneManager::DisableLighting()
-{
-	if (m_pShaderManager)
+	m_sceneObjects = scene.m_objects;
+	for (size_t i = 0; i < m_sceneObjects.Count(); i++)
+	{
+		int16_t& materialID = m_sceneObjects.materialIDs[i];
+		int16_t& textureID = m_sceneObjects.textureIDs[i];
+		materialID = (materialID >= 0) ? materialIndices[materialID] : -1;
+		textureID = (textureID >= 0) ? textureSlots[textureID] : -1;
+	}
+
+	m_staticGeometry.Clear();
+	if (m_bStaticBaking)
 	{
-		m_pShaderManager->setBoolValue(g_UseLightingName, false);
+		BakeStaticObjects(filename);
 	}
+	RebuildDrawList();
+
+	return(true);
 }
 
 /***********************************************************
- *  SetTransformations()
+ *  BakeStaticObjects()
  *
- *  This method is used for setting the transform buffer
- *  using the passed in transformation values.
+ *  This method is used for merging the loaded scene objects
+ *  into pre-transformed meshes.  The baked file next to the
+ *  scene is used when it is up to date, otherwise the objects
+ *  are baked and the file is written for the next run.
  ***********************************************************/
-void SceneManager::SetTransformations(
-	glm::vec3 scaleXYZ,
-	float XrotationDegrees,
-	float YrotationDegrees,
-	float ZrotationDegrees,
-	glm::vec3 positionXYZ)
+void SceneManager::BakeStaticObjects(const char* filename)
 {
-	// variables for this method
-	glm::mat4 modelView;
-	glm::mat4 scale;
-	glm::mat4 rotationX;
-	glm::mat4 rotationY;
-	glm::mat4 rotationZ;
-	glm::mat4 translation;
-
-	// set the scale value in the transform buffer
-	scale = glm::scale(scaleXYZ);
-	// set the rotation values in the transform buffer
-	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-	// set the translation value in the transform buffer
-	translation = glm::translate(positionXYZ);
-
-	modelView = translation * rotationX * rotationY * rotationZ * scale;
+	std::string bakedFilename = std::string(filename) + ".baked";
+	bool bBaked = false;
 
-	if (NULL != m_pShaderManager)
+	if (m_bStaticBakingCache && IsBinarySceneCurrent(bakedFilename, filename))
+	{
+		bBaked = m_staticGeometry.LoadCache(bakedFilename.c_str(), m_sceneObjects, m_meshes);
+	}
+	if (!bBaked)
 	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
+		bBaked = m_staticGeometry.Bake(m_sceneObjects, m_transforms, m_meshes);
+		if (bBaked && m_bStaticBakingCache)
+		{
+			m_staticGeometry.SaveCache(bakedFilename.c_str(), m_meshes);
+		}
 	}
+
+	std::cout << "Baked " << m_staticGeometry.GetBakedObjectCount() << " of "
+		<< m_sceneObjects.Count() << " static objects into "
+		<< m_staticGeometry.GetBakedGroupCount() << " meshes" << std::endl;
 }
 
 /***********************************************************
- *  SetShaderColor()
+ *  RebuildDrawList()
  *
- *  This method is used for setting the passed in color
- *  into the shader for the next draw command
+ *  This method is used for building the draw list from the
+ *  scene objects and the baked groups, along with the world
+ *  bounds and the culling tree over the new list.
  ***********************************************************/
-void SceneManager::SetShaderColor(
-	float redColorValue,
-	float greenColorValue,
-	float blueColorValue,
-	float alphaValue)
+void SceneManager::RebuildDrawList()
 {
-	// variables for this method
-	glm::vec4 currentColor;
+	m_staticGeometry.BuildDrawList(m_sceneObjects, m_bakedNode, m_drawList);
+	m_objectLods.assign(m_drawList.Count(), 0);
+
+	// build the culling tree over the new objects
+	UpdateObjectBounds();
+	m_bvh.Build(m_objectBounds);
+
+	// the instance buffer is rebuilt from the new draw list
+	MarkFramePacketsStale();
+	m_bGpuObjectsDirty = true;
+	m_framePackets[0].visibleObjects.reserve(m_drawList.Count());
+	m_framePackets[1].visibleObjects.reserve(m_drawList.Count());
+	m_renderQueue.Reserve(m_drawList.Count());
+}
 
-	currentColor.r = redColorValue;
-	currentColor.g = greenColorValue;
-	currentColor.b = blueColorValue;
-	currentColor.a = alphaValue;
+/***********************************************************
+ *  MarkFramePacketsStale()
+ ***********************************************************/
+void SceneManager::MarkFramePacketsStale()
+{
+	m_framePackets[0].bStale = true;
+	m_framePackets[1].bStale = true;
+}
 
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
-	}
+/***********************************************************
+ *  SetStaticBaking()
+ *
+ *  This method is used for choosing whether the static scene
+ *  objects are merged into pre-transformed meshes when the
+ *  scene is loaded, and whether the baked meshes are kept in
+ *  a file next to the scene.
+ ***********************************************************/
+void SceneManager::SetStaticBaking(bool bEnable, bool bUseCache)
+{
+	m_bStaticBaking = bEnable;
+	m_bStaticBakingCache = bUseCache;
 }
 
 /***********************************************************
- *  SetShaderTexture()
+ *  SetCylinderTessellation()
  *
- *  This method is used for setting the texture data
- *  associated with the passed in ID into the shader.
+ *  This method is used for choosing the slices around the
+ *  full detail cylinder, the coarser levels are derived from
+ *  it when the meshes are loaded.
  ***********************************************************/
-void SceneManager::SetShaderTexture(
-	std::string textureTag)
+void SceneManager::SetCylinderTessellation(int slices)
 {
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
+	m_meshes.SetCylinderTessellation(slices);
+}
 
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
-	}
+/***********************************************************
+ *  SetLevelOfDetail()
+ *
+ *  This method is used for switching the level of detail
+ *  selection on or off.  Every object starts again at full
+ *  detail and the batches are rebuilt on the next frame.
+ ***********************************************************/
+void SceneManager::SetLevelOfDetail(bool bEnable)
+{
+	m_bLevelOfDetail = bEnable;
+	m_objectLods.assign(m_drawList.Count(), 0);
+	MarkFramePacketsStale();
+	m_bGpuObjectsDirty = true;
 }
 
 /***********************************************************
- *  SetTextureUVScale()
+ *  SetPipelinedFrames()
  *
- *  This method is used for setting the texture UV scale
- *  values into the shader.
+ *  This method is used for choosing whether the next frame
+ *  is prepared while this one is drawn.  Switching it off
+ *  drops the frame prepared ahead, the next frame prepares
+ *  and draws the same packet.
  ***********************************************************/
-void SceneManager::SetTextureUVScale(float u, float v)
+void SceneManager::SetPipelinedFrames(bool bEnable)
 {
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
-	}
+	m_bPipelinedFrames = bEnable;
+	m_bPacketPending = false;
 }
 
 /***********************************************************
- *  SetShaderMaterial()
+ *  UnbakeObject()
  *
- *  This method is used for passing the material values
- *  into the shader.
+ *  This method is used for drawing a baked scene object on
+ *  its own again, so its transform can change.  The rest of
+ *  its group stays merged.  False when it was not baked.
  ***********************************************************/
-void SceneManager::SetShaderMaterial(
-	std::string materialTag)
+bool SceneManager::UnbakeObject(int object)
 {
-	if (m_objectMaterials.size() > 0)
+	if (!m_staticGeometry.Unbake(object, m_sceneObjects, m_transforms, m_meshes))
 	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
+		return false;
+	}
+
+	RebuildDrawList();
+	return true;
+}
 
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
+/***********************************************************
+ *  FindNode()
+ ***********************************************************/
+int SceneManager::FindNode(const std::string& name) const
+{
+	if (name.empty())
+	{
+		return(-1);
+	}
+	for (size_t i = 0; i < m_nodeNames.size(); i++)
+	{
+		if (m_nodeNames[i] == name)
 		{
-			m_pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
-			m_pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
+			return((int)i);
 		}
 	}
+	return(-1);
 }
 
-/**************************************************************/
-/*** STUDENTS CAN MODIFY the code in the methods BELOW for  ***/
-/*** preparing and rendering their own 3D replicated scenes.***/
-/*** Please refer to the code in the OpenGL sample project  ***/
-/*** for assistance.                                        ***/
-/**************************************************************/
-
-
 /***********************************************************
- *  PrepareScene()
+ *  SetNodeTransform()
  *
- *  This method is used for preparing the 3D scene by loading
- *  the shapes, textures in memory to support the 3D scene 
- *  rendering
+ *  This method is used for moving a scene node.  Only the
+ *  node and its descendants get new world matrices, the
+ *  bounds and the culling tree follow on the next frame.
+ *  Baked objects on those nodes are un-baked first, while
+ *  the world matrices their group was merged with are still
+ *  current.  The frame preparation job reads the transforms,
+ *  so this must not run while RenderScene() does.  False
+ *  when the node is not a scene file node.
  ***********************************************************/
-void SceneManager::PrepareScene()
+bool SceneManager::SetNodeTransform(
+	int node,
+	glm::vec3 scaleXYZ,
+	glm::vec3 rotationDegreesXYZ,
+	glm::vec3 positionXYZ)
+{
+	if ((node < 0) || (node >= (int)m_nodeNames.size()))
+	{
+		return(false);
+	}
+
+	bool bUnbaked = false;
+	for (int i = 0; i < (int)m_sceneObjects.Count(); i++)
+	{
+		if (!m_staticGeometry.IsBaked(i))
+		{
+			continue;
+		}
+
+		int ancestor = m_sceneObjects.nodeIDs[i];
+		while ((ancestor >= 0) && (ancestor != node))
+		{
+			ancestor = m_transforms.GetParent(ancestor);
+		}
+		if (ancestor == node)
+		{
+			bUnbaked |= m_staticGeometry.Unbake(i, m_sceneObjects, m_transforms, m_meshes);
+		}
+	}
+	if (bUnbaked)
+	{
+		RebuildDrawList();
+	}
+
+	m_transforms.SetLocalTransform(node, scaleXYZ, rotationDegreesXYZ, positionXYZ);
+	return(true);
+}
+
+/***********************************************************
+ *  SetViewParameters()
+ *
+ *  This method is used for passing in the camera of the next
+ *  frame, it is used to cull, sort and select the draws of
+ *  the packet prepared next.
+ ***********************************************************/
+void SceneManager::SetViewParameters(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	const glm::vec3& viewPosition)
+{
+	FRAME_PACKET& packet = m_framePackets[m_preparePacket];
+	packet.viewMatrix = view;
+	packet.projectionMatrix = projection;
+	packet.viewPosition = viewPosition;
+}
+
+/***********************************************************
+ *  UpdateObjectBounds()
+ *
+ *  This method is used for transforming the local bounds of
+ *  every object's mesh into a world space box.
+ ***********************************************************/
+void SceneManager::UpdateObjectBounds()
+{
+	const SCENE_DRAW_LIST& drawList = m_drawList;
+	const size_t objectCount = drawList.Count();
+
+	m_objectBounds.resize(objectCount);
+	g_JobSystem.ParallelFor(objectCount, OBJECTS_PER_JOB, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			m_objectBounds[i] = TransformAABB(
+				m_meshes.GetLocalBounds(drawList.meshIDs[i]),
+				m_transforms.GetWorldMatrix(drawList.nodeIDs[i]));
+		}
+	});
+}
+
+/***********************************************************
+ *  CullSceneObjects()
+ *
+ *  This method is used for collecting the objects whose
+ *  bounds are at least partly inside the view frustum of the
+ *  packet's camera.
+ ***********************************************************/
+void SceneManager::CullSceneObjects(FRAME_PACKET& packet)
+{
+	packet.visibleObjects.clear();
+	m_bvh.Cull(ExtractFrustum(packet.projectionMatrix * packet.viewMatrix), packet.visibleObjects);
+}
+
+/***********************************************************
+ *  SelectObjectLods()
+ *
+ *  This method is used for picking the level of detail of
+ *  each object from the projected size of its bounding
+ *  sphere, as a fraction of the viewport height.  The camera
+ *  zoom is part of the projection, so zooming in raises the
+ *  detail like moving closer does.  An object only moves to
+ *  a coarser level once it is a hysteresis band below the
+ *  level's screen size, and back once it is a band above.
+ *  Every object is written by one job only, so the objects
+ *  are split between jobs.
+ ***********************************************************/
+bool SceneManager::SelectObjectLods(const FRAME_PACKET& packet, bool bAllObjects)
+{
+	if (!m_bLevelOfDetail)
+	{
+		return false;
+	}
+
+	const SCENE_DRAW_LIST& drawList = m_drawList;
+	const size_t count = bAllObjects ? drawList.Count() : packet.visibleObjects.size();
+	// a perspective projection divides the projected radius by
+	// the distance, an orthographic one does not
+	const float projectionScale = packet.projectionMatrix[1][1];
+	const bool bPerspective = (packet.projectionMatrix[3][3] == 0.0f);
+
+	std::atomic<bool> bChanged(false);
+	g_JobSystem.ParallelFor(count, OBJECTS_PER_JOB, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const int i = bAllObjects ? (int)v : packet.visibleObjects[v];
+			const int meshID = drawList.meshIDs[i];
+			const int lodCount = m_meshes.GetLodCount(meshID);
+			if (lodCount < 2)
+			{
+				continue;
+			}
+
+			const AABB& bounds = m_objectBounds[i];
+			const float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+			float screenSize = radius * projectionScale;
+			if (bPerspective)
+			{
+				float distance = glm::length((bounds.min + bounds.max) * 0.5f - packet.viewPosition);
+				screenSize = (distance > radius) ? screenSize / distance : FLT_MAX;
+			}
+
+			int level = m_objectLods[i];
+			while ((level + 1 < lodCount) &&
+				(screenSize < m_meshes.GetLodScreenSize(meshID, level) * (1.0f - LOD_HYSTERESIS)))
+			{
+				level++;
+			}
+			while ((level > 0) &&
+				(screenSize > m_meshes.GetLodScreenSize(meshID, level - 1) * (1.0f + LOD_HYSTERESIS)))
+			{
+				level--;
+			}
+
+			if (level != m_objectLods[i])
+			{
+				m_objectLods[i] = (uint8_t)level;
+				bChanged = true;
+			}
+		}
+	});
+	return bChanged;
+}
+
+/***********************************************************
+ *  QueueSceneObjects()
+ *
+ *  This method is used for adding a draw packet for every
+ *  visible object to the render queue.  The sort key
+ *  holds the object's pipeline, texture array, mesh, material
+ *  and camera distance.  Objects with a see-through color go
+ *  in the transparent pipeline so they are drawn last.
+ *  Without depth sorting the order only changes with the
+ *  objects themselves, not with the camera.  The queue is
+ *  sized up front so the jobs fill their own packets.
+ ***********************************************************/
+void SceneManager::QueueSceneObjects(const FRAME_PACKET& packet, bool bSortByDepth)
+{
+	const SCENE_DRAW_LIST& drawList = m_drawList;
+	const size_t visibleCount = packet.visibleObjects.size();
+
+	m_renderQueue.Clear();
+	m_renderQueue.Resize(visibleCount);
+	g_JobSystem.ParallelFor(visibleCount, OBJECTS_PER_JOB, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const int i = packet.visibleObjects[v];
+			const glm::mat4& world = m_transforms.GetWorldMatrix(drawList.nodeIDs[i]);
+			float distance = bSortByDepth ? glm::length(glm::vec3(world[3]) - packet.viewPosition) : 0.0f;
+
+			int textureID = drawList.textureIDs[i];
+			int arraySlot = (textureID >= 0) ? m_textureManager.GetArraySlot(textureID) : -1;
+			int pipeline = ((textureID < 0) && (drawList.colors[i].a < 1.0f)) ? PIPELINE_TRANSPARENT : PIPELINE_OPAQUE;
+
+			uint64_t key = RenderQueue::MakeKey(
+				pipeline,
+				arraySlot + 1,
+				GetObjectMesh(i),
+				drawList.materialIDs[i],
+				distance / SORT_DEPTH_RANGE);
+			m_renderQueue.Set(v, key, (uint32_t)i);
+		}
+	});
+}
+
+/***********************************************************
+ *  BuildInstanceBatches()
+ *
+ *  This method is used for turning the sorted render queue
+ *  into instance batches.  Neighbouring packets with the same
+ *  pipeline, texture array and mesh become one batch that is
+ *  drawn with a single instanced call.  When the sorted order
+ *  matches the one the packet was last built for and it is
+ *  not stale, its instances are still right and nothing is
+ *  rebuilt.  The batches are found in one pass, the instances
+ *  are then filled by jobs.
+ ***********************************************************/
+void SceneManager::BuildInstanceBatches(FRAME_PACKET& packet)
+{
+	const SCENE_DRAW_LIST& drawList = m_drawList;
+	const size_t count = m_renderQueue.Count();
+
+	bool bChanged = packet.bStale || (count != packet.instanceObjects.size());
+	for (size_t i = 0; (i < count) && !bChanged; i++)
+	{
+		bChanged = ((int)m_renderQueue.GetPacket(i).command != packet.instanceObjects[i]);
+	}
+	if (!bChanged)
+	{
+		return;
+	}
+
+	packet.instances.resize(count);
+	packet.instanceObjects.resize(count);
+	packet.instanceBatches.clear();
+	packet.bStale = false;
+
+	uint64_t batchState = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		const DRAW_PACKET& drawPacket = m_renderQueue.GetPacket(i);
+		const int object = (int)drawPacket.command;
+		packet.instanceObjects[i] = object;
+
+		if (packet.instanceBatches.empty() || (RenderQueue::BatchState(drawPacket.key) != batchState))
+		{
+			INSTANCE_BATCH batch;
+			batch.pipeline = RenderQueue::GetPipeline(drawPacket.key);
+			batch.meshID = GetObjectMesh(object);
+			batch.textureID = drawList.textureIDs[object];
+			batch.firstInstance = (int)i;
+			batch.instanceCount = 0;
+			packet.instanceBatches.push_back(batch);
+			batchState = RenderQueue::BatchState(drawPacket.key);
+		}
+		packet.instanceBatches.back().instanceCount++;
+	}
+
+	g_JobSystem.ParallelFor(count, OBJECTS_PER_JOB, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const int object = packet.instanceObjects[i];
+			const int textureID = drawList.textureIDs[object];
+
+			// the mesh's dequantization is folded into the instance
+			const MESH_DEQUANTIZATION& dequantization = m_meshes.GetDequantization(GetObjectMesh(object));
+			MESH_INSTANCE& data = packet.instances[i];
+			data.model = m_transforms.GetWorldMatrix(drawList.nodeIDs[object]) * dequantization.position;
+			data.color = drawList.colors[object];
+			data.uvScale = drawList.uvScales[object] * dequantization.uvScale;
+			data.uvOffset = drawList.uvScales[object] * dequantization.uvOffset;
+			data.materialIndex = (drawList.materialIDs[object] >= 0) ? drawList.materialIDs[object] : 0;
+			data.textureLayer = (textureID >= 0) ? m_textureManager.GetLayer(textureID) : -1;
+		}
+	});
+
+	BuildDrawCommands(packet);
+}
+
+/***********************************************************
+ *  BuildGpuCullObjects()
+ *
+ *  This method is used for batching every object, whether it
+ *  is visible or not, and handing the batches to the compute
+ *  culling.  Without depth sorting the batches only change
+ *  with the objects, so this runs when they do, not when the
+ *  camera moves; see-through objects are drawn in object
+ *  order instead of back to front.  Large opaque objects are
+ *  also given a command of their own for the occluder depth.
+ ***********************************************************/
+void SceneManager::BuildGpuCullObjects(FRAME_PACKET& packet)
+{
+	const size_t objectCount = m_drawList.Count();
+	packet.visibleObjects.resize(objectCount);
+	for (size_t i = 0; i < objectCount; i++)
+	{
+		packet.visibleObjects[i] = (int)i;
+	}
+	QueueSceneObjects(packet, false);
+	m_renderQueue.Sort();
+	packet.queueStats = m_renderQueue.GetStats();
+	packet.bStale = true;
+	BuildInstanceBatches(packet);
+
+	std::vector<GPU_CULL_OBJECT> objects(packet.instances.size());
+	std::vector<DRAW_ELEMENTS_COMMAND> occluders;
+	for (size_t b = 0; b < packet.instanceBatches.size(); b++)
+	{
+		const INSTANCE_BATCH& batch = packet.instanceBatches[b];
+		// the instance models expect the packed positions
+		const AABB& bounds = m_meshes.GetPackedBounds(batch.meshID);
+		for (int i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++)
+		{
+			GPU_CULL_OBJECT& object = objects[i];
+			object.instance = packet.instances[i];
+			object.boundsMin = bounds.min;
+			object.batch = (uint32_t)b;
+			object.boundsMax = bounds.max;
+			object.padding = 0;
+
+			if (batch.pipeline != PIPELINE_OPAQUE)
+			{
+				continue;
+			}
+			// walls, floors and roofs hide things, posts and
+			// trim are too thin to be worth drawing twice
+			AABB worldBounds = TransformAABB(bounds, object.instance.model);
+			glm::vec3 size = worldBounds.max - worldBounds.min;
+			int largeAxes = ((size.x >= OCCLUDER_MIN_SIZE) ? 1 : 0) +
+				((size.y >= OCCLUDER_MIN_SIZE) ? 1 : 0) +
+				((size.z >= OCCLUDER_MIN_SIZE) ? 1 : 0);
+			DRAW_ELEMENTS_COMMAND command;
+			if ((largeAxes >= 2) && m_meshes.MakeDrawCommand(batch.meshID, i, 1, command))
+			{
+				occluders.push_back(command);
+			}
+		}
+	}
+	m_gpuCulling.SetObjects(objects, packet.drawCommands);
+	m_gpuCulling.SetOccluders(occluders);
+	m_bGpuObjectsDirty = false;
+}
+
+/***********************************************************
+ *  SetGpuCulling()
+ *
+ *  This method is used for switching between culling on the
+ *  CPU and in the compute shader.  The CPU path rebuilds its
+ *  batches and culling tree on its next frame.
+ ***********************************************************/
+bool SceneManager::SetGpuCulling(bool bEnable)
+{
+	if (bEnable && !m_gpuCulling.Initialize())
+	{
+		return(false);
+	}
+
+	if (!bEnable && m_bGpuCulling)
+	{
+		UpdateObjectBounds();
+		m_bvh.Refit(m_objectBounds);
+	}
+	m_bGpuCulling = bEnable;
+	m_bGpuObjectsDirty = true;
+	MarkFramePacketsStale();
+	m_bPacketPending = false;
+	if (!bEnable)
+	{
+		m_bOcclusionCulling = false;
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetOcclusionCulling()
+ *
+ *  This method is used for switching the Hi-Z occlusion test
+ *  of the compute culling on and off, switching it on turns
+ *  the compute culling on as well.
+ ***********************************************************/
+bool SceneManager::SetOcclusionCulling(bool bEnable)
+{
+	if (bEnable)
+	{
+		if (!SetGpuCulling(true) || !m_hiZ.Initialize())
+		{
+			return(false);
+		}
+	}
+	m_bOcclusionCulling = bEnable;
+	m_frameCullStats = CULL_STATS();
+
+	return(true);
+}
+
+/***********************************************************
+ *  BuildDrawCommands()
+ *
+ *  This method is used for turning every instance batch into
+ *  an indirect draw command and the parameters the shader
+ *  looks up by draw index.  The commands keep the batch
+ *  order, so the batches of one pipeline are a contiguous
+ *  range of commands.  Their base instances count from the
+ *  first instance of the frame.
+ ***********************************************************/
+void SceneManager::BuildDrawCommands(FRAME_PACKET& packet)
+{
+	packet.drawCommands.clear();
+	packet.drawParameters.clear();
+	packet.drawTriangles = 0;
+	for (size_t i = 0; i < packet.instanceBatches.size(); i++)
+	{
+		const INSTANCE_BATCH& batch = packet.instanceBatches[i];
+		DRAW_ELEMENTS_COMMAND command;
+		if (!m_meshes.MakeDrawCommand(batch.meshID, batch.firstInstance, batch.instanceCount, command))
+		{
+			// keep one command per batch, an empty one draws nothing
+			command.count = 0;
+			command.instanceCount = 0;
+			command.firstIndex = 0;
+			command.baseVertex = 0;
+			command.baseInstance = 0;
+		}
+		packet.drawCommands.push_back(command);
+		packet.drawTriangles += (size_t)(command.count / 3) * command.instanceCount;
+
+		DRAW_PARAMETERS parameters;
+		parameters.textureArray = (batch.textureID >= 0) ? m_textureManager.GetArraySlot(batch.textureID) : -1;
+		packet.drawParameters.push_back(parameters);
+	}
+}
+
+/***********************************************************
+ *  WriteFrameData()
+ *
+ *  This method is used for copying the draw parameters, and
+ *  on the CPU culling path the instances and commands, into
+ *  the next region of the ring.  The records are only copied,
+ *  the base instance of each command is moved to where the
+ *  frame's instances landed, and the shader finds the
+ *  parameters through the first draw uniform, so the ring
+ *  stays bound as it is.  The compute culling writes its own
+ *  instances and commands on the GPU.
+ ***********************************************************/
+bool SceneManager::WriteFrameData(const FRAME_PACKET& packet)
+{
+	const size_t drawCount = packet.drawCommands.size();
+	const size_t instanceCount = m_bGpuCulling ? 0 : packet.instances.size();
+	const size_t commandCount = m_bGpuCulling ? 0 : drawCount;
+
+	// the records plus the worst case padding of each block
+	m_frameData.BeginFrame(
+		(drawCount + 1) * sizeof(DRAW_PARAMETERS) +
+		(instanceCount + 1) * sizeof(MESH_INSTANCE) +
+		(commandCount + 1) * sizeof(DRAW_ELEMENTS_COMMAND));
+
+	size_t parameterOffset = 0;
+	size_t instanceOffset = 0;
+	void* pParameters = m_frameData.Allocate(drawCount * sizeof(DRAW_PARAMETERS), sizeof(DRAW_PARAMETERS), parameterOffset);
+	void* pInstances = m_frameData.Allocate(instanceCount * sizeof(MESH_INSTANCE), sizeof(MESH_INSTANCE), instanceOffset);
+	DRAW_ELEMENTS_COMMAND* pCommands = (DRAW_ELEMENTS_COMMAND*)m_frameData.Allocate(
+		commandCount * sizeof(DRAW_ELEMENTS_COMMAND), sizeof(GLuint), m_frameCommandOffset);
+	if ((NULL == pParameters) || (NULL == pInstances) || (NULL == pCommands))
+	{
+		return(false);
+	}
+
+	m_frameParameterBase = (GLuint)(parameterOffset / sizeof(DRAW_PARAMETERS));
+	m_frameInstanceBase = (GLuint)(instanceOffset / sizeof(MESH_INSTANCE));
+	if (drawCount > 0)
+	{
+		memcpy(pParameters, packet.drawParameters.data(), drawCount * sizeof(DRAW_PARAMETERS));
+	}
+	if (instanceCount > 0)
+	{
+		memcpy(pInstances, packet.instances.data(), instanceCount * sizeof(MESH_INSTANCE));
+	}
+	for (size_t i = 0; i < commandCount; i++)
+	{
+		pCommands[i] = packet.drawCommands[i];
+		pCommands[i].baseInstance += m_frameInstanceBase;
+	}
+
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_DRAW_PARAMETERS, m_frameData.GetBuffer());
+	return(true);
+}
+
+/***********************************************************
+ *  RecordRenderStats()
+ *
+ *  This method is used for keeping the statistics of the
+ *  frame about to be drawn.  They change with the camera, so
+ *  they are only formatted when asked for, never written to
+ *  the console from the render loop.
+ ***********************************************************/
+void SceneManager::RecordRenderStats(const FRAME_PACKET& packet)
+{
+	m_frameQueueStats = packet.queueStats;
+	m_frameDraws = packet.instanceBatches.size();
+	m_frameTriangles = packet.drawTriangles;
+	if (m_bGpuCulling)
+	{
+		m_frameCullStats = m_gpuCulling.GetCullStats();
+	}
+}
+
+/***********************************************************
+ *  GetRenderSummary()
+ *
+ *  This method is used for formatting the render queue state
+ *  change counts, draws and triangles of the last frame, and
+ *  how often the frame data ring waited for the GPU.  The
+ *  compute culling reports the objects it rejected instead,
+ *  its queue holds every object.
+ ***********************************************************/
+std::string SceneManager::GetRenderSummary() const
+{
+	std::ostringstream text;
+	if (m_bGpuCulling)
+	{
+		text << "gpu culling " << m_gpuCulling.GetObjectCount() << " objects, "
+			<< m_frameCullStats.frustumCulled << " outside the view, "
+			<< m_frameCullStats.occlusionCulled << " occluded by "
+			<< m_gpuCulling.GetOccluderCount() << " occluders";
+	}
+	else
+	{
+		text << m_frameQueueStats.packets << " of " << m_drawList.Count() << " visible, "
+			<< m_frameQueueStats.unsortedStateChanges << " state changes unsorted "
+			<< m_frameQueueStats.sortedStateChanges << " sorted";
+	}
+	text << " | " << m_frameDraws << " draws, " << m_frameTriangles << " triangles, "
+		<< m_frameData.GetStallCount() << " ring stalls";
+	return(text.str());
+}
+
+/***********************************************************
+ *  ReportMeshStats()
+ *
+ *  This method is used for writing how much vertex memory the
+ *  packed vertices save, and how much vertex fetch one draw
+ *  of every mesh saves once the triangles are reordered for
+ *  the vertex cache.
+ ***********************************************************/
+void SceneManager::ReportMeshStats()
+{
+	const MESH_LIBRARY_STATS& stats = m_meshes.GetStats();
+	if (stats.triangleCount == 0)
+	{
+		return;
+	}
+
+	const size_t floatBytes = stats.vertexCount * sizeof(MESH_VERTEX);
+	const size_t packedBytes = stats.vertexCount * sizeof(PACKED_VERTEX);
+	const size_t fetchBefore = stats.cacheMissesBefore * sizeof(MESH_VERTEX);
+	const size_t fetchAfter = stats.cacheMissesAfter * sizeof(PACKED_VERTEX);
+
+	std::cout << "meshes: " << stats.vertexCount << " vertices at " << sizeof(PACKED_VERTEX)
+		<< " instead of " << sizeof(MESH_VERTEX) << " bytes, "
+		<< packedBytes << " bytes instead of " << floatBytes << ", "
+		<< (float)stats.cacheMissesBefore / (float)stats.triangleCount << " -> "
+		<< (float)stats.cacheMissesAfter / (float)stats.triangleCount << " vertices transformed per triangle, "
+		<< fetchAfter << " bytes fetched per draw of every mesh instead of " << fetchBefore << std::endl;
+}
+
+//scenelights()
+void SceneManager::SetupSceneLights()
+{
+	m_lights.assign(4, LIGHT_SOURCE());
+
+	//light 0, trying to replicate sun
+	m_lights[0].type = 0;
+	m_lights[0].direction = glm::normalize(glm::vec3(-0.7f, -0.5f, -0.5f));
+	m_lights[0].ambientColor = glm::vec3(0.2f, 0.2f, 0.25f);  
+	m_lights[0].diffuseColor = glm::vec3(0.9f, 0.85f, 0.7f); 
+	m_lights[0].specularColor = glm::vec3(1.0f, 0.95f, 0.8f);
+	m_lights[0].enabled = true;
+
+	//light 1, porch light
+	m_lights[1].type = 1;  
+	m_lights[1].position = glm::vec3(-0.5f, 3.5f, 3.5f);
+	m_lights[1].ambientColor = glm::vec3(0.1f, 0.1f, 0.08f);
+	m_lights[1].diffuseColor = glm::vec3(0.8f, 0.75f, 0.5f); 
+	m_lights[1].specularColor = glm::vec3(0.9f, 0.85f, 0.7f);
+	m_lights[1].constant = 1.0f;
+	m_lights[1].linear = 0.09f;
+	m_lights[1].quadratic = 0.032f;
+	m_lights[1].enabled = true;
+
+	//garage light
+	m_lights[2].type = 1;
+	m_lights[2].position = glm::vec3(-4.0f, 3.0f, 4.5f);
+	m_lights[2].ambientColor = glm::vec3(0.08f, 0.08f, 0.1f);
+	m_lights[2].diffuseColor = glm::vec3(0.7f, 0.7f, 0.8f); 
+	m_lights[2].specularColor = glm::vec3(0.8f, 0.8f, 0.9f);
+	m_lights[2].constant = 1.0f;
+	m_lights[2].linear = 0.07f;
+	m_lights[2].quadratic = 0.017f;
+	m_lights[2].enabled = true;
+
+	//light 3, filler light
+	m_lights[3].type = 1;
+	m_lights[3].position = glm::vec3(8.0f, 10.0f, 5.0f);
+	m_lights[3].ambientColor = glm::vec3(0.15f, 0.15f, 0.2f);
+	m_lights[3].diffuseColor = glm::vec3(0.4f, 0.4f, 0.5f);
+	m_lights[3].specularColor = glm::vec3(0.2f, 0.2f, 0.3f);
+	m_lights[3].constant = 1.0f;
+	m_lights[3].linear = 0.014f;
+	m_lights[3].quadratic = 0.0007f;
+	m_lights[3].enabled = true;
+
+	m_bLightsDirty = true;
+}
+
+/***********************************************************
+ *  AddLight()
+ *
+ *  This method is used for adding a light to the scene.
+ *  There is no fixed limit, local lights only cost the
+ *  fragments inside their attenuation radius.
+ ***********************************************************/
+int SceneManager::AddLight(const LIGHT_SOURCE& light)
+{
+	m_lights.push_back(light);
+	m_bLightsDirty = true;
+	return((int)m_lights.size() - 1);
+}
+
+/***********************************************************
+ *  SetLight()
+ *
+ *  This method is used for replacing one of the scene lights.
+ *  The lights are only marked for upload when the packed
+ *  values are different from the current ones.
+ ***********************************************************/
+void SceneManager::SetLight(int index, const LIGHT_SOURCE& light)
+{
+	if (index < 0)
+	{
+		return;
+	}
+	if (index >= (int)m_lights.size())
+	{
+		m_lights.resize(index + 1, LIGHT_SOURCE());
+		m_lights[index] = light;
+		m_bLightsDirty = true;
+		return;
+	}
+
+	GPU_LIGHT current;
+	GPU_LIGHT replacement;
+	PackLight(m_lights[index], current);
+	PackLight(light, replacement);
+
+	m_lights[index] = light;
+	if (memcmp(&current, &replacement, sizeof(GPU_LIGHT)) != 0)
+	{
+		m_bLightsDirty = true;
+	}
+}
+
+/***********************************************************
+ *  PackLight()
+ *
+ *  This method is used for converting a light source into
+ *  its storage buffer layout.  Point and spot lights get the
+ *  radius their attenuation reaches.
+ ***********************************************************/
+void SceneManager::PackLight(const LIGHT_SOURCE& light, GPU_LIGHT& gpuLight)
+{
+	gpuLight = GPU_LIGHT();
+	gpuLight.position = light.position;
+	gpuLight.type = light.type;
+	gpuLight.direction = light.direction;
+	gpuLight.enabled = light.enabled ? 1 : 0;
+	gpuLight.ambientColor = light.ambientColor;
+	gpuLight.cutOff = light.cutOff;
+	gpuLight.diffuseColor = light.diffuseColor;
+	gpuLight.outerCutOff = light.outerCutOff;
+	gpuLight.specularColor = light.specularColor;
+	gpuLight.constant = light.constant;
+	gpuLight.linear = light.linear;
+	gpuLight.quadratic = light.quadratic;
+	gpuLight.radius = 0.0f;
+
+	if (light.type != 0)
+	{
+		glm::vec3 brightest = glm::max(light.ambientColor, glm::max(light.diffuseColor, light.specularColor));
+		float radius = AttenuationRadius(light.constant, light.linear, light.quadratic,
+			std::max(brightest.x, std::max(brightest.y, brightest.z)));
+		gpuLight.radius = (radius < 0.0f) ? 0.0f : std::max(radius, FLT_MIN);
+	}
+}
+
+/***********************************************************
+ *  CreateLightBuffer()
+ *
+ *  This method is used for creating the storage buffer that
+ *  holds the packed lights and attaching it to its binding
+ *  point.
+ ***********************************************************/
+void SceneManager::CreateLightBuffer()
+{
+	static_assert(sizeof(GPU_LIGHT) == 96, "GPU_LIGHT must match the std430 LightSource layout");
+
+	if (m_lightBuffer == 0)
+	{
+		glGenBuffers(1, &m_lightBuffer);
+	}
+	g_GLState.BindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGE_BINDING_LIGHTS, m_lightBuffer);
+
+	m_bLightsDirty = true;
+}
+
+/***********************************************************
+ *  SetLightingUniforms()
+ *
+ *  This method is used for uploading the enabled lights into
+ *  the light buffer and assigning the local ones to the
+ *  clusters of the current view.  The lights are only packed
+ *  and sent again when one of them changed.
+ ***********************************************************/
+void SceneManager::SetLightingUniforms()
+{
+	ProfileScope profileScope("SetLightingUniforms");
+
+	if (m_lightBuffer == 0)
+	{
+		return;
+	}
+
+	const bool bLightsChanged = m_bLightsDirty;
+	if (m_bLightsDirty)
+	{
+		// lights reaching everywhere are shaded by every
+		// fragment, so they go first, the rest by cluster
+		std::vector<GPU_LIGHT> localLights;
+		m_packedLights.clear();
+		m_lightSpheres.clear();
+		for (size_t i = 0; i < m_lights.size(); i++)
+		{
+			if (m_lights[i].enabled == false)
+			{
+				continue;
+			}
+
+			GPU_LIGHT gpuLight;
+			PackLight(m_lights[i], gpuLight);
+			if (gpuLight.radius == 0.0f)
+			{
+				m_packedLights.push_back(gpuLight);
+			}
+			else
+			{
+				localLights.push_back(gpuLight);
+				m_lightSpheres.push_back(glm::vec4(gpuLight.position, gpuLight.radius));
+			}
+		}
+		m_globalLightCount = (int)m_packedLights.size();
+		m_packedLights.insert(m_packedLights.end(), localLights.begin(), localLights.end());
+
+		g_GLState.BindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightBuffer);
+		if ((m_lightCapacity < m_packedLights.size()) || (m_lightCapacity == 0))
+		{
+			m_lightCapacity = std::max(m_packedLights.size(), m_lightCapacity * 2);
+			m_lightCapacity = std::max(m_lightCapacity, (size_t)16);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPU_LIGHT) * m_lightCapacity, NULL, GL_DYNAMIC_DRAW);
+		}
+		if (!m_packedLights.empty())
+		{
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GPU_LIGHT) * m_packedLights.size(), m_packedLights.data());
+		}
+
+		m_uniforms.SetInt(UNIFORM_GLOBAL_LIGHT_COUNT, m_globalLightCount);
+		m_bLightsDirty = false;
+	}
+
+	AssignLightClusters(bLightsChanged);
+}
+
+/***********************************************************
+ *  AssignLightClusters()
+ *
+ *  This method is used for listing the local lights of every
+ *  cluster of the current view and passing the cluster grid
+ *  to the shader.
+ ***********************************************************/
+void SceneManager::AssignLightClusters(bool bLightsChanged)
+{
+	GLint viewport[4] = { 0, 0, 0, 0 };
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	m_lightClusters.Assign(
+		m_lightSpheres,
+		m_globalLightCount,
+		bLightsChanged,
+		m_viewMatrix,
+		m_projectionMatrix,
+		viewport[2],
+		viewport[3]);
+
+	m_uniforms.SetVec2(UNIFORM_CLUSTER_TILE_SCALE, m_lightClusters.GetTileScale());
+	m_uniforms.SetVec2(UNIFORM_CLUSTER_DEPTH_SCALE, m_lightClusters.GetDepthScaleBias());
+}
+
+//gotta enable lighting i suppose
+void SceneManager::EnableLighting()
+{
+	if (m_pShaderManager)
+	{
+		m_bLightingEnabled = true;
+		m_uniforms.SetInt(UNIFORM_USE_LIGHTING, true);
+		SetLightingUniforms();
+	}
+}
+
+//need to turn off lights unless you want an $800 electric bill like mine
+void SceneManager::DisableLighting()
+{
+	if (m_pShaderManager)
+	{
+		m_bLightingEnabled = false;
+		m_uniforms.SetInt(UNIFORM_USE_LIGHTING, false);
+	}
+}
+
+/***********************************************************
+ *  SetTransformations()
+ *
+ *  This method is used for setting the transform buffer
+ *  using the passed in transformation values.
+ ***********************************************************/
+void SceneManager::SetTransformations(
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	// variables for this method
+	glm::mat4 modelView;
+	glm::mat4 scale;
+	glm::mat4 rotationX;
+	glm::mat4 rotationY;
+	glm::mat4 rotationZ;
+	glm::mat4 translation;
+
+	// set the scale value in the transform buffer
+	scale = glm::scale(scaleXYZ);
+	// set the rotation values in the transform buffer
+	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
+	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
+	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
+	// set the translation value in the transform buffer
+	translation = glm::translate(positionXYZ);
+
+	modelView = translation * rotationX * rotationY * rotationZ * scale;
+
+	// passed to the shader by DrawMesh() along with the mesh's
+	// dequantization
+	m_modelMatrix = modelView;
+}
+
+/***********************************************************
+ *  SetModelMatrix()
+ *
+ *  This method is used for setting an already computed model
+ *  matrix for the next single draw.
+ ***********************************************************/
+void SceneManager::SetModelMatrix(
+	const glm::mat4& modelMatrix)
+{
+	m_modelMatrix = modelMatrix;
+}
+
+/***********************************************************
+ *  SetShaderColor()
+ *
+ *  This method is used for setting the passed in color
+ *  into the shader for the next draw command
+ ***********************************************************/
+void SceneManager::SetShaderColor(
+	float redColorValue,
+	float greenColorValue,
+	float blueColorValue,
+	float alphaValue)
+{
+	// variables for this method
+	glm::vec4 currentColor;
+
+	currentColor.r = redColorValue;
+	currentColor.g = greenColorValue;
+	currentColor.b = blueColorValue;
+	currentColor.a = alphaValue;
+
+	if (NULL != m_pShaderManager)
+	{
+		m_uniforms.SetInt(UNIFORM_USE_TEXTURE, false);
+		m_uniforms.SetVec4(UNIFORM_OBJECT_COLOR, currentColor);
+	}
+}
+
+/***********************************************************
+ *  SetShaderTexture()
+ *
+ *  This method is used for setting the texture data
+ *  associated with the passed in tag into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderTexture(
+	std::string textureTag)
+{
+	SetShaderTexture(FindTextureSlot(textureTag));
+}
+
+/***********************************************************
+ *  SetShaderTexture()
+ *
+ *  This method is used for selecting the texture with the
+ *  passed in index.  All texture arrays are already bound, so
+ *  this only passes the array slot and layer, or the array's
+ *  bindless handle, to the shader.
+ ***********************************************************/
+void SceneManager::SetShaderTexture(
+	int textureIndex)
+{
+	if ((textureIndex < 0) || (textureIndex >= m_textureManager.Count()))
+	{
+		return;
+	}
+
+	m_uniforms.SetInt(UNIFORM_USE_TEXTURE, true);
+	m_uniforms.SetInt(UNIFORM_USE_BINDLESS, m_textureManager.IsBindless());
+	m_uniforms.SetIVec2(UNIFORM_TEXTURE_LAYER, glm::ivec2(
+		m_textureManager.GetArraySlot(textureIndex),
+		m_textureManager.GetLayer(textureIndex)));
+	if (m_textureManager.IsBindless())
+	{
+		m_uniforms.SetHandle(UNIFORM_OBJECT_TEXTURE_BINDLESS, m_textureManager.GetBindlessHandle(textureIndex));
+	}
+}
+
+/***********************************************************
+ *  SetTextureUVScale()
+ *
+ *  This method is used for setting the texture UV scale
+ *  values for the next single draw.
+ ***********************************************************/
+void SceneManager::SetTextureUVScale(float u, float v)
+{
+	m_uvScale = glm::vec2(u, v);
+}
+
+/***********************************************************
+ *  SetShaderMaterial()
+ *
+ *  This method is used for passing the material values
+ *  into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderMaterial(
+	std::string materialTag)
+{
+	SetShaderMaterial(FindMaterialIndex(materialTag));
+}
+
+/***********************************************************
+ *  SetShaderMaterial()
+ *
+ *  This method is used for selecting a material from the
+ *  material table by handle.  The material values are already
+ *  on the GPU, so only the index is passed to the shader.
+ ***********************************************************/
+void SceneManager::SetShaderMaterial(
+	int materialHandle)
+{
+	if ((materialHandle >= 0) && (materialHandle < (int)m_objectMaterials.size()))
+	{
+		m_uniforms.SetInt(UNIFORM_MATERIAL_INDEX, materialHandle);
+	}
+}
+
+/***********************************************************
+ *  DrawMesh()
+ *
+ *  This method is used for drawing one of the loaded basic
+ *  meshes by its scene mesh ID, with the transform and UV
+ *  scale set last and the mesh's dequantization.
+ ***********************************************************/
+void SceneManager::DrawMesh(int meshID)
+{
+	if (!m_meshes.IsLoaded(meshID))
+	{
+		return;
+	}
+
+	if (NULL != m_pShaderManager)
+	{
+		const MESH_DEQUANTIZATION& dequantization = m_meshes.GetDequantization(meshID);
+		m_uniforms.SetMat4(UNIFORM_MODEL, m_modelMatrix * dequantization.position);
+		m_uniforms.SetVec2(UNIFORM_UV_SCALE, m_uvScale * dequantization.uvScale);
+		m_uniforms.SetVec2(UNIFORM_UV_OFFSET, m_uvScale * dequantization.uvOffset);
+	}
+	m_meshes.Draw(meshID);
+}
+
+/**************************************************************/
+/*** STUDENTS CAN MODIFY the code in the methods BELOW for  ***/
+/*** preparing and rendering their own 3D replicated scenes.***/
+/*** Please refer to the code in the OpenGL sample project  ***/
+/*** for assistance.                                        ***/
+/**************************************************************/
+
+
+/***********************************************************
+ *  PrepareScene()
+ *
+ *  This method is used for preparing the 3D scene by loading
+ *  the shapes, textures in memory to support the 3D scene 
+ *  rendering
+ ***********************************************************/
+void SceneManager::PrepareScene()
 {
 	// only one instance of a particular mesh needs to be
 	// loaded in memory no matter how many times it is drawn
 	// in the rendered 3D scene
 
-	m_basicMeshes->LoadPlaneMesh();  //for ground and roof
-	m_basicMeshes->LoadBoxMesh(); //for house main and garage
-	m_basicMeshes->LoadPyramid3Mesh(); //for roof peaks
-	m_basicMeshes->LoadCylinderMesh(); //for chimney
-	m_basicMeshes->LoadPrismMesh(); //for roof
-
-	m_loadedTextures = 0;
+	// the workers that prepare the frames, and the bounds of
+	// the loaded scene
+	g_JobSystem.Start();
 
-	//load images
-	CreateGLTexture("../../Utilities/textures/grass.jpg", "grass");
-	CreateGLTexture("../../Utilities/textures/wood.jpg", "wood");
-	CreateGLTexture("../../Utilities/textures/stone.jpg", "stone");
+	//plane for ground and roof, box for house main and garage,
+	//pyramid for roof peaks, cylinder for chimney, prism for roof
+	m_meshes.Load();
 
-	//bind texts
-	BindGLTextures();
+	// look up the uniform locations of the loaded shader program
+	// once, the variants are built as batches need them
+	if (NULL != m_pShaderManager)
+	{
+		m_shaderVariants.Initialize(SCENE_VERTEX_SHADER, SCENE_FRAGMENT_SHADER, m_pShaderManager->m_programID);
+		m_uniforms = m_shaderVariants.Get(SHADER_VARIANT_GENERAL);
+	}
 
 	//define mats for phong
 	DefineMaterials();
 
+	//load the objects, their textures and materials from the scene file
+	if (!LoadSceneFile(SCENE_FILENAME))
+	{
+		std::cout << "Could not load the scene, nothing will be drawn:" << SCENE_FILENAME << std::endl;
+	}
+
+	ReportMeshStats();
+
 	//set lights
 	SetupSceneLights();
+	CreateLightBuffer();
+	CreateMaterialBuffer();
 }
 
 /***********************************************************
@@ -614,360 +1722,256 @@ void SceneManager::PrepareScene()
  ***********************************************************/
 void SceneManager::RenderScene()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
+	ProfileScope profileScope("RenderScene");
+
+	// the CPU culling path prepares its packet in a job while
+	// this thread sets up the frame; with pipelined frames the
+	// packet prepared during the last frame is drawn meanwhile
+	FRAME_PACKET& preparePacket = m_framePackets[m_preparePacket];
+	JOB_COUNTER prepared;
+	if (!m_bGpuCulling)
+	{
+		g_JobSystem.Run(prepared, [this, &preparePacket]() { PrepareFrame(preparePacket); });
+	}
+	const bool bPipelined = m_bPipelinedFrames && !m_bGpuCulling && m_bPacketPending;
+	FRAME_PACKET& drawPacket = bPipelined ? m_framePackets[m_preparePacket ^ 1] : preparePacket;
+	m_viewMatrix = drawPacket.viewMatrix;
+	m_projectionMatrix = drawPacket.projectionMatrix;
+	m_viewPosition = drawPacket.viewPosition;
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	UseShaderVariant(SHADER_VARIANT_GENERAL);
+
+	g_GLState.Enable(GL_DEPTH_TEST);
+	g_GLState.DepthFunc(GL_LEQUAL);
 
 	//flip the switch
 	EnableLighting();
 
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-	/******************************************************************/
-	//create a large green yard
-	scaleXYZ = glm::vec3(25.0f, 1.0f, 20.0f);
-
-	// set the XYZ rotation for the yard
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the yard
-	positionXYZ = glm::vec3(0.0f, 0.0f, 0.0f);
-
-	// set the transformations into memory to be used on yard
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//SetShaderColor(0.13f, 0.55f, 0.13f, 1.0f); //green for grass
-	//set image instead of color
-	SetShaderMaterial("grass");
-	SetShaderTexture("grass");
-	SetTextureUVScale(10.0f, 10.0f);
-
-	// draw the yard with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-	/******************************************************************/
-	/*** driveway (Concrete/Gray)                                  ***/
-	/******************************************************************/
-	//create driveway plane - in front of garage
-	/****************************************************************/
-	scaleXYZ = glm::vec3(4.0f, 1.0f, 8.0f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-4.0f, 0.01f, 6.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//set grey color
-	SetShaderColor(0.5f, 0.5f, 0.5f, 1.0f);
-	//draw driveway
-	m_basicMeshes->DrawPlaneMesh();
-
-	/******************************************************************/
-	/*** main house struct ***/
-	/******************************************************************/
-	//main house body - white upper section
-	scaleXYZ = glm::vec3(8.0f, 4.0f, 6.0f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(2.0f, 2.0f, 0.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//set white siding color
-	//SetShaderColor(0.95f, 0.95f, 0.95f, 1.0f);
-	//wood siding instead
-	SetShaderMaterial("wood");
-	SetShaderTexture("wood");
-	SetTextureUVScale(4.0f, 3.0f);
-	
-	m_basicMeshes->DrawBoxMesh();
-
-	//going to try to add brick to the house
-	scaleXYZ = glm::vec3(8.2f, 1.0f, 6.2f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(2.0f, 0.5f, 0.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//redish brick color
-	//SetShaderColor(0.55f, 0.27f, 0.07f, 1.0f);
-
-	//trying to add actual stone now
-	SetShaderMaterial("stone");
-	SetShaderTexture("stone");
-	SetTextureUVScale(3.0f, 1.0f);
-
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/*** garage on left side of house ***/
-	/******************************************************************/
-	//garage struct
-	scaleXYZ = glm::vec3(5.0f, 3.5f, 5.0f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-4.0f, 1.75f, 1.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//white siding to match house
-	//SetShaderColor(0.95f, 0.95f, 0.95f, 1.0f);
-	SetShaderMaterial("wood");
-	SetShaderTexture("wood");
-	SetTextureUVScale(3.0f, 2.5f);
-
-	m_basicMeshes->DrawBoxMesh();
-
-	//garage brick
-	scaleXYZ = glm::vec3(5.2f, 0.8f, 5.2f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-4.0f, 0.4f, 1.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//redish brick color
-	//SetShaderColor(0.55f, 0.27f, 0.07f, 1.0f);
-	SetShaderMaterial("stone");
-	SetShaderTexture("stone");
-	SetTextureUVScale(2.5f, 0.8f);
-	
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/***next up, garage door ***/
-	/******************************************************************/
-	
-	scaleXYZ = glm::vec3(3.5f, 2.5f, 0.1f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-4.0f, 1.25f, 3.6f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//gray color for door
-	SetShaderColor(0.9f, 0.9f, 0.9f, 1.0f);
-	m_basicMeshes->DrawBoxMesh();
-
-
-	/******************************************************************/
-	/*** main roof using prism ***/
-	/******************************************************************/
-	//main house roof
-
-	scaleXYZ = glm::vec3(8.5f, 2.0f, 7.0f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f; 
-	positionXYZ = glm::vec3(2.0f, 4.5f, 0.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-	//dark gray color for roof
-	SetShaderColor(0.3f, 0.3f, 0.35f, 1.0f);
-	m_basicMeshes->DrawPrismMesh();
-
-	/******************************************************************/
-	/***roof for garage now ***/
-	/******************************************************************/
-	scaleXYZ = glm::vec3(5.5f, 1.5f, 5.5f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 90.0f; //need to ratate to fit main roof
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-4.0f, 3.8f, 1.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	SetShaderColor(0.3f, 0.3f, 0.35f, 1.0f); //same as other roof
-	m_basicMeshes->DrawPrismMesh();
-
-	/******************************************************************/
-	/***front door time ***/
-	/******************************************************************/
-	scaleXYZ = glm::vec3(0.8f, 2.0f, 0.1f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-0.5f, 1.5f, 3.1f);
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-	//brown door color
-	SetShaderColor(0.4f, 0.2f, 0.1f, 1.0f);
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/***windows because who doesnt love to get blinded by the sun or tv glare ***/
-	/******************************************************************/
-	//window 1, left of door
-	scaleXYZ = glm::vec3(1.2f, 1.0f, 0.1f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(-1.0f, 2.0f, 3.1f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	//all windows will have a black frame
-	SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-	m_basicMeshes->DrawBoxMesh();
-
-	//window 2, upper floor on right side
-	scaleXYZ = glm::vec3(1.5f, 1.0f, 0.1f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(3.5f, 3.0f, 3.1f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-	m_basicMeshes->DrawBoxMesh();
-
-	//window 3, larger window
-	scaleXYZ = glm::vec3(2.0f, 1.5f, 0.1f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(5.0f, 2.0f, 3.1f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-
-	SetShaderColor(0.1f, 0.1f, 0.1f, 1.0f);
-	m_basicMeshes->DrawBoxMesh();
-
-	/******************************************************************/
-	/***going to try do a chimney, probably will fail  ***/
-	/******************************************************************/
-	scaleXYZ = glm::vec3(0.4f, 2.0f, 0.4f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(4.0f, 5.f, -1.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-	//brick red for color of chimney
-	//SetShaderColor(0.55f, 0.27f, 0.07f, 1.0f);
-	SetShaderMaterial("stone");
-	SetShaderTexture("stone");
-	SetTextureUVScale(1.0f, 2.0f);
-
-	m_basicMeshes->DrawCylinderMesh();
-
-	/******************************************************************/
-	/***sidewalk ***/
-	/******************************************************************/
-	scaleXYZ = glm::vec3(1.5f, 1.0f, 4.0f);
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-	positionXYZ = glm::vec3(0.5f, 0.01f, 5.0f);
-
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ
-	);
-	//light gray for sidewalk color
-	SetShaderColor(0.6f, 0.6f, 0.6f, 1.0f);
-	m_basicMeshes->DrawPlaneMesh();
+	// send any materials defined since the last frame
+	UploadMaterials();
+
+	// stream in the textures decoded since the last frame
+	{
+		GpuProfileScope gpuScope("TextureUpload");
+		m_textureManager.Update();
+	}
+
+	if (m_bGpuCulling)
+	{
+		// the compute culling path only needs the world bounds
+		// to pick levels of detail, never the culling tree
+		bool bTransformsChanged = (m_transforms.Update() > 0);
+		if (bTransformsChanged)
+		{
+			UpdateObjectBounds();
+		}
+
+		// batch every object once, the compute shader picks the
+		// visible ones from the batches every frame; the levels
+		// of detail are picked here and rebatch the objects only
+		// when one of them changes
+		bool bLodsChanged = SelectObjectLods(drawPacket, true);
+		if (bTransformsChanged || bLodsChanged || m_bGpuObjectsDirty)
+		{
+			ProfileScope cullScope("CullAndSort");
+			BuildGpuCullObjects(drawPacket);
+		}
+
+		// depth of the large occluders first, then the culling
+		// tests every object against its farthest depth pyramid
+		const glm::mat4 viewProjection = m_projectionMatrix * m_viewMatrix;
+		if (m_bOcclusionCulling)
+		{
+			{
+				GpuProfileScope gpuScope("OcclusionPrePass");
+				m_hiZ.BeginOccluders(viewProjection);
+				m_meshes.Bind();
+				m_gpuCulling.DrawOccluders();
+			}
+			m_hiZ.EndOccluders();
+		}
+		m_gpuCulling.Cull(ExtractFrustum(viewProjection), viewProjection, m_bOcclusionCulling ? &m_hiZ : NULL);
+	}
+	else if (!bPipelined)
+	{
+		ProfileScope waitScope("WaitForFrame");
+		g_JobSystem.Wait(prepared);
+	}
+	RecordRenderStats(drawPacket);
+
+	DrawInstanceBatches(drawPacket);
+
+	// nothing may read the scene once this returns, the scene
+	// can change between frames
+	{
+		ProfileScope waitScope("WaitForFrame");
+		g_JobSystem.Wait(prepared);
+	}
+	if (m_bPipelinedFrames && !m_bGpuCulling)
+	{
+		// draw this packet next frame and prepare the other one,
+		// for the same camera unless a new one is passed in
+		m_preparePacket ^= 1;
+		m_framePackets[m_preparePacket].viewMatrix = preparePacket.viewMatrix;
+		m_framePackets[m_preparePacket].projectionMatrix = preparePacket.projectionMatrix;
+		m_framePackets[m_preparePacket].viewPosition = preparePacket.viewPosition;
+		m_bPacketPending = true;
+	}
+	else
+	{
+		m_bPacketPending = false;
+	}
+}
+
+/***********************************************************
+ *  PrepareFrame()
+ *
+ *  This method is used for building the packet of a frame on
+ *  the CPU culling path, it runs as a job.  The transforms
+ *  and the culling tree are brought up to date, then the
+ *  objects inside the view are sorted by state and merged
+ *  into instanced batches.  The loops over the objects are
+ *  split into more jobs; the tree walk, the sort and the
+ *  batching stay on one thread.
+ ***********************************************************/
+void SceneManager::PrepareFrame(FRAME_PACKET& packet)
+{
+	ProfileScope profileScope("PrepareFrame");
+
+	// recompute only the transforms that changed, a static
+	// scene does no matrix math here at all
+	bool bChanged = (m_transforms.Update() > 0);
+	if (bChanged)
+	{
+		UpdateObjectBounds();
+		m_bvh.Refit(m_objectBounds);
+	}
+
+	// skip everything outside the view, then sort the visible
+	// draws by state and merge them into instanced batches
+	ProfileScope cullScope("CullAndSort");
+	CullSceneObjects(packet);
+	bChanged = SelectObjectLods(packet, false) || bChanged;
+	if (bChanged)
+	{
+		// the other packet was built from the old transforms
+		// or levels as well
+		MarkFramePacketsStale();
+	}
+	QueueSceneObjects(packet, true);
+	m_renderQueue.Sort();
+	packet.queueStats = m_renderQueue.GetStats();
+	BuildInstanceBatches(packet);
+}
+
+/***********************************************************
+ *  DrawInstanceBatches()
+ *
+ *  This method is used for drawing the instance batches with
+ *  one indirect draw per run of batches with the same
+ *  pipeline and shader variant.  Every mesh shares the same
+ *  buffers and each batch reads its texture array from its
+ *  draw parameters, so only the program changes between the
+ *  runs.  The queue sorts the untextured batches of a
+ *  pipeline first, so a pipeline splits into two runs at
+ *  most.  One bindless handle cannot serve every batch, so
+ *  the draws sample the bound texture arrays.  The commands
+ *  and the instances come from the frame's ring region, or
+ *  from the compute culling when it is on.
+ ***********************************************************/
+void SceneManager::DrawInstanceBatches(const FRAME_PACKET& packet)
+{
+	const std::vector<INSTANCE_BATCH>& batches = packet.instanceBatches;
+	if (!WriteFrameData(packet))
+	{
+		return;
+	}
+	GLuint commandBuffer = m_bGpuCulling ? m_gpuCulling.GetCommandBuffer() : m_frameData.GetBuffer();
+	GLuint instanceBuffer = m_bGpuCulling ? m_gpuCulling.GetInstanceBuffer() : m_frameData.GetBuffer();
+	const size_t commandOffset = m_bGpuCulling ? 0 : m_frameCommandOffset;
+	if ((commandBuffer == 0) || (instanceBuffer == 0))
+	{
+		m_frameData.EndFrame();
+		return;
+	}
+	// a grown ring is a new buffer even when its name is
+	// the old one, the vertex array lost the old one
+	const bool bRingCreated = !m_bGpuCulling && (m_frameData.GetGeneration() != m_instanceBufferGeneration);
+	if ((m_meshes.GetInstanceBuffer() != instanceBuffer) || bRingCreated)
+	{
+		m_meshes.SetInstanceBuffer(instanceBuffer);
+		m_instanceBufferGeneration = m_frameData.GetGeneration();
+	}
+
+	GpuProfileScope gpuScope("SceneDraw");
+	m_meshes.Bind();
+	g_GLState.BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	size_t firstDraw = 0;
+	while (firstDraw < batches.size())
+	{
+		ProfileScope batchScope("DrawBatch");
+		const int pipeline = batches[firstDraw].pipeline;
+		const uint32_t variant = GetBatchVariant(batches[firstDraw]);
+		size_t endDraw = firstDraw + 1;
+		while ((endDraw < batches.size()) &&
+			(batches[endDraw].pipeline == pipeline) &&
+			(GetBatchVariant(batches[endDraw]) == variant))
+		{
+			endDraw++;
+		}
+
+		UseShaderVariant(variant);
+		m_uniforms.SetInt(UNIFORM_USE_INSTANCING, true);
+		m_uniforms.SetInt(UNIFORM_USE_BINDLESS, false);
+
+		// see-through objects test depth but do not write it
+		g_GLState.DepthMask((pipeline == PIPELINE_TRANSPARENT) ? GL_FALSE : GL_TRUE);
+		m_uniforms.SetInt(UNIFORM_FIRST_DRAW, (int)(m_frameParameterBase + firstDraw));
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			(const void*)(commandOffset + firstDraw * sizeof(DRAW_ELEMENTS_COMMAND)), (GLsizei)(endDraw - firstDraw), 0);
+		firstDraw = endDraw;
+	}
+	m_uniforms.SetInt(UNIFORM_USE_INSTANCING, false);
+	g_GLState.DepthMask(GL_TRUE);
+	m_frameData.EndFrame();
+	UseShaderVariant(SHADER_VARIANT_GENERAL);
+}
+
+/***********************************************************
+ *  GetBatchVariant()
+ ***********************************************************/
+uint32_t SceneManager::GetBatchVariant(const INSTANCE_BATCH& batch) const
+{
+	return(MakeShaderVariant(
+		batch.textureID >= 0,
+		m_bLightingEnabled,
+		m_globalLightCount,
+		!m_lightSpheres.empty()));
+}
+
+/***********************************************************
+ *  UseShaderVariant()
+ *
+ *  This method is used for switching to a variant program.
+ *  The camera and lighting values are passed to it on every
+ *  switch, a program that already holds them costs no OpenGL
+ *  calls through the state cache.
+ ***********************************************************/
+void SceneManager::UseShaderVariant(uint32_t variant)
+{
+	if (NULL == m_pShaderManager)
+	{
+		return;
+	}
+
+	m_uniforms = m_shaderVariants.Get(variant);
+	g_GLState.UseProgram(m_uniforms.GetProgram());
 
+	m_uniforms.SetMat4(UNIFORM_VIEW, m_viewMatrix);
+	m_uniforms.SetMat4(UNIFORM_PROJECTION, m_projectionMatrix);
+	m_uniforms.SetVec3(UNIFORM_VIEW_POSITION, m_viewPosition);
+	m_uniforms.SetInt(UNIFORM_USE_LIGHTING, m_bLightingEnabled);
+	m_uniforms.SetInt(UNIFORM_GLOBAL_LIGHT_COUNT, m_globalLightCount);
+	m_uniforms.SetVec2(UNIFORM_CLUSTER_TILE_SCALE, m_lightClusters.GetTileScale());
+	m_uniforms.SetVec2(UNIFORM_CLUSTER_DEPTH_SCALE, m_lightClusters.GetDepthScaleBias());
 }
@@ -10,7 +10,18 @@
 #pragma once
 
 #include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "MeshLibrary.h"
+#include "RenderQueue.h"
+#include "BoundingVolumeHierarchy.h"
+#include "SceneFile.h"
+#include "TransformHierarchy.h"
+#include "ShaderUniforms.h"
+#include "TextureManager.h"
+#include "LightClusters.h"
+#include "GpuCulling.h"
+#include "ShaderVariants.h"
+#include "RingBuffer.h"
+#include "StaticGeometry.h"
 
 #include <string>
 #include <vector>
@@ -29,12 +40,6 @@ public:
 	// destructor
 	~SceneManager();
 
-	struct TEXTURE_INFO
-	{
-		std::string tag;
-		uint32_t ID;
-	};
-
 	struct OBJECT_MATERIAL
 	{
 		float ambientStrength;
@@ -62,35 +67,331 @@ public:
 		bool enabled;
 	};
 
+	// add a scene light and return its index
+	int AddLight(const LIGHT_SOURCE& light);
+	// replace a scene light, the light buffer is only uploaded
+	// again when the light actually changed
+	void SetLight(int index, const LIGHT_SOURCE& light);
+
+	// define a material and return its handle, handles are
+	// stable indexes into the material table, or -1 when full
+	int AddMaterial(const OBJECT_MATERIAL& material);
+
+	// true while textures are still streaming in
+	bool IsStreaming() const { return m_textureManager.GetPendingCount() > 0; }
+
+	// cull and batch the objects in a compute shader instead of
+	// on the CPU, false when the culling shader cannot be loaded
+	bool SetGpuCulling(bool bEnable);
+	bool IsGpuCulling() const { return m_bGpuCulling; }
+	// also cull the objects hidden behind the large occluders,
+	// false when the Hi-Z shaders cannot be loaded
+	bool SetOcclusionCulling(bool bEnable);
+	bool IsOcclusionCulling() const { return m_bOcclusionCulling; }
+
+	// merge the static objects into pre-transformed meshes when
+	// the scene is loaded, optionally through a file next to the
+	// scene, must be set before PrepareScene()
+	void SetStaticBaking(bool bEnable, bool bUseCache = true);
+	// draw a scene object on its own again so it can be moved,
+	// objects are numbered in scene file order
+	bool UnbakeObject(int object);
+
+	// slices around the full detail cylinder, must be set
+	// before PrepareScene()
+	void SetCylinderTessellation(int slices);
+	// pick a level of detail per object from its size on
+	// screen, or always draw full detail
+	void SetLevelOfDetail(bool bEnable);
+	bool IsLevelOfDetail() const { return m_bLevelOfDetail; }
+
+	// prepare the next frame on the job system while this one
+	// is drawn, at the cost of a frame of latency; the compute
+	// culling path always prepares and draws the same frame
+	void SetPipelinedFrames(bool bEnable);
+	bool IsPipelinedFrames() const { return m_bPipelinedFrames; }
+
+	// find a scene node by its name in the scene file, or -1
+	int FindNode(const std::string& name) const;
+	// change the local transform of a scene node, its objects
+	// and every node below it move on the next frame and stop
+	// being baked; call it between frames, never during
+	// RenderScene()
+	bool SetNodeTransform(
+		int node,
+		glm::vec3 scaleXYZ,
+		glm::vec3 rotationDegreesXYZ,
+		glm::vec3 positionXYZ);
+
+	// pass in the camera of the frame about to be rendered
+	void SetViewParameters(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		const glm::vec3& viewPosition);
+
+	// the culling and batching statistics of the last frame,
+	// short enough for the window title
+	std::string GetRenderSummary() const;
+
 private:
+	// std140 layout of one material in the material uniform block
+	struct GPU_MATERIAL
+	{
+		glm::vec3 ambientColor;
+		float ambientStrength;
+		glm::vec3 diffuseColor;
+		float shininess;
+		glm::vec3 specularColor;
+		float padding;
+	};
+
+	// std430 layout of one light in the light storage buffer
+	struct GPU_LIGHT
+	{
+		glm::vec3 position;
+		int32_t type;
+		glm::vec3 direction;
+		int32_t enabled;
+		glm::vec3 ambientColor;
+		float cutOff;
+		glm::vec3 diffuseColor;
+		float outerCutOff;
+		glm::vec3 specularColor;
+		float constant;
+		float linear;
+		float quadratic;
+		// attenuation radius, 0 for lights that reach everywhere
+		float radius;
+		float padding;
+	};
+
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
-	// pointer to basic shapes object
-	ShapeMeshes* m_basicMeshes;
-	// total number of loaded textures
-	int m_loadedTextures;
-	// loaded textures info
-	TEXTURE_INFO m_textureIDs[16];
+	// every mesh, in shared vertex and index buffers
+	MeshLibrary m_meshes;
+	// loaded textures, packed into texture arrays
+	TextureManager m_textureManager;
 	// defined object materials
 	std::vector<OBJECT_MATERIAL> m_objectMaterials;
+	// uniform buffer holding the material table
+	GLuint m_materialBuffer;
+	// first material not yet uploaded to the material table
+	int m_firstDirtyMaterial;
+
+	// the maximum number of materials, must match the shader
+	static const int MAX_MATERIALS = 256;
 
 	//scene lights
-	static const int MAX_LIGHTS = 4;
-	LIGHT_SOURCE m_lights[MAX_LIGHTS];
-	int m_numLights;
+	std::vector<LIGHT_SOURCE> m_lights;
+	// the enabled lights as uploaded, the lights reaching
+	// everywhere first and then the local lights
+	std::vector<GPU_LIGHT> m_packedLights;
+	int m_globalLightCount;
+	// world space sphere of every packed local light
+	std::vector<glm::vec4> m_lightSpheres;
+	// storage buffer holding the packed lights
+	GLuint m_lightBuffer;
+	// number of lights the light buffer can hold
+	size_t m_lightCapacity;
+	// true when the lights changed since the last upload
+	bool m_bLightsDirty;
+	// the local lights reaching each cluster of the view
+	LightClusters m_lightClusters;
+
+	// cached uniform locations of the active shader program
+	ShaderUniforms m_uniforms;
 
-	// load texture images and convert to OpenGL texture data
-	bool CreateGLTexture(const char* filename, std::string tag);
-	// bind loaded OpenGL textures to slots in memory
+	// flat list of the objects loaded from the scene file
+	SCENE_DRAW_LIST m_sceneObjects;
+	// the objects that are drawn, the baked groups followed by
+	// the scene objects that are not baked
+	SCENE_DRAW_LIST m_drawList;
+	// static objects merged per material, texture and color
+	StaticGeometry m_staticGeometry;
+	bool m_bStaticBaking;
+	bool m_bStaticBakingCache;
+	// identity node the baked groups are drawn with, or -1
+	int m_bakedNode;
+	// level of detail of every draw list object, kept between
+	// frames so a level only changes past the hysteresis band
+	std::vector<uint8_t> m_objectLods;
+	bool m_bLevelOfDetail;
+	// scene transforms with cached world matrices
+	TransformHierarchy m_transforms;
+	// names of the scene file nodes, the nodes past them are
+	// added by the scene manager
+	std::vector<std::string> m_nodeNames;
+
+	// a run of instances in the instance buffer that share a
+	// mesh and a texture array and are drawn with one call
+	struct INSTANCE_BATCH
+	{
+		int pipeline;
+		int meshID;
+		// any texture of the batch, it selects the texture
+		// array, or -1 when no instance is textured
+		int textureID;
+		int firstInstance;
+		int instanceCount;
+	};
+
+	// per-draw values the shader reads by draw index, must
+	// match DrawParameters in the vertex shader
+	struct DRAW_PARAMETERS
+	{
+		// texture array of the draw, or -1 when untextured
+		int32_t textureArray;
+	};
+
+	// everything the main thread needs to draw a frame, built
+	// by jobs from the scene and the frame's camera
+	struct FRAME_PACKET
+	{
+		// camera the frame was prepared for
+		glm::mat4 viewMatrix;
+		glm::mat4 projectionMatrix;
+		glm::vec3 viewPosition;
+
+		// the objects that passed culling
+		std::vector<int> visibleObjects;
+		// per-instance data of every visible object, grouped
+		// by batch
+		std::vector<MESH_INSTANCE> instances;
+		// the draw list object each instance was built from
+		std::vector<int> instanceObjects;
+		std::vector<INSTANCE_BATCH> instanceBatches;
+		// one indirect command and its parameters per batch
+		std::vector<DRAW_ELEMENTS_COMMAND> drawCommands;
+		std::vector<DRAW_PARAMETERS> drawParameters;
+		// triangles the commands draw
+		size_t drawTriangles;
+		// the render queue statistics of the frame
+		RENDER_QUEUE_STATS queueStats;
+		// true when the instances must be rebuilt even if the
+		// sorted order matches the one they were built for
+		bool bStale;
+	};
+
+	// the packet being prepared and the one prepared the frame
+	// before, which is drawn meanwhile when frames are pipelined
+	FRAME_PACKET m_framePackets[2];
+	int m_preparePacket;
+	bool m_bPipelinedFrames;
+	// true when the other packet holds a frame not yet drawn
+	bool m_bPacketPending;
+
+	// the instances, commands and parameters are copied into
+	// the next region of the ring every frame
+	RingBuffer m_frameData;
+	// generation of the ring the instance attributes point at
+	unsigned int m_instanceBufferGeneration;
+	// where this frame's records start in the ring, the offsets
+	// in bytes and the bases in records
+	size_t m_frameCommandOffset;
+	GLuint m_frameInstanceBase;
+	GLuint m_frameParameterBase;
+
+	// world bounds of every draw list object and the tree
+	// over them used for frustum culling
+	std::vector<AABB> m_objectBounds;
+	BoundingVolumeHierarchy m_bvh;
+
+	// the compute culling path, its batches hold every object
+	// and are only rebuilt when the objects or transforms change
+	GpuCulling m_gpuCulling;
+	bool m_bGpuCulling;
+	bool m_bGpuObjectsDirty;
+	// depth of the large occluders for the occlusion test
+	HiZBuffer m_hiZ;
+	bool m_bOcclusionCulling;
+
+	// the scene programs specialized per batch, m_uniforms is
+	// a copy of the uniforms of the one in use
+	ShaderVariants m_shaderVariants;
+	bool m_bLightingEnabled;
+
+	// draw packets of the frame being prepared, sorted by state
+	RenderQueue m_renderQueue;
+	// the statistics of the last drawn frame
+	RENDER_QUEUE_STATS m_frameQueueStats;
+	size_t m_frameDraws;
+	size_t m_frameTriangles;
+	CULL_STATS m_frameCullStats;
+
+	// transform and UV scale of the next single draw
+	glm::mat4 m_modelMatrix;
+	glm::vec2 m_uvScale;
+
+	// camera of the frame being drawn
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	glm::vec3 m_viewPosition;
+
+	// cull, select, queue and batch the objects into a packet,
+	// run as a job; it touches no OpenGL state
+	void PrepareFrame(FRAME_PACKET& packet);
+	// make both packets rebuild their instances
+	void MarkFramePacketsStale();
+	// recompute the world bounds of the draw list objects
+	void UpdateObjectBounds();
+	// collect the objects inside the packet's view frustum
+	void CullSceneObjects(FRAME_PACKET& packet);
+	// pick the level of detail of the visible objects, or of
+	// every object, true when any level changed
+	bool SelectObjectLods(const FRAME_PACKET& packet, bool bAllObjects);
+	// the mesh an object is drawn with at its level of detail
+	int GetObjectMesh(int object) const { return m_meshes.GetLodMesh(m_drawList.meshIDs[object], m_objectLods[object]); }
+	// add a draw packet for every visible object to the queue
+	void QueueSceneObjects(const FRAME_PACKET& packet, bool bSortByDepth);
+	// turn the sorted queue into instance batches, they are
+	// only rebuilt when the order changed or they are stale
+	void BuildInstanceBatches(FRAME_PACKET& packet);
+	// build an indirect command and draw parameters per batch
+	void BuildDrawCommands(FRAME_PACKET& packet);
+	// copy the records of a packet's draws into the ring,
+	// false when there is no ring buffer
+	bool WriteFrameData(const FRAME_PACKET& packet);
+	// batch every object and upload them for the compute culling
+	void BuildGpuCullObjects(FRAME_PACKET& packet);
+	// draw the batches with one indirect draw per pipeline and
+	// shader variant
+	void DrawInstanceBatches(const FRAME_PACKET& packet);
+	// the shader variant that draws a batch
+	uint32_t GetBatchVariant(const INSTANCE_BATCH& batch) const;
+	// use a variant program and pass it the camera and lighting
+	// values of the frame
+	void UseShaderVariant(uint32_t variant);
+	// keep the statistics of the packet about to be drawn
+	void RecordRenderStats(const FRAME_PACKET& packet);
+	// write the vertex memory and fetch the mesh packing saves
+	void ReportMeshStats();
+
+	// queue a texture image to be loaded into a texture array
+	int CreateGLTexture(const char* filename, std::string tag);
+	// start loading the queued textures and bind the texture arrays
 	void BindGLTextures();
 	// free the loaded OpenGL textures
 	void DestroyGLTextures();
 	// find a loaded texture by tag
-	int FindTextureID(std::string tag);
 	int FindTextureSlot(std::string tag);
 	// find a defined material by tag
 	bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
+	int FindMaterialIndex(std::string tag);
 	void DefineMaterials();
+	// create the material table buffer and upload new materials
+	void CreateMaterialBuffer();
+	void UploadMaterials();
+
+	// load a scene description into the draw list
+	bool LoadSceneFile(const char* filename);
+	// bake the loaded scene objects, or read them baked from
+	// the file next to the scene
+	void BakeStaticObjects(const char* filename);
+	// build the draw list from the scene objects and the baked
+	// groups, and the bounds and culling tree over it
+	void RebuildDrawList();
+	// draw one of the basic meshes by scene mesh ID
+	void DrawMesh(int meshID);
 
 	// set the transformation values 
 	// into the transform buffer
@@ -100,6 +401,9 @@ private:
 		float YrotationDegrees,
 		float ZrotationDegrees,
 		glm::vec3 positionXYZ);
+	// set a precomputed model matrix into the shader
+	void SetModelMatrix(
+		const glm::mat4& modelMatrix);
 
 	// set the color values into the shader
 	void SetShaderColor(
@@ -111,6 +415,8 @@ private:
 	// set the texture data into the shader
 	void SetShaderTexture(
 		std::string textureTag);
+	void SetShaderTexture(
+		int textureIndex);
 
 	// set the UV scale for the texture mapping
 	void SetTextureUVScale(
@@ -119,12 +425,17 @@ private:
 	// set the object material into the shader
 	void SetShaderMaterial(
 		std::string materialTag);
+	void SetShaderMaterial(
+		int materialHandle);
 
 	//light methods
 	void SetupSceneLights();
 	void EnableLighting();
 	void DisableLighting();
 	void SetLightingUniforms();
+	void CreateLightBuffer();
+	void AssignLightClusters(bool bLightsChanged);
+	static void PackLight(const LIGHT_SOURCE& light, GPU_LIGHT& gpuLight);
 
 public:
 
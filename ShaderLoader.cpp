@@ -0,0 +1,362 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderloader.cpp
+// ============
+// compile the shader programs, or load them from the program binary cache
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderLoader.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// declaration of local helpers
+namespace
+{
+	const char PROGRAM_CACHE_DIRECTORY[] = "shadercache";
+	const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'B' };
+	const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	// file header, followed by size bytes of program binary
+	struct PROGRAM_CACHE_HEADER
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t binaryFormat;
+		uint32_t size;
+	};
+
+	bool g_bProgramCacheEnabled = true;
+
+	// read a whole text file, false when it cannot be opened
+	bool ReadTextFile(const char* filename, std::string& text)
+	{
+		std::ifstream file(filename, std::ios::in | std::ios::binary);
+		if (!file)
+		{
+			return(false);
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		text = stream.str();
+		return(true);
+	}
+
+	// put the define lines after the #version line, which has
+	// to stay the first statement of the shader
+	void InsertDefines(std::string& source, const char* defines)
+	{
+		if ((NULL == defines) || (defines[0] == '\0'))
+		{
+			return;
+		}
+		size_t position = 0;
+		size_t version = source.find("#version");
+		if (version != std::string::npos)
+		{
+			size_t lineEnd = source.find('\n', version);
+			position = (lineEnd != std::string::npos) ? lineEnd + 1 : source.size();
+		}
+		source.insert(position, defines);
+	}
+
+	void MakeDirectory(const char* directory)
+	{
+#ifdef _WIN32
+		_mkdir(directory);
+#else
+		mkdir(directory, 0755);
+#endif
+	}
+
+	// 64-bit FNV-1a over the bytes of a string
+	uint64_t HashText(uint64_t hash, const std::string& text)
+	{
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			hash ^= (unsigned char)text[i];
+			hash *= 1099511628211ULL;
+		}
+		// the terminator keeps "ab"+"c" apart from "a"+"bc"
+		hash ^= 0xFF;
+		hash *= 1099511628211ULL;
+		return(hash);
+	}
+
+	std::string GetGLString(GLenum name)
+	{
+		const GLubyte* text = glGetString(name);
+		return (NULL != text) ? std::string((const char*)text) : std::string();
+	}
+
+	// the cache file of a set of shader stages on this driver
+	std::string GetProgramCacheFilename(const GLenum* types, const std::string* sources, int shaderCount)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		hash = HashText(hash, GetGLString(GL_VENDOR));
+		hash = HashText(hash, GetGLString(GL_RENDERER));
+		hash = HashText(hash, GetGLString(GL_VERSION));
+		for (int i = 0; i < shaderCount; i++)
+		{
+			hash = HashText(hash, std::to_string(types[i]));
+			hash = HashText(hash, sources[i]);
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+		return std::string(PROGRAM_CACHE_DIRECTORY) + "/" + name + ".bin";
+	}
+
+	/***********************************************************
+	 *  LoadCachedProgram()
+	 *
+	 *  Create a program from a cached binary.  The driver may
+	 *  refuse a binary it wrote itself, so the link status is
+	 *  checked and 0 returned to fall back to the sources.
+	 ***********************************************************/
+	GLuint LoadCachedProgram(const std::string& cacheFilename)
+	{
+		FILE* file = fopen(cacheFilename.c_str(), "rb");
+		if (NULL == file)
+		{
+			return(0);
+		}
+
+		PROGRAM_CACHE_HEADER header;
+		std::vector<unsigned char> binary;
+		bool bValid = (fread(&header, sizeof(header), 1, file) == 1) &&
+			(memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0) &&
+			(header.version == PROGRAM_CACHE_VERSION) &&
+			(header.size > 0);
+		if (bValid)
+		{
+			binary.resize(header.size);
+			bValid = (fread(binary.data(), 1, binary.size(), file) == binary.size());
+		}
+		fclose(file);
+		if (!bValid)
+		{
+			std::cout << "Ignoring invalid shader cache entry:" << cacheFilename << std::endl;
+			return(0);
+		}
+
+		GLuint program = glCreateProgram();
+		glProgramBinary(program, (GLenum)header.binaryFormat, binary.data(), (GLsizei)binary.size());
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			std::cout << "The driver rejected the cached shader binary, recompiling:" << cacheFilename << std::endl;
+			glDeleteProgram(program);
+			return(0);
+		}
+		return(program);
+	}
+
+	// write the binary of a linked program to the cache
+	void SaveCachedProgram(const std::string& cacheFilename, GLuint program)
+	{
+		GLint binaryLength = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+		if (binaryLength <= 0)
+		{
+			return;
+		}
+
+		PROGRAM_CACHE_HEADER header;
+		std::vector<unsigned char> binary((size_t)binaryLength);
+		GLenum binaryFormat = 0;
+		GLsizei writtenLength = 0;
+		glGetProgramBinary(program, binaryLength, &writtenLength, &binaryFormat, binary.data());
+		if (writtenLength <= 0)
+		{
+			return;
+		}
+		memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+		header.version = PROGRAM_CACHE_VERSION;
+		header.binaryFormat = (uint32_t)binaryFormat;
+		header.size = (uint32_t)writtenLength;
+
+		MakeDirectory(PROGRAM_CACHE_DIRECTORY);
+		FILE* file = fopen(cacheFilename.c_str(), "wb");
+		if (NULL == file)
+		{
+			std::cout << "Could not write shader cache file:" << cacheFilename << std::endl;
+			return;
+		}
+		bool bWritten = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+			(fwrite(binary.data(), 1, (size_t)writtenLength, file) == (size_t)writtenLength);
+		fclose(file);
+		if (!bWritten)
+		{
+			// a partial entry would only be rejected on every launch
+			remove(cacheFilename.c_str());
+		}
+	}
+
+	// compile one shader source, 0 when it fails
+	GLuint CompileShaderSource(GLenum type, const std::string& source, const char* filename)
+	{
+		GLint status = GL_FALSE;
+		const char* sourceText = source.c_str();
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &sourceText, NULL);
+		glCompileShader(shader);
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint logLength = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<char> log((size_t)logLength + 1, '\0');
+			glGetShaderInfoLog(shader, logLength, NULL, log.data());
+			std::cout << "Could not compile shader:" << filename << std::endl << log.data() << std::endl;
+			glDeleteShader(shader);
+			return(0);
+		}
+		return(shader);
+	}
+
+	// link the compiled shaders into a program and free them,
+	// 0 when any shader is missing or linking fails
+	GLuint LinkShaders(const GLuint* shaders, int shaderCount, const char* name)
+	{
+		bool bCompiled = true;
+		for (int i = 0; i < shaderCount; i++)
+		{
+			bCompiled = bCompiled && (shaders[i] != 0);
+		}
+
+		GLuint program = 0;
+		if (bCompiled)
+		{
+			program = glCreateProgram();
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			for (int i = 0; i < shaderCount; i++)
+			{
+				glAttachShader(program, shaders[i]);
+			}
+			glLinkProgram(program);
+			for (int i = 0; i < shaderCount; i++)
+			{
+				glDetachShader(program, shaders[i]);
+			}
+		}
+		for (int i = 0; i < shaderCount; i++)
+		{
+			if (shaders[i] != 0)
+			{
+				glDeleteShader(shaders[i]);
+			}
+		}
+		if (program == 0)
+		{
+			return(0);
+		}
+
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			GLint logLength = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+			std::vector<char> log((size_t)logLength + 1, '\0');
+			glGetProgramInfoLog(program, logLength, NULL, log.data());
+			std::cout << "Could not link shaders:" << name << std::endl << log.data() << std::endl;
+			glDeleteProgram(program);
+			return(0);
+		}
+		return(program);
+	}
+
+	/***********************************************************
+	 *  LoadProgram()
+	 *
+	 *  Read the shader files and add the defines, then use the
+	 *  cached binary of the sources when there is one the
+	 *  driver accepts.  Otherwise compile and link the sources
+	 *  and cache the result.
+	 ***********************************************************/
+	GLuint LoadProgram(const GLenum* types, const char* const* filenames, int shaderCount, const char* defines)
+	{
+		std::vector<std::string> sources((size_t)shaderCount);
+		for (int i = 0; i < shaderCount; i++)
+		{
+			if (!ReadTextFile(filenames[i], sources[i]))
+			{
+				std::cout << "Could not open shader:" << filenames[i] << std::endl;
+				return(0);
+			}
+			InsertDefines(sources[i], defines);
+		}
+
+		GLint binaryFormatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+		const bool bUseCache = g_bProgramCacheEnabled && (binaryFormatCount > 0);
+		std::string cacheFilename;
+		if (bUseCache)
+		{
+			cacheFilename = GetProgramCacheFilename(types, sources.data(), shaderCount);
+			GLuint program = LoadCachedProgram(cacheFilename);
+			if (program != 0)
+			{
+				return(program);
+			}
+		}
+
+		std::vector<GLuint> shaders((size_t)shaderCount);
+		for (int i = 0; i < shaderCount; i++)
+		{
+			shaders[i] = CompileShaderSource(types[i], sources[i], filenames[i]);
+		}
+		GLuint program = LinkShaders(shaders.data(), shaderCount, filenames[0]);
+		if ((program != 0) && bUseCache)
+		{
+			SaveCachedProgram(cacheFilename, program);
+		}
+		return(program);
+	}
+}
+
+/***********************************************************
+ *  SetProgramCacheEnabled()
+ ***********************************************************/
+void SetProgramCacheEnabled(bool bEnabled)
+{
+	g_bProgramCacheEnabled = bEnabled;
+}
+
+/***********************************************************
+ *  LoadComputeProgram()
+ *
+ *  This function is used for compiling a compute shader and
+ *  linking it into its own program.  The shader and program
+ *  logs are written to the console when either step fails.
+ ***********************************************************/
+GLuint LoadComputeProgram(const char* filename)
+{
+	const GLenum type = GL_COMPUTE_SHADER;
+	return(LoadProgram(&type, &filename, 1, NULL));
+}
+
+/***********************************************************
+ *  LoadShaderProgram()
+ *
+ *  This function is used for compiling a vertex and fragment
+ *  shader pair and linking them into a program.
+ ***********************************************************/
+GLuint LoadShaderProgram(const char* vertexFilename, const char* fragmentFilename, const char* defines)
+{
+	const GLenum types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	const char* filenames[2] = { vertexFilename, fragmentFilename };
+	return(LoadProgram(types, filenames, 2, defines));
+}
@@ -0,0 +1,35 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderloader.h
+// ============
+// compile the shader programs, or load them from the program binary cache
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// compile and link a compute shader file into a program, the
+// errors are written to the console and 0 is returned
+GLuint LoadComputeProgram(const char* filename);
+// compile and link a vertex and a fragment shader file into a
+// program, or 0 on errors; the defines are #define lines put
+// in both shaders right after their #version line
+GLuint LoadShaderProgram(const char* vertexFilename, const char* fragmentFilename, const char* defines = NULL);
+
+/***********************************************************
+ *  Program binary cache
+ *
+ *  Every program linked here is stored in the shadercache
+ *  directory as the driver's own binary, under a hash of the
+ *  shader sources and the OpenGL vendor, renderer and version
+ *  strings.  The next launch hands the binary straight back
+ *  to glProgramBinary and only compiles from source when the
+ *  driver rejects it, after a driver update for example, so
+ *  a warm start does no shader compilation at all.  Changing
+ *  a shader changes its hash, stale entries are never used.
+ ***********************************************************/
+
+// turn the cache on or off, it is on by default
+void SetProgramCacheEnabled(bool bEnabled);
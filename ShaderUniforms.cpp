@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.cpp
+// ============
+// uniform locations resolved once per shader program
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderUniforms.h"
+#include "GLStateCache.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+// declaration of global variables
+namespace
+{
+	// uniform names, in SHADER_UNIFORM order
+	const char* g_UniformNames[UNIFORM_COUNT] =
+	{
+		"model",
+		"view",
+		"projection",
+		"viewPosition",
+		"objectColor",
+		"objectTextures",
+		"objectTextureBindless",
+		"textureLayer",
+		"bUseTexture",
+		"bUseBindless",
+		"bUseLighting",
+		"UVscale",
+		"UVoffset",
+		"materialIndex",
+		"bUseInstancing",
+		"numGlobalLights",
+		"clusterTileScale",
+		"clusterDepthScale",
+		"firstDraw"
+	};
+
+	// uniform block names and their binding points
+	const char* g_MaterialBlockName = "MaterialBlock";
+}
+
+/***********************************************************
+ *  ShaderUniforms()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderUniforms::ShaderUniforms()
+{
+	m_programID = 0;
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		m_locations[i] = -1;
+	}
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for making the passed in program the
+ *  one in use and the cached locations belong to it, they
+ *  are only looked up again when the program changes.
+ ***********************************************************/
+void ShaderUniforms::Bind(GLuint programID)
+{
+	g_GLState.UseProgram(programID);
+	if (programID != m_programID)
+	{
+		Resolve(programID);
+	}
+}
+
+/***********************************************************
+ *  Resolve()
+ *
+ *  This method is used for looking up the location of every
+ *  known uniform in the passed in program and attaching the
+ *  shared uniform blocks to their binding points.  Uniforms
+ *  the program does not use get a location of -1, which
+ *  OpenGL silently ignores.
+ ***********************************************************/
+void ShaderUniforms::Resolve(GLuint programID)
+{
+	m_programID = programID;
+	g_GLState.ForgetProgram(programID);
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		m_locations[i] = (programID != 0) ? glGetUniformLocation(programID, g_UniformNames[i]) : -1;
+	}
+
+	if (programID != 0)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(programID, g_MaterialBlockName);
+		if (blockIndex != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(programID, blockIndex, BLOCK_BINDING_MATERIALS);
+		}
+
+		// point the texture array samplers at their fixed texture units
+		GLint textureUnits[MAX_TEXTURE_ARRAYS];
+		for (int i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+		{
+			textureUnits[i] = TEXTURE_UNIT_ARRAYS + i;
+		}
+		glUniform1iv(m_locations[UNIFORM_OBJECT_TEXTURES], MAX_TEXTURE_ARRAYS, textureUnits);
+	}
+}
+
+void ShaderUniforms::SetInt(SHADER_UNIFORM uniform, int value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], &value, sizeof(value)))
+	{
+		glUniform1i(m_locations[uniform], value);
+	}
+}
+
+void ShaderUniforms::SetFloat(SHADER_UNIFORM uniform, float value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], &value, sizeof(value)))
+	{
+		glUniform1f(m_locations[uniform], value);
+	}
+}
+
+void ShaderUniforms::SetIVec2(SHADER_UNIFORM uniform, const glm::ivec2& value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], &value.x, sizeof(value)))
+	{
+		glUniform2i(m_locations[uniform], value.x, value.y);
+	}
+}
+
+void ShaderUniforms::SetVec2(SHADER_UNIFORM uniform, const glm::vec2& value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], glm::value_ptr(value), sizeof(value)))
+	{
+		glUniform2fv(m_locations[uniform], 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderUniforms::SetVec3(SHADER_UNIFORM uniform, const glm::vec3& value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], glm::value_ptr(value), sizeof(value)))
+	{
+		glUniform3fv(m_locations[uniform], 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderUniforms::SetVec4(SHADER_UNIFORM uniform, const glm::vec4& value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], glm::value_ptr(value), sizeof(value)))
+	{
+		glUniform4fv(m_locations[uniform], 1, glm::value_ptr(value));
+	}
+}
+
+void ShaderUniforms::SetMat4(SHADER_UNIFORM uniform, const glm::mat4& value) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], glm::value_ptr(value), sizeof(value)))
+	{
+		glUniformMatrix4fv(m_locations[uniform], 1, GL_FALSE, glm::value_ptr(value));
+	}
+}
+
+void ShaderUniforms::SetHandle(SHADER_UNIFORM uniform, GLuint64 handle) const
+{
+	if (g_GLState.UniformChanged(m_programID, m_locations[uniform], &handle, sizeof(handle)))
+	{
+		glUniformHandleui64ARB(m_locations[uniform], handle);
+	}
+}
@@ -0,0 +1,91 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.h
+// ============
+// uniform locations resolved once per shader program
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// the uniforms the scene and view managers set in the shaders
+enum SHADER_UNIFORM
+{
+	UNIFORM_MODEL = 0,
+	UNIFORM_VIEW,
+	UNIFORM_PROJECTION,
+	UNIFORM_VIEW_POSITION,
+	UNIFORM_OBJECT_COLOR,
+	UNIFORM_OBJECT_TEXTURES,
+	UNIFORM_OBJECT_TEXTURE_BINDLESS,
+	UNIFORM_TEXTURE_LAYER,
+	UNIFORM_USE_TEXTURE,
+	UNIFORM_USE_BINDLESS,
+	UNIFORM_USE_LIGHTING,
+	UNIFORM_UV_SCALE,
+	UNIFORM_UV_OFFSET,
+	UNIFORM_MATERIAL_INDEX,
+	UNIFORM_USE_INSTANCING,
+	UNIFORM_GLOBAL_LIGHT_COUNT,
+	UNIFORM_CLUSTER_TILE_SCALE,
+	UNIFORM_CLUSTER_DEPTH_SCALE,
+	UNIFORM_FIRST_DRAW,
+	UNIFORM_COUNT
+};
+
+// binding points of the uniform blocks shared by all programs,
+// the lights are in storage buffers, see LightClusters.h
+enum SHADER_BLOCK_BINDING
+{
+	BLOCK_BINDING_MATERIALS = 1
+};
+
+// storage buffer binding of the per-draw parameters, after the
+// lighting buffers in LightClusters.h, must match the shader
+const int STORAGE_BINDING_DRAW_PARAMETERS = 3;
+
+// the texture arrays are bound to consecutive texture units
+// starting at TEXTURE_UNIT_ARRAYS, must match the shader
+const int MAX_TEXTURE_ARRAYS = 8;
+const int TEXTURE_UNIT_ARRAYS = 0;
+
+/***********************************************************
+ *  ShaderUniforms
+ *
+ *  This class looks up the location of every known uniform
+ *  the first time a program is used, so setting a uniform
+ *  afterwards is a single glUniform call with no name lookup.
+ *  Values go through the state cache, so setting a uniform
+ *  to the value it already holds costs no OpenGL call.  The
+ *  program must be the one currently in use.
+ ***********************************************************/
+class ShaderUniforms
+{
+public:
+	// constructor
+	ShaderUniforms();
+
+	// use the program and resolve the uniform locations if the
+	// program has changed
+	void Bind(GLuint programID);
+	// resolve the uniform locations of the passed in program
+	void Resolve(GLuint programID);
+
+	GLuint GetProgram() const { return m_programID; }
+	GLint Location(SHADER_UNIFORM uniform) const { return m_locations[uniform]; }
+
+	void SetInt(SHADER_UNIFORM uniform, int value) const;
+	void SetFloat(SHADER_UNIFORM uniform, float value) const;
+	void SetIVec2(SHADER_UNIFORM uniform, const glm::ivec2& value) const;
+	void SetVec2(SHADER_UNIFORM uniform, const glm::vec2& value) const;
+	void SetVec3(SHADER_UNIFORM uniform, const glm::vec3& value) const;
+	void SetVec4(SHADER_UNIFORM uniform, const glm::vec4& value) const;
+	void SetMat4(SHADER_UNIFORM uniform, const glm::mat4& value) const;
+	// set a bindless texture handle, needs ARB_bindless_texture
+	void SetHandle(SHADER_UNIFORM uniform, GLuint64 handle) const;
+
+private:
+	GLuint m_programID;
+	GLint m_locations[UNIFORM_COUNT];
+};
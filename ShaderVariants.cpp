@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.cpp
+// ============
+// scene shader programs specialized at compile time by #define
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderVariants.h"
+#include "ShaderLoader.h"
+#include "GLStateCache.h"
+
+#include <iostream>
+
+// declaration of local helpers
+namespace
+{
+	// bits of a variant below the global light count
+	const int VARIANT_FLAG_BITS = 4;
+	// global light count that means the count uniform is used
+	const int VARIANT_GLOBAL_LIGHTS_UNIFORM = 0xF;
+}
+
+/***********************************************************
+ *  MakeShaderVariant()
+ ***********************************************************/
+uint32_t MakeShaderVariant(bool bTextured, bool bLit, int globalLightCount, bool bLocalLights)
+{
+	uint32_t variant = 0;
+	if (bTextured)
+	{
+		variant |= VARIANT_TEXTURED;
+	}
+	if (bLit)
+	{
+		variant |= VARIANT_LIT;
+		if (bLocalLights)
+		{
+			variant |= VARIANT_LOCAL_LIGHTS;
+		}
+		int lights = (globalLightCount <= MAX_VARIANT_GLOBAL_LIGHTS) ? globalLightCount : VARIANT_GLOBAL_LIGHTS_UNIFORM;
+		variant |= (uint32_t)lights << VARIANT_FLAG_BITS;
+	}
+	return(variant);
+}
+
+/***********************************************************
+ *  ShaderVariants()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderVariants::ShaderVariants()
+{
+}
+
+/***********************************************************
+ *  ~ShaderVariants()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderVariants::~ShaderVariants()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Initialize()
+ ***********************************************************/
+void ShaderVariants::Initialize(const char* vertexFilename, const char* fragmentFilename, GLuint generalProgram)
+{
+	Destroy();
+	m_vertexFilename = vertexFilename;
+	m_fragmentFilename = fragmentFilename;
+	if (generalProgram != 0)
+	{
+		g_GLState.UseProgram(generalProgram);
+	}
+	m_general.Resolve(generalProgram);
+}
+
+/***********************************************************
+ *  Destroy()
+ ***********************************************************/
+void ShaderVariants::Destroy()
+{
+	for (auto& entry : m_variants)
+	{
+		GLuint program = entry.second.GetProgram();
+		if ((program != 0) && (program != m_general.GetProgram()))
+		{
+			g_GLState.ForgetProgram(program);
+			glDeleteProgram(program);
+		}
+	}
+	m_variants.clear();
+}
+
+/***********************************************************
+ *  Get()
+ *
+ *  This method is used for looking up a variant, building it
+ *  on first use.  A variant that fails to build is kept as
+ *  the general program so it is not compiled again on every
+ *  frame.
+ ***********************************************************/
+const ShaderUniforms& ShaderVariants::Get(uint32_t variant)
+{
+	if ((variant == SHADER_VARIANT_GENERAL) || m_vertexFilename.empty())
+	{
+		return(m_general);
+	}
+
+	auto found = m_variants.find(variant);
+	if (found != m_variants.end())
+	{
+		return(found->second);
+	}
+
+	std::string defines = MakeDefines(variant);
+	GLuint program = LoadShaderProgram(m_vertexFilename.c_str(), m_fragmentFilename.c_str(), defines.c_str());
+	ShaderUniforms& uniforms = m_variants[variant];
+	if (program == 0)
+	{
+		std::cout << "Using the general scene shader for variant " << variant << std::endl;
+		uniforms = m_general;
+	}
+	else
+	{
+		g_GLState.UseProgram(program);
+		uniforms.Resolve(program);
+	}
+	return(uniforms);
+}
+
+/***********************************************************
+ *  MakeDefines()
+ *
+ *  This method is used for writing the #define lines of a
+ *  variant, see the top of the fragment shader.
+ ***********************************************************/
+std::string ShaderVariants::MakeDefines(uint32_t variant)
+{
+	int globalLights = (int)(variant >> VARIANT_FLAG_BITS);
+	if (globalLights == VARIANT_GLOBAL_LIGHTS_UNIFORM)
+	{
+		globalLights = -1;
+	}
+
+	std::string defines = "#define SHADER_VARIANT 1\n";
+	defines += std::string("#define VARIANT_TEXTURED ") + (((variant & VARIANT_TEXTURED) != 0) ? "1" : "0") + "\n";
+	defines += std::string("#define VARIANT_LIT ") + (((variant & VARIANT_LIT) != 0) ? "1" : "0") + "\n";
+	defines += std::string("#define VARIANT_LOCAL_LIGHTS ") + (((variant & VARIANT_LOCAL_LIGHTS) != 0) ? "1" : "0") + "\n";
+	defines += "#define VARIANT_GLOBAL_LIGHTS " + std::to_string(globalLights) + "\n";
+	return(defines);
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadervariants.h
+// ============
+// scene shader programs specialized at compile time by #define
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderUniforms.h"
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// features a scene program variant is compiled with
+enum SHADER_VARIANT_FLAG
+{
+	VARIANT_TEXTURED = 1,
+	VARIANT_LIT = 2,
+	// shade the light lists of the clusters
+	VARIANT_LOCAL_LIGHTS = 4
+};
+
+// global light counts up to this get a variant with the count
+// built in, more lights use the light count uniform
+const int MAX_VARIANT_GLOBAL_LIGHTS = 4;
+
+// the general program, compiled without any defines, which
+// branches on the uniforms at runtime
+const uint32_t SHADER_VARIANT_GENERAL = 0xFFFFFFFF;
+
+// get the variant for a set of features, the global light
+// count is kept in the bits above the flags
+uint32_t MakeShaderVariant(bool bTextured, bool bLit, int globalLightCount, bool bLocalLights);
+
+/***********************************************************
+ *  ShaderVariants
+ *
+ *  This class compiles the scene shaders once per variant
+ *  that is actually drawn, with the features of the variant
+ *  passed in as #defines, so an untextured batch carries no
+ *  texture sampling, an unlit one no lighting, and the light
+ *  loops have a fixed count the compiler can unroll.  Every
+ *  program keeps its own resolved uniform locations, so
+ *  switching variants costs no name lookups.  The programs go
+ *  through the program binary cache, so after the first run a
+ *  new variant is a binary load rather than a compile.
+ ***********************************************************/
+class ShaderVariants
+{
+public:
+	// constructor
+	ShaderVariants();
+	// destructor
+	~ShaderVariants();
+
+	// pass in the shader files of the variants and the general
+	// program already built from them
+	void Initialize(const char* vertexFilename, const char* fragmentFilename, GLuint generalProgram);
+	// free the variant programs, the general program is not
+	// owned here
+	void Destroy();
+
+	// get the uniforms of a variant, with its program, built the
+	// first time it is asked for; a variant that does not
+	// compile falls back to the general program
+	const ShaderUniforms& Get(uint32_t variant);
+
+	int GetProgramCount() const { return (int)m_variants.size(); }
+
+private:
+	std::string m_vertexFilename;
+	std::string m_fragmentFilename;
+	ShaderUniforms m_general;
+	std::unordered_map<uint32_t, ShaderUniforms> m_variants;
+
+	static std::string MakeDefines(uint32_t variant);
+};
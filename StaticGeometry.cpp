@@ -0,0 +1,468 @@
+///////////////////////////////////////////////////////////////////////////////
+// staticgeometry.cpp
+// ============
+// merge static objects that draw alike into pre-transformed meshes
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StaticGeometry.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// the draw list stores mesh IDs in a byte, no merged mesh
+	// can be added past this many meshes
+	const int MAX_STATIC_MESHES = 256;
+
+	// identifies a baked geometry file and its layout version
+	const char STATIC_CACHE_MAGIC[4] = { 'S', 'B', 'A', 'K' };
+	const uint32_t STATIC_CACHE_VERSION = 2;
+
+	struct STATIC_CACHE_HEADER
+	{
+		char magic[4];
+		uint32_t version;
+		// draw list objects the file was baked from
+		uint32_t objectCount;
+		uint32_t groupCount;
+		// the basic meshes the objects were baked from
+		uint32_t meshVersion;
+		uint32_t cylinderSlices;
+	};
+
+	// followed by the object indexes, vertices and indices
+	struct STATIC_CACHE_GROUP
+	{
+		uint32_t objectCount;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+	};
+
+	// true when the two objects can be drawn as one mesh
+	bool IsSameGroup(const SCENE_DRAW_LIST& objects, int first, int second)
+	{
+		return (objects.materialIDs[first] == objects.materialIDs[second]) &&
+			(objects.textureIDs[first] == objects.textureIDs[second]) &&
+			(objects.colors[first] == objects.colors[second]);
+	}
+
+	// see-through objects are drawn one by one in depth order
+	bool IsSeeThrough(const SCENE_DRAW_LIST& objects, int object)
+	{
+		return (objects.textureIDs[object] < 0) && (objects.colors[object].a < 1.0f);
+	}
+}
+
+/***********************************************************
+ *  StaticGeometry()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StaticGeometry::StaticGeometry()
+{
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for forgetting every group, the
+ *  merged meshes stay in the mesh library.
+ ***********************************************************/
+void StaticGeometry::Clear()
+{
+	m_groups.clear();
+	m_objectGroups.clear();
+}
+
+/***********************************************************
+ *  AppendObject()
+ *
+ *  This method is used for adding the vertices of an object's
+ *  mesh to a merged mesh.  Positions and normals are moved to
+ *  world space and the UV scale is applied to the texture
+ *  coordinates, so the merged mesh draws with an identity
+ *  transform and a UV scale of one.
+ ***********************************************************/
+void StaticGeometry::AppendObject(
+	const SCENE_DRAW_LIST& objects,
+	int object,
+	const TransformHierarchy& transforms,
+	const MeshLibrary& meshes,
+	MESH_DATA& merged)
+{
+	const MESH_DATA& mesh = meshes.GetMeshData(objects.meshIDs[object]);
+	const glm::mat4& world = transforms.GetWorldMatrix(objects.nodeIDs[object]);
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+	const glm::vec2 uvScale = objects.uvScales[object];
+	const GLuint firstVertex = (GLuint)merged.vertices.size();
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		MESH_VERTEX vertex;
+		vertex.position = glm::vec3(world * glm::vec4(mesh.vertices[i].position, 1.0f));
+		vertex.normal = glm::normalize(normalMatrix * mesh.vertices[i].normal);
+		vertex.textureCoordinate = mesh.vertices[i].textureCoordinate * uvScale;
+		merged.vertices.push_back(vertex);
+	}
+	for (size_t i = 0; i < mesh.indices.size(); i++)
+	{
+		merged.indices.push_back(firstVertex + mesh.indices[i]);
+	}
+}
+
+/***********************************************************
+ *  Bake()
+ *
+ *  This method is used for grouping the objects that share a
+ *  material, texture and color and adding one merged mesh per
+ *  group of at least two objects.  Objects left alone are
+ *  drawn as before.
+ ***********************************************************/
+bool StaticGeometry::Bake(const SCENE_DRAW_LIST& objects, const TransformHierarchy& transforms, MeshLibrary& meshes)
+{
+	const int objectCount = (int)objects.Count();
+
+	Clear();
+	m_objectGroups.assign(objectCount, -1);
+
+	// sort the objects into candidate groups, there are only a
+	// few per scene so a linear search over them is enough
+	std::vector<std::vector<int>> candidates;
+	for (int i = 0; i < objectCount; i++)
+	{
+		if (IsSeeThrough(objects, i) || !meshes.IsLoaded(objects.meshIDs[i]))
+		{
+			continue;
+		}
+
+		size_t c = 0;
+		while ((c < candidates.size()) && !IsSameGroup(objects, candidates[c][0], i))
+		{
+			c++;
+		}
+		if (c == candidates.size())
+		{
+			candidates.push_back(std::vector<int>());
+		}
+		candidates[c].push_back(i);
+	}
+
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		if (candidates[c].size() < 2)
+		{
+			continue;
+		}
+		if (meshes.GetMeshCount() >= MAX_STATIC_MESHES)
+		{
+			std::cout << "Too many meshes to bake the remaining static groups" << std::endl;
+			break;
+		}
+
+		MESH_DATA merged;
+		for (size_t j = 0; j < candidates[c].size(); j++)
+		{
+			AppendObject(objects, candidates[c][j], transforms, meshes, merged);
+		}
+
+		STATIC_GROUP group;
+		group.objects = candidates[c];
+		group.meshID = meshes.AddMesh(merged);
+		group.bBaked = true;
+		for (size_t j = 0; j < group.objects.size(); j++)
+		{
+			m_objectGroups[group.objects[j]] = (int)m_groups.size();
+		}
+		m_groups.push_back(group);
+	}
+
+	return(!m_groups.empty());
+}
+
+/***********************************************************
+ *  LoadCache()
+ *
+ *  This method is used for reading baked groups from a file
+ *  instead of baking them again.  The file must have been
+ *  written for a draw list of the same size, from basic
+ *  meshes generated the same way.
+ ***********************************************************/
+bool StaticGeometry::LoadCache(const char* filename, const SCENE_DRAW_LIST& objects, MeshLibrary& meshes)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	STATIC_CACHE_HEADER header;
+	file.read((char*)&header, sizeof(header));
+	if (!file ||
+		(memcmp(header.magic, STATIC_CACHE_MAGIC, sizeof(header.magic)) != 0) ||
+		(header.version != STATIC_CACHE_VERSION) ||
+		(header.objectCount != (uint32_t)objects.Count()) ||
+		(header.meshVersion != MESH_GENERATION_VERSION) ||
+		(header.cylinderSlices != (uint32_t)meshes.GetCylinderTessellation()))
+	{
+		return false;
+	}
+
+	const int objectCount = (int)objects.Count();
+	std::vector<STATIC_GROUP> groups;
+	std::vector<MESH_DATA> meshData;
+	std::vector<int> objectGroups(objectCount, -1);
+	for (uint32_t g = 0; g < header.groupCount; g++)
+	{
+		STATIC_CACHE_GROUP cacheGroup;
+		file.read((char*)&cacheGroup, sizeof(cacheGroup));
+		if (!file || (cacheGroup.objectCount > header.objectCount))
+		{
+			return false;
+		}
+
+		STATIC_GROUP group;
+		MESH_DATA mesh;
+		std::vector<int32_t> groupObjects(cacheGroup.objectCount);
+		mesh.vertices.resize(cacheGroup.vertexCount);
+		mesh.indices.resize(cacheGroup.indexCount);
+		file.read((char*)groupObjects.data(), groupObjects.size() * sizeof(int32_t));
+		file.read((char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(MESH_VERTEX));
+		file.read((char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+		if (!file)
+		{
+			return false;
+		}
+
+		for (size_t j = 0; j < groupObjects.size(); j++)
+		{
+			int object = groupObjects[j];
+			if ((object < 0) || (object >= objectCount) || (objectGroups[object] >= 0))
+			{
+				return false;
+			}
+			objectGroups[object] = (int)groups.size();
+			group.objects.push_back(object);
+		}
+		for (size_t j = 0; j < mesh.indices.size(); j++)
+		{
+			if (mesh.indices[j] >= mesh.vertices.size())
+			{
+				return false;
+			}
+		}
+		group.meshID = -1;
+		group.bBaked = true;
+		groups.push_back(group);
+		meshData.push_back(mesh);
+	}
+
+	// only add the meshes once the whole file is known to be good
+	if (meshes.GetMeshCount() + (int)meshData.size() > MAX_STATIC_MESHES)
+	{
+		return false;
+	}
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		groups[g].meshID = meshes.AddMesh(meshData[g]);
+	}
+
+	m_groups.swap(groups);
+	m_objectGroups.swap(objectGroups);
+	return(!m_groups.empty());
+}
+
+/***********************************************************
+ *  SaveCache()
+ *
+ *  This method is used for writing the baked groups and
+ *  their merged meshes to a file.
+ ***********************************************************/
+bool StaticGeometry::SaveCache(const char* filename, const MeshLibrary& meshes) const
+{
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Could not write baked geometry file:" << filename << std::endl;
+		return false;
+	}
+
+	STATIC_CACHE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STATIC_CACHE_MAGIC, sizeof(header.magic));
+	header.version = STATIC_CACHE_VERSION;
+	header.objectCount = (uint32_t)m_objectGroups.size();
+	header.groupCount = (uint32_t)GetBakedGroupCount();
+	header.meshVersion = MESH_GENERATION_VERSION;
+	header.cylinderSlices = (uint32_t)meshes.GetCylinderTessellation();
+	file.write((const char*)&header, sizeof(header));
+
+	for (size_t g = 0; g < m_groups.size(); g++)
+	{
+		const STATIC_GROUP& group = m_groups[g];
+		if (!group.bBaked)
+		{
+			continue;
+		}
+
+		const MESH_DATA& mesh = meshes.GetMeshData(group.meshID);
+		std::vector<int32_t> groupObjects(group.objects.begin(), group.objects.end());
+
+		STATIC_CACHE_GROUP cacheGroup;
+		cacheGroup.objectCount = (uint32_t)groupObjects.size();
+		cacheGroup.vertexCount = (uint32_t)mesh.vertices.size();
+		cacheGroup.indexCount = (uint32_t)mesh.indices.size();
+		file.write((const char*)&cacheGroup, sizeof(cacheGroup));
+		file.write((const char*)groupObjects.data(), groupObjects.size() * sizeof(int32_t));
+		file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(MESH_VERTEX));
+		file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+	}
+
+	return(file.good());
+}
+
+/***********************************************************
+ *  Unbake()
+ *
+ *  This method is used for drawing an object on its own
+ *  again, so it can be moved.  The other objects of its group
+ *  stay baked: their mesh is merged again from the current
+ *  transforms, which must still be the ones the group was
+ *  baked with, and takes the ID and range of the old merged
+ *  mesh.  A group left with a single object is not worth a
+ *  mesh and is released.  The draw list has to be built
+ *  again afterwards.
+ ***********************************************************/
+bool StaticGeometry::Unbake(int object, const SCENE_DRAW_LIST& objects, const TransformHierarchy& transforms, MeshLibrary& meshes)
+{
+	if (!IsBaked(object))
+	{
+		return false;
+	}
+
+	STATIC_GROUP& group = m_groups[m_objectGroups[object]];
+	group.objects.erase(std::find(group.objects.begin(), group.objects.end(), object));
+	m_objectGroups[object] = -1;
+	meshes.ReleaseMesh(group.meshID);
+	group.meshID = -1;
+
+	if (group.objects.size() < 2)
+	{
+		for (size_t j = 0; j < group.objects.size(); j++)
+		{
+			m_objectGroups[group.objects[j]] = -1;
+		}
+		group.objects.clear();
+		group.bBaked = false;
+		return true;
+	}
+
+	// the merged mesh only gets smaller, so a released range,
+	// at worst the one just released, has room for it
+	MESH_DATA merged;
+	for (size_t j = 0; j < group.objects.size(); j++)
+	{
+		AppendObject(objects, group.objects[j], transforms, meshes, merged);
+	}
+	group.meshID = meshes.AddMesh(merged);
+	return true;
+}
+
+/***********************************************************
+ *  IsBaked()
+ *
+ *  This method is used for checking whether an object is
+ *  drawn as part of a merged mesh.
+ ***********************************************************/
+bool StaticGeometry::IsBaked(int object) const
+{
+	if ((object < 0) || (object >= (int)m_objectGroups.size()))
+	{
+		return false;
+	}
+
+	int group = m_objectGroups[object];
+	return (group >= 0) && m_groups[group].bBaked;
+}
+
+/***********************************************************
+ *  BuildDrawList()
+ *
+ *  This method is used for filling the draw list with one
+ *  object per baked group, drawn through the passed in
+ *  identity node, followed by every object that is drawn on
+ *  its own.
+ ***********************************************************/
+void StaticGeometry::BuildDrawList(const SCENE_DRAW_LIST& objects, int bakedNode, SCENE_DRAW_LIST& drawList) const
+{
+	const int objectCount = (int)objects.Count();
+
+	drawList.Clear();
+	drawList.Reserve(objectCount);
+	for (size_t g = 0; g < m_groups.size(); g++)
+	{
+		const STATIC_GROUP& group = m_groups[g];
+		if (!group.bBaked)
+		{
+			continue;
+		}
+
+		const int first = group.objects[0];
+		drawList.meshIDs.push_back((uint8_t)group.meshID);
+		drawList.materialIDs.push_back(objects.materialIDs[first]);
+		drawList.textureIDs.push_back(objects.textureIDs[first]);
+		drawList.colors.push_back(objects.colors[first]);
+		drawList.uvScales.push_back(glm::vec2(1.0f));
+		drawList.nodeIDs.push_back(bakedNode);
+	}
+
+	for (int i = 0; i < objectCount; i++)
+	{
+		if (IsBaked(i))
+		{
+			continue;
+		}
+
+		drawList.meshIDs.push_back(objects.meshIDs[i]);
+		drawList.materialIDs.push_back(objects.materialIDs[i]);
+		drawList.textureIDs.push_back(objects.textureIDs[i]);
+		drawList.colors.push_back(objects.colors[i]);
+		drawList.uvScales.push_back(objects.uvScales[i]);
+		drawList.nodeIDs.push_back(objects.nodeIDs[i]);
+	}
+}
+
+/***********************************************************
+ *  GetBakedGroupCount()
+ *
+ *  This method is used for counting the merged meshes that
+ *  are drawn.
+ ***********************************************************/
+int StaticGeometry::GetBakedGroupCount() const
+{
+	int count = 0;
+	for (size_t g = 0; g < m_groups.size(); g++)
+	{
+		count += m_groups[g].bBaked ? 1 : 0;
+	}
+	return count;
+}
+
+/***********************************************************
+ *  GetBakedObjectCount()
+ *
+ *  This method is used for counting the objects drawn as part
+ *  of a merged mesh.
+ ***********************************************************/
+int StaticGeometry::GetBakedObjectCount() const
+{
+	int count = 0;
+	for (size_t g = 0; g < m_groups.size(); g++)
+	{
+		count += m_groups[g].bBaked ? (int)m_groups[g].objects.size() : 0;
+	}
+	return count;
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// staticgeometry.h
+// ============
+// merge static objects that draw alike into pre-transformed meshes
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneFile.h"
+#include "MeshLibrary.h"
+#include "TransformHierarchy.h"
+
+#include <vector>
+
+/***********************************************************
+ *  StaticGeometry
+ *
+ *  This class groups the scene objects that share a material,
+ *  texture and color, transforms their vertices into world
+ *  space with the UV scale applied, and adds every group of
+ *  two or more objects to the mesh library as one mesh.  The
+ *  draw list then holds one object per baked group, drawn
+ *  with an identity transform, followed by every object that
+ *  was not baked.  See-through objects are never baked since
+ *  they must be sorted by depth one by one.
+ *
+ *  Un-baking an object takes it out of its group and merges
+ *  the rest of the group again into the range of the old
+ *  mesh, a group left with one object is released.  An object
+ *  has to be un-baked before its transform changes.
+ ***********************************************************/
+class StaticGeometry
+{
+public:
+	// constructor
+	StaticGeometry();
+
+	// forget every group
+	void Clear();
+	// group the passed in objects and add a merged mesh per
+	// group, false when nothing was baked
+	bool Bake(const SCENE_DRAW_LIST& objects, const TransformHierarchy& transforms, MeshLibrary& meshes);
+	// read the groups and their merged meshes from a file
+	// written by SaveCache(), false when it does not match
+	bool LoadCache(const char* filename, const SCENE_DRAW_LIST& objects, MeshLibrary& meshes);
+	bool SaveCache(const char* filename, const MeshLibrary& meshes) const;
+
+	// draw an object on its own again and merge the rest of its
+	// group without it, false when the object was not baked
+	bool Unbake(int object, const SCENE_DRAW_LIST& objects, const TransformHierarchy& transforms, MeshLibrary& meshes);
+	bool IsBaked(int object) const;
+
+	// fill the draw list with the baked groups, which use the
+	// passed in node, and the objects that are not baked
+	void BuildDrawList(const SCENE_DRAW_LIST& objects, int bakedNode, SCENE_DRAW_LIST& drawList) const;
+
+	int GetBakedGroupCount() const;
+	int GetBakedObjectCount() const;
+
+private:
+	// objects merged into one mesh
+	struct STATIC_GROUP
+	{
+		std::vector<int> objects;
+		int meshID;
+		bool bBaked;
+	};
+
+	std::vector<STATIC_GROUP> m_groups;
+	// group of every object, -1 for an object that is not in one
+	std::vector<int> m_objectGroups;
+
+	// add the transformed vertices and indices of an object
+	static void AppendObject(
+		const SCENE_DRAW_LIST& objects,
+		int object,
+		const TransformHierarchy& transforms,
+		const MeshLibrary& meshes,
+		MESH_DATA& merged);
+};
@@ -0,0 +1,516 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.cpp
+// ============
+// block-compressed, pre-mipmapped copies of the source images
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+
+#include "stb_image.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	const char CACHE_MAGIC[4] = { 'T', 'X', 'B', 'C' };
+	const uint32_t CACHE_VERSION = 1;
+
+	// file header, every level offset is relative to the end
+	// of the header
+	struct CACHE_HEADER
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t internalFormat;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint64_t levelOffsets[MAX_CACHE_LEVELS];
+		uint64_t levelSizes[MAX_CACHE_LEVELS];
+	};
+
+	uint16_t PackRGB565(int r, int g, int b)
+	{
+		return (uint16_t)(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+	}
+
+	void UnpackRGB565(uint16_t color, int rgb[3])
+	{
+		int r = (color >> 11) & 31;
+		int g = (color >> 5) & 63;
+		int b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	void WriteLE16(unsigned char* out, uint16_t value)
+	{
+		out[0] = (unsigned char)(value & 0xFF);
+		out[1] = (unsigned char)(value >> 8);
+	}
+
+	/***********************************************************
+	 *  EncodeColorBlock()
+	 *
+	 *  Compress the colors of a 4x4 RGBA block into a BC1 block.
+	 *  The endpoints are the corners of the color bounding box,
+	 *  picked along the diagonal the colors actually follow and
+	 *  pulled in slightly, and every pixel takes the nearest of
+	 *  the four palette colors.
+	 ***********************************************************/
+	void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		int minColor[3] = { 255, 255, 255 };
+		int maxColor[3] = { 0, 0, 0 };
+		int mean[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				int value = block[i * 4 + c];
+				minColor[c] = (value < minColor[c]) ? value : minColor[c];
+				maxColor[c] = (value > maxColor[c]) ? value : maxColor[c];
+				mean[c] += value;
+			}
+		}
+
+		// flip red or blue when they fall while green rises, so the
+		// endpoints sit on the right diagonal of the box
+		int covarianceRG = 0;
+		int covarianceBG = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int g = block[i * 4 + 1] * 16 - mean[1];
+			covarianceRG += (block[i * 4] * 16 - mean[0]) * g;
+			covarianceBG += (block[i * 4 + 2] * 16 - mean[2]) * g;
+		}
+		int start[3] = { maxColor[0], maxColor[1], maxColor[2] };
+		int end[3] = { minColor[0], minColor[1], minColor[2] };
+		if (covarianceRG < 0)
+		{
+			start[0] = minColor[0];
+			end[0] = maxColor[0];
+		}
+		if (covarianceBG < 0)
+		{
+			start[2] = minColor[2];
+			end[2] = maxColor[2];
+		}
+
+		// pull the endpoints in by 1/16 of the range
+		for (int c = 0; c < 3; c++)
+		{
+			int inset = (start[c] - end[c]) / 16;
+			start[c] -= inset;
+			end[c] += inset;
+		}
+
+		uint16_t color0 = PackRGB565(start[0], start[1], start[2]);
+		uint16_t color1 = PackRGB565(end[0], end[1], end[2]);
+		if (color0 < color1)
+		{
+			uint16_t swap = color0;
+			color0 = color1;
+			color1 = swap;
+		}
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			// four color mode needs color0 > color1
+			int palette[4][3];
+			UnpackRGB565(color0, palette[0]);
+			UnpackRGB565(color1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 0x7FFFFFFF;
+				for (int p = 0; p < 4; p++)
+				{
+					int distance = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						int delta = block[i * 4 + c] - palette[p][c];
+						distance += delta * delta;
+					}
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (uint32_t)best << (i * 2);
+			}
+		}
+
+		WriteLE16(out, color0);
+		WriteLE16(out + 2, color1);
+		out[4] = (unsigned char)(indices & 0xFF);
+		out[5] = (unsigned char)((indices >> 8) & 0xFF);
+		out[6] = (unsigned char)((indices >> 16) & 0xFF);
+		out[7] = (unsigned char)((indices >> 24) & 0xFF);
+	}
+
+	/***********************************************************
+	 *  EncodeAlphaBlock()
+	 *
+	 *  Compress the alpha of a 4x4 RGBA block into the alpha
+	 *  half of a BC3 block, with the eight value palette between
+	 *  the smallest and largest alpha.
+	 ***********************************************************/
+	void EncodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+	{
+		int alpha0 = 0;
+		int alpha1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			int value = block[i * 4 + 3];
+			alpha0 = (value > alpha0) ? value : alpha0;
+			alpha1 = (value < alpha1) ? value : alpha1;
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			int palette[8];
+			palette[0] = alpha0;
+			palette[1] = alpha1;
+			for (int p = 2; p < 8; p++)
+			{
+				palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+			}
+
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					int distance = block[i * 4 + 3] - palette[p];
+					distance = (distance < 0) ? -distance : distance;
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+
+		out[0] = (unsigned char)alpha0;
+		out[1] = (unsigned char)alpha1;
+		for (int i = 0; i < 6; i++)
+		{
+			out[2 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	// compress one RGBA image level and append it to the output
+	void CompressLevel(const unsigned char* pixels, int width, int height, bool bAlpha, std::vector<unsigned char>& output)
+	{
+		const int blockSize = bAlpha ? 16 : 8;
+		const int blocksWide = (width + 3) / 4;
+		const int blocksHigh = (height + 3) / 4;
+		size_t offset = output.size();
+		output.resize(offset + (size_t)blocksWide * blocksHigh * blockSize);
+
+		unsigned char block[64];
+		for (int by = 0; by < blocksHigh; by++)
+		{
+			for (int bx = 0; bx < blocksWide; bx++)
+			{
+				// copy the block, repeating the edge pixels of levels
+				// that are not a multiple of four
+				for (int y = 0; y < 4; y++)
+				{
+					int sourceY = (by * 4 + y < height) ? by * 4 + y : height - 1;
+					for (int x = 0; x < 4; x++)
+					{
+						int sourceX = (bx * 4 + x < width) ? bx * 4 + x : width - 1;
+						memcpy(&block[(y * 4 + x) * 4], &pixels[((size_t)sourceY * width + sourceX) * 4], 4);
+					}
+				}
+
+				unsigned char* out = &output[offset];
+				if (bAlpha)
+				{
+					EncodeAlphaBlock(block, out);
+					out += 8;
+				}
+				EncodeColorBlock(block, out);
+				offset += blockSize;
+			}
+		}
+	}
+
+	// halve an RGBA image with a box filter
+	void Downsample(const std::vector<unsigned char>& source, int width, int height,
+		std::vector<unsigned char>& destination, int newWidth, int newHeight)
+	{
+		destination.resize((size_t)newWidth * newHeight * 4);
+		for (int y = 0; y < newHeight; y++)
+		{
+			int y0 = y * 2;
+			int y1 = (y0 + 1 < height) ? y0 + 1 : y0;
+			for (int x = 0; x < newWidth; x++)
+			{
+				int x0 = x * 2;
+				int x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+				for (int c = 0; c < 4; c++)
+				{
+					int sum = source[((size_t)y0 * width + x0) * 4 + c] +
+						source[((size_t)y0 * width + x1) * 4 + c] +
+						source[((size_t)y1 * width + x0) * 4 + c] +
+						source[((size_t)y1 * width + x1) * 4 + c];
+					destination[((size_t)y * newWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	void MakeDirectory(const std::string& directory)
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+}
+
+/***********************************************************
+ *  TextureCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureCache::TextureCache()
+{
+	m_directory = "texturecache";
+}
+
+/***********************************************************
+ *  GetCacheFilename()
+ *
+ *  This method is used for getting the cache file of a
+ *  source image.  The whole source path goes into the name
+ *  so images with the same file name do not collide.
+ ***********************************************************/
+std::string TextureCache::GetCacheFilename(const std::string& sourceFilename) const
+{
+	std::string name = sourceFilename;
+	for (size_t i = 0; i < name.size(); i++)
+	{
+		char c = name[i];
+		bool bKeep = ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+			((c >= '0') && (c <= '9')) || (c == '-') || (c == '_');
+		if (!bKeep)
+		{
+			name[i] = '_';
+		}
+	}
+	return m_directory + "/" + name + ".btex";
+}
+
+/***********************************************************
+ *  IsCurrent()
+ *
+ *  This method is used for checking that a source image has
+ *  a cache entry at least as new as itself.  An entry whose
+ *  source is missing is still used, so the cache can ship
+ *  without the source images.
+ ***********************************************************/
+bool TextureCache::IsCurrent(const std::string& sourceFilename) const
+{
+	struct stat cacheInfo;
+	struct stat sourceInfo;
+	if (stat(GetCacheFilename(sourceFilename).c_str(), &cacheInfo) != 0)
+		return false;
+	if (stat(sourceFilename.c_str(), &sourceInfo) != 0)
+		return true;
+	return (cacheInfo.st_mtime >= sourceInfo.st_mtime);
+}
+
+/***********************************************************
+ *  ReadHeader()
+ ***********************************************************/
+bool TextureCache::ReadHeader(const std::string& sourceFilename, CACHED_TEXTURE& texture) const
+{
+	return ReadFile(sourceFilename, texture, false);
+}
+
+/***********************************************************
+ *  Load()
+ ***********************************************************/
+bool TextureCache::Load(const std::string& sourceFilename, CACHED_TEXTURE& texture) const
+{
+	return ReadFile(sourceFilename, texture, true);
+}
+
+/***********************************************************
+ *  ReadFile()
+ *
+ *  This method is used for reading a cache entry when it is
+ *  current.  The header is checked against the data size so
+ *  a truncated file is rejected instead of uploaded.
+ ***********************************************************/
+bool TextureCache::ReadFile(const std::string& sourceFilename, CACHED_TEXTURE& texture, bool bReadData) const
+{
+	if (!IsCurrent(sourceFilename))
+	{
+		return(false);
+	}
+
+	FILE* file = fopen(GetCacheFilename(sourceFilename).c_str(), "rb");
+	if (NULL == file)
+	{
+		return(false);
+	}
+
+	CACHE_HEADER header;
+	bool bValid = (fread(&header, sizeof(header), 1, file) == 1) &&
+		(memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0) &&
+		(header.version == CACHE_VERSION) &&
+		(header.levelCount > 0) && (header.levelCount <= (uint32_t)MAX_CACHE_LEVELS);
+
+	size_t dataSize = 0;
+	if (bValid)
+	{
+		texture.internalFormat = (GLenum)header.internalFormat;
+		texture.width = (int)header.width;
+		texture.height = (int)header.height;
+		texture.levelCount = (int)header.levelCount;
+		for (int i = 0; i < texture.levelCount; i++)
+		{
+			texture.levelOffsets[i] = (size_t)header.levelOffsets[i];
+			texture.levelSizes[i] = (size_t)header.levelSizes[i];
+			if (texture.levelOffsets[i] + texture.levelSizes[i] > dataSize)
+			{
+				dataSize = texture.levelOffsets[i] + texture.levelSizes[i];
+			}
+		}
+	}
+
+	if (bValid && bReadData)
+	{
+		texture.data.resize(dataSize);
+		bValid = (fread(texture.data.data(), 1, dataSize, file) == dataSize);
+	}
+	fclose(file);
+
+	if (!bValid)
+	{
+		std::cout << "Ignoring invalid texture cache entry for:" << sourceFilename << std::endl;
+	}
+	return(bValid);
+}
+
+/***********************************************************
+ *  Bake()
+ *
+ *  This method is used for building the cache entry of a
+ *  source image.  The image is loaded flipped, the same way
+ *  the runtime loads it, then every mip level down to 1x1 is
+ *  box filtered and block compressed.
+ ***********************************************************/
+bool TextureCache::Bake(const std::string& sourceFilename) const
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char* image = stbi_load(sourceFilename.c_str(), &width, &height, &colorChannels, 4);
+	if (NULL == image)
+	{
+		std::cout << "Could not load image:" << sourceFilename << std::endl;
+		return(false);
+	}
+
+	std::vector<unsigned char> level(image, image + (size_t)width * height * 4);
+	stbi_image_free(image);
+
+	// BC3 only when some pixel is not fully opaque
+	bool bAlpha = false;
+	for (size_t i = 3; i < level.size(); i += 4)
+	{
+		if (level[i] != 255)
+		{
+			bAlpha = true;
+			break;
+		}
+	}
+
+	CACHE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.internalFormat = bAlpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	header.width = (uint32_t)width;
+	header.height = (uint32_t)height;
+
+	std::vector<unsigned char> data;
+	std::vector<unsigned char> nextLevel;
+	int levelWidth = width;
+	int levelHeight = height;
+	for (;;)
+	{
+		size_t offset = data.size();
+		CompressLevel(level.data(), levelWidth, levelHeight, bAlpha, data);
+		header.levelOffsets[header.levelCount] = offset;
+		header.levelSizes[header.levelCount] = data.size() - offset;
+		header.levelCount++;
+
+		if (((levelWidth == 1) && (levelHeight == 1)) || (header.levelCount == (uint32_t)MAX_CACHE_LEVELS))
+		{
+			break;
+		}
+
+		int nextWidth = (levelWidth > 1) ? levelWidth / 2 : 1;
+		int nextHeight = (levelHeight > 1) ? levelHeight / 2 : 1;
+		Downsample(level, levelWidth, levelHeight, nextLevel, nextWidth, nextHeight);
+		level.swap(nextLevel);
+		levelWidth = nextWidth;
+		levelHeight = nextHeight;
+	}
+
+	MakeDirectory(m_directory);
+	std::string cacheFilename = GetCacheFilename(sourceFilename);
+	FILE* file = fopen(cacheFilename.c_str(), "wb");
+	if (NULL == file)
+	{
+		std::cout << "Could not write texture cache file:" << cacheFilename << std::endl;
+		return(false);
+	}
+	bool bWritten = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+		(fwrite(data.data(), 1, data.size(), file) == data.size());
+	fclose(file);
+
+	if (!bWritten)
+	{
+		std::cout << "Could not write texture cache file:" << cacheFilename << std::endl;
+		remove(cacheFilename.c_str());
+		return(false);
+	}
+
+	std::cout << "Baked texture:" << sourceFilename << " -> " << cacheFilename
+		<< ", " << (bAlpha ? "BC3" : "BC1") << ", levels:" << header.levelCount
+		<< ", bytes:" << data.size() << std::endl;
+	return(true);
+}
@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.h
+// ============
+// block-compressed, pre-mipmapped copies of the source images
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// the S3TC formats are an extension, GLEW normally defines them
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// a full mip chain of a 32768 pixel image fits
+const int MAX_CACHE_LEVELS = 16;
+
+/***********************************************************
+ *  CACHED_TEXTURE
+ *
+ *  A compressed image with its whole mip chain.  The levels
+ *  are stored back to back in data, largest first, exactly
+ *  as glCompressedTexSubImage3D expects them.
+ ***********************************************************/
+struct CACHED_TEXTURE
+{
+	GLenum internalFormat;
+	int width;
+	int height;
+	int levelCount;
+	size_t levelOffsets[MAX_CACHE_LEVELS];
+	size_t levelSizes[MAX_CACHE_LEVELS];
+	std::vector<unsigned char> data;
+};
+
+/***********************************************************
+ *  TextureCache
+ *
+ *  This class converts source images into BC1, or BC3 when
+ *  the image has transparency, with every mip level built
+ *  offline, and stores them in a cache directory.  Each cache
+ *  file holds a small header with the format and the offset
+ *  and size of every level, like a KTX2 level index, followed
+ *  by the level data.  An entry is only used while it is
+ *  newer than its source image.
+ ***********************************************************/
+class TextureCache
+{
+public:
+	// constructor
+	TextureCache();
+
+	// the cache file used for a source image
+	std::string GetCacheFilename(const std::string& sourceFilename) const;
+	// true when the source has a cache entry newer than itself
+	bool IsCurrent(const std::string& sourceFilename) const;
+
+	// read the format, size and level index without the data
+	bool ReadHeader(const std::string& sourceFilename, CACHED_TEXTURE& texture) const;
+	// read a whole cache entry
+	bool Load(const std::string& sourceFilename, CACHED_TEXTURE& texture) const;
+	// compress a source image into the cache
+	bool Bake(const std::string& sourceFilename) const;
+
+private:
+	std::string m_directory;
+
+	bool ReadFile(const std::string& sourceFilename, CACHED_TEXTURE& texture, bool bReadData) const;
+};
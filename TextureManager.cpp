@@ -0,0 +1,603 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturemanager.cpp
+// ============
+// load textures into layers of shared OpenGL texture arrays
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureManager.h"
+#include "ShaderUniforms.h"
+#include "Profiler.h"
+#include "GLStateCache.h"
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// the upload buffer is split into this many regions, one
+	// is filled per frame while the GPU reads the others
+	const int UPLOAD_REGIONS = 3;
+	// bytes that can be streamed into the arrays per frame
+	const size_t UPLOAD_REGION_SIZE = 8 * 1024 * 1024;
+
+	// color shown on a layer until its image is uploaded
+	const unsigned char PLACEHOLDER_COLOR[4] = { 128, 128, 128, 255 };
+}
+
+/***********************************************************
+ *  TextureManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureManager::TextureManager()
+{
+	m_bBindless = false;
+	m_pendingTextures = 0;
+	m_uploadBuffer = 0;
+	m_pUploadMemory = NULL;
+	m_uploadRegion = 0;
+	for (int i = 0; i < UPLOAD_REGIONS; i++)
+	{
+		m_uploadFences[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~TextureManager()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureManager::~TextureManager()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  AddTexture()
+ *
+ *  This method is used for queueing an image to be loaded.
+ *  Only the image header, or the cache entry header, is read
+ *  here, which is enough to pick the texture array of
+ *  matching size and format and reserve a layer in it.
+ *  Cache entries hold S3TC blocks, so without the extension
+ *  the source image is decoded instead.
+ ***********************************************************/
+int TextureManager::AddTexture(const char* filename, std::string tag)
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+	GLenum internalFormat = GL_RGBA8;
+	int mipLevels = 0;
+
+	CACHED_TEXTURE cached;
+	bool bCached = (GLEW_EXT_texture_compression_s3tc != 0) && m_cache.ReadHeader(filename, cached);
+	if (bCached)
+	{
+		width = cached.width;
+		height = cached.height;
+		internalFormat = cached.internalFormat;
+		mipLevels = cached.levelCount;
+	}
+	else if (!stbi_info(filename, &width, &height, &colorChannels))
+	{
+		std::cout << "Could not load image:" << filename << std::endl;
+		return(-1);
+	}
+
+	// find the array for this image size and format, or start a new one
+	int arraySlot = -1;
+	for (int i = 0; i < (int)m_arrays.size(); i++)
+	{
+		if ((m_arrays[i].width == width) && (m_arrays[i].height == height) &&
+			(m_arrays[i].internalFormat == internalFormat) &&
+			(!bCached || (m_arrays[i].mipLevels == mipLevels)))
+		{
+			arraySlot = i;
+			break;
+		}
+	}
+	if (arraySlot < 0)
+	{
+		if ((int)m_arrays.size() >= MAX_TEXTURE_ARRAYS)
+		{
+			std::cout << "Too many texture sizes, could not add image:" << filename << std::endl;
+			return(-1);
+		}
+
+		TEXTURE_ARRAY textureArray;
+		textureArray.ID = 0;
+		textureArray.handle = 0;
+		textureArray.internalFormat = internalFormat;
+		textureArray.width = width;
+		textureArray.height = height;
+		textureArray.layers = 0;
+		textureArray.mipLevels = bCached ? mipLevels : 0;
+		textureArray.bMipmapsDirty = false;
+		m_arrays.push_back(textureArray);
+		arraySlot = (int)m_arrays.size() - 1;
+	}
+
+	TEXTURE_ENTRY texture;
+	texture.tag = tag;
+	texture.filename = filename;
+	texture.arraySlot = arraySlot;
+	texture.layer = m_arrays[arraySlot].layers++;
+	texture.bResident = false;
+	texture.bCached = bCached;
+	m_textures.push_back(texture);
+
+	return((int)m_textures.size() - 1);
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for creating the texture arrays and
+ *  starting to decode every queued image.  The arrays are
+ *  usable as soon as this returns, every layer shows the
+ *  placeholder color until Update() uploads its image.
+ *  Images are always expanded to RGBA so images of the same
+ *  size can share an array whatever their channel count.
+ ***********************************************************/
+bool TextureManager::Build()
+{
+	m_bBindless = (GLEW_ARB_bindless_texture != 0);
+
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		TEXTURE_ARRAY& textureArray = m_arrays[i];
+		if (textureArray.ID != 0)
+		{
+			continue;
+		}
+
+		// immutable storage for the whole mip chain, cached
+		// images bring their own level count
+		if (textureArray.mipLevels == 0)
+		{
+			int largest = (textureArray.width > textureArray.height) ? textureArray.width : textureArray.height;
+			textureArray.mipLevels = 1;
+			while ((largest >>= 1) > 0)
+			{
+				textureArray.mipLevels++;
+			}
+		}
+
+		// every array stays bound to its own texture unit, uploads
+		// bind it there too so the units never need restoring
+		glGenTextures(1, &textureArray.ID);
+		g_GLState.BindTexture(TEXTURE_UNIT_ARRAYS + (int)i, GL_TEXTURE_2D_ARRAY, textureArray.ID);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, textureArray.mipLevels, textureArray.internalFormat,
+			textureArray.width, textureArray.height, textureArray.layers);
+
+		// set the texture wrapping parameters
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// set texture filtering parameters
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// fill every level of every layer with the placeholder,
+		// compressed formats cannot be cleared
+		if (textureArray.internalFormat == GL_RGBA8)
+		{
+			for (int level = 0; level < textureArray.mipLevels; level++)
+			{
+				glClearTexImage(textureArray.ID, level, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_COLOR);
+			}
+		}
+		else
+		{
+			FillCompressedPlaceholder(textureArray);
+		}
+
+		// the texture parameters are frozen once a handle exists,
+		// the contents can still be uploaded afterwards
+		if (m_bBindless)
+		{
+			textureArray.handle = glGetTextureHandleARB(textureArray.ID);
+			glMakeTextureHandleResidentARB(textureArray.handle);
+		}
+	}
+
+	if (!CreateUploadBuffer())
+	{
+		return(false);
+	}
+
+	// indicate to always flip images vertically when loaded,
+	// set before any worker starts decoding
+	stbi_set_flip_vertically_on_load(true);
+
+	m_decodePool.Start();
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].bResident)
+		{
+			continue;
+		}
+		m_pendingTextures++;
+		int texture = (int)i;
+		std::string filename = m_textures[i].filename;
+		bool bCached = m_textures[i].bCached;
+		m_decodePool.Submit([this, texture, filename, bCached]() { DecodeImage(texture, filename, bCached); });
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  FillCompressedPlaceholder()
+ *
+ *  This method is used for filling every level of every
+ *  layer of a compressed array with placeholder blocks.  A
+ *  block with both endpoints set to the placeholder color
+ *  decodes to that color whatever its indices are.
+ ***********************************************************/
+void TextureManager::FillCompressedPlaceholder(const TEXTURE_ARRAY& textureArray)
+{
+	const bool bAlpha = (textureArray.internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	const int blockSize = bAlpha ? 16 : 8;
+
+	unsigned char block[16] = { 0 };
+	unsigned char* colorBlock = block;
+	if (bAlpha)
+	{
+		block[0] = PLACEHOLDER_COLOR[3];
+		block[1] = PLACEHOLDER_COLOR[3];
+		colorBlock = block + 8;
+	}
+	uint16_t color = (uint16_t)(((PLACEHOLDER_COLOR[0] >> 3) << 11) | ((PLACEHOLDER_COLOR[1] >> 2) << 5) | (PLACEHOLDER_COLOR[2] >> 3));
+	colorBlock[0] = colorBlock[2] = (unsigned char)(color & 0xFF);
+	colorBlock[1] = colorBlock[3] = (unsigned char)(color >> 8);
+
+	// level 0 of every layer is the largest upload
+	const size_t largestLevel = (size_t)((textureArray.width + 3) / 4) * ((textureArray.height + 3) / 4) * textureArray.layers;
+	std::vector<unsigned char> blocks(largestLevel * blockSize);
+	for (size_t i = 0; i < largestLevel; i++)
+	{
+		memcpy(&blocks[i * blockSize], block, blockSize);
+	}
+
+	for (int level = 0; level < textureArray.mipLevels; level++)
+	{
+		int levelWidth = (textureArray.width >> level) > 0 ? (textureArray.width >> level) : 1;
+		int levelHeight = (textureArray.height >> level) > 0 ? (textureArray.height >> level) : 1;
+		GLsizei levelSize = (GLsizei)(((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * textureArray.layers * blockSize);
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+			levelWidth, levelHeight, textureArray.layers,
+			textureArray.internalFormat, levelSize, blocks.data());
+	}
+}
+
+/***********************************************************
+ *  CreateUploadBuffer()
+ *
+ *  This method is used for creating the pixel buffer the
+ *  decoded images are copied into.  It stays mapped for its
+ *  whole life, so an upload is a memcpy and no map call.
+ ***********************************************************/
+bool TextureManager::CreateUploadBuffer()
+{
+	if (m_uploadBuffer != 0)
+	{
+		return(true);
+	}
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = (GLsizeiptr)(UPLOAD_REGIONS * UPLOAD_REGION_SIZE);
+
+	glGenBuffers(1, &m_uploadBuffer);
+	g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+	m_pUploadMemory = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+	g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (NULL == m_pUploadMemory)
+	{
+		std::cout << "Could not map the texture upload buffer" << std::endl;
+		g_GLState.DeleteBuffers(1, &m_uploadBuffer);
+		m_uploadBuffer = 0;
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  DecodeImage()
+ *
+ *  This method runs on a worker thread.  It decodes one image,
+ *  or reads its compressed cache entry, and hands the result
+ *  over to the main thread, it must not call OpenGL.
+ ***********************************************************/
+void TextureManager::DecodeImage(int texture, std::string filename, bool bCached)
+{
+	ProfileScope profileScope("DecodeImage");
+
+	DECODED_IMAGE image;
+	image.texture = texture;
+	image.pixels = NULL;
+	image.width = 0;
+	image.height = 0;
+	image.colorChannels = 0;
+	image.bCached = false;
+
+	if (bCached)
+	{
+		image.bCached = m_cache.Load(filename, image.cached);
+		if (image.bCached)
+		{
+			image.width = image.cached.width;
+			image.height = image.cached.height;
+		}
+	}
+	else
+	{
+		image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.colorChannels, 4);
+	}
+
+	std::lock_guard<std::mutex> lock(m_decodedMutex);
+	m_decodedImages.push_back(std::move(image));
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for uploading decoded images into
+ *  their layers, called once per frame.  At most one upload
+ *  buffer region is filled per frame, so a frame never
+ *  spends long on uploads, and a region is only reused when
+ *  its fence shows the GPU finished reading it, so the CPU
+ *  never waits on the GPU.
+ ***********************************************************/
+int TextureManager::Update()
+{
+	if (m_pendingTextures == 0)
+	{
+		return(0);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_decodedMutex);
+		for (size_t i = 0; i < m_decodedImages.size(); i++)
+		{
+			m_readyImages.push_back(std::move(m_decodedImages[i]));
+		}
+		m_decodedImages.clear();
+	}
+	if (m_readyImages.empty())
+	{
+		return(0);
+	}
+
+	// skip this frame if the GPU still reads the next region
+	GLsync& fence = m_uploadFences[m_uploadRegion];
+	if (fence != 0)
+	{
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			return(0);
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	const size_t regionStart = m_uploadRegion * UPLOAD_REGION_SIZE;
+	size_t regionUsed = 0;
+	size_t uploaded = 0;
+	int resident = 0;
+
+	g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer);
+	for (; uploaded < m_readyImages.size(); uploaded++)
+	{
+		DECODED_IMAGE& image = m_readyImages[uploaded];
+		TEXTURE_ENTRY& texture = m_textures[image.texture];
+		const TEXTURE_ARRAY& textureArray = m_arrays[texture.arraySlot];
+		const size_t imageSize = image.bCached ? image.cached.data.size() : (size_t)image.width * image.height * 4;
+		const void* pixels = image.bCached ? (const void*)image.cached.data.data() : (const void*)image.pixels;
+
+		if ((pixels == NULL) || (image.bCached != texture.bCached) ||
+			(image.width != textureArray.width) || (image.height != textureArray.height))
+		{
+			std::cout << "Could not load image:" << texture.filename << std::endl;
+		}
+		else if (imageSize > UPLOAD_REGION_SIZE)
+		{
+			// too large for the buffer, upload it directly as the
+			// only upload of this frame
+			if (regionUsed > 0)
+			{
+				break;
+			}
+			g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			UploadImage(image, pixels);
+			g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer);
+			regionUsed = UPLOAD_REGION_SIZE;
+		}
+		else
+		{
+			if (regionUsed + imageSize > UPLOAD_REGION_SIZE)
+			{
+				break;
+			}
+			memcpy(m_pUploadMemory + regionStart + regionUsed, pixels, imageSize);
+			UploadImage(image, (const void*)(regionStart + regionUsed));
+			regionUsed += imageSize;
+		}
+
+		if (image.pixels != NULL)
+		{
+			stbi_image_free(image.pixels);
+			image.pixels = NULL;
+		}
+		std::vector<unsigned char>().swap(image.cached.data);
+		if (texture.bResident)
+		{
+			resident++;
+		}
+		m_pendingTextures--;
+	}
+	g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_readyImages.erase(m_readyImages.begin(), m_readyImages.begin() + uploaded);
+
+	// fence the region so it is not overwritten while in use
+	if (regionUsed > 0)
+	{
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_uploadRegion = (m_uploadRegion + 1) % UPLOAD_REGIONS;
+	}
+
+	// rebuild the mip chains of the arrays that changed
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		if (m_arrays[i].bMipmapsDirty)
+		{
+			g_GLState.BindTexture(TEXTURE_UNIT_ARRAYS + (int)i, GL_TEXTURE_2D_ARRAY, m_arrays[i].ID);
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			m_arrays[i].bMipmapsDirty = false;
+		}
+	}
+
+	return(resident);
+}
+
+/***********************************************************
+ *  UploadImage()
+ *
+ *  This method is used for copying a decoded image into its
+ *  layer.  The pixel data is an offset into the bound pixel
+ *  buffer, or a pointer when no pixel buffer is bound.
+ *  Cached images upload every level as stored, others only
+ *  fill level 0 and have their mips generated afterwards.
+ ***********************************************************/
+void TextureManager::UploadImage(const DECODED_IMAGE& image, const void* pixelData)
+{
+	TEXTURE_ENTRY& texture = m_textures[image.texture];
+	TEXTURE_ARRAY& textureArray = m_arrays[texture.arraySlot];
+
+	g_GLState.BindTexture(TEXTURE_UNIT_ARRAYS + texture.arraySlot, GL_TEXTURE_2D_ARRAY, textureArray.ID);
+	if (image.bCached)
+	{
+		const CACHED_TEXTURE& cached = image.cached;
+		const unsigned char* base = (const unsigned char*)pixelData;
+		for (int level = 0; (level < cached.levelCount) && (level < textureArray.mipLevels); level++)
+		{
+			int levelWidth = (cached.width >> level) > 0 ? (cached.width >> level) : 1;
+			int levelHeight = (cached.height >> level) > 0 ? (cached.height >> level) : 1;
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, texture.layer,
+				levelWidth, levelHeight, 1, cached.internalFormat,
+				(GLsizei)cached.levelSizes[level], base + cached.levelOffsets[level]);
+		}
+
+		std::cout << "Successfully loaded cached image:" << texture.filename << ", width:" << image.width << ", height:" << image.height << ", levels:" << cached.levelCount << ", layer:" << texture.layer << std::endl;
+	}
+	else
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, texture.layer,
+			image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixelData);
+		textureArray.bMipmapsDirty = true;
+
+		std::cout << "Successfully loaded image:" << texture.filename << ", width:" << image.width << ", height:" << image.height << ", channels:" << image.colorChannels << ", layer:" << texture.layer << std::endl;
+	}
+
+	texture.bResident = true;
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for binding each texture array to its
+ *  own texture unit.  This only needs to happen once, draws
+ *  select a texture by array slot and layer, and uploads
+ *  bind an array to the unit it already has.
+ ***********************************************************/
+void TextureManager::Bind() const
+{
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		g_GLState.BindTexture(TEXTURE_UNIT_ARRAYS + (int)i, GL_TEXTURE_2D_ARRAY, m_arrays[i].ID);
+	}
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for stopping the decoding and freeing
+ *  all the texture arrays.
+ ***********************************************************/
+void TextureManager::Destroy()
+{
+	// the workers must be done before their images are freed
+	m_decodePool.Stop();
+	for (size_t i = 0; i < m_decodedImages.size(); i++)
+	{
+		m_readyImages.push_back(std::move(m_decodedImages[i]));
+	}
+	m_decodedImages.clear();
+	for (size_t i = 0; i < m_readyImages.size(); i++)
+	{
+		stbi_image_free(m_readyImages[i].pixels);
+	}
+	m_readyImages.clear();
+	m_pendingTextures = 0;
+
+	for (int i = 0; i < UPLOAD_REGIONS; i++)
+	{
+		if (m_uploadFences[i] != 0)
+		{
+			glDeleteSync(m_uploadFences[i]);
+			m_uploadFences[i] = 0;
+		}
+	}
+	if (m_uploadBuffer != 0)
+	{
+		g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		g_GLState.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		g_GLState.DeleteBuffers(1, &m_uploadBuffer);
+		m_uploadBuffer = 0;
+		m_pUploadMemory = NULL;
+	}
+
+	for (size_t i = 0; i < m_arrays.size(); i++)
+	{
+		if (m_arrays[i].handle != 0)
+		{
+			glMakeTextureHandleNonResidentARB(m_arrays[i].handle);
+		}
+		if (m_arrays[i].ID != 0)
+		{
+			g_GLState.DeleteTextures(1, &m_arrays[i].ID);
+		}
+	}
+	m_arrays.clear();
+	m_textures.clear();
+}
+
+/***********************************************************
+ *  FindTexture()
+ *
+ *  This method is used for getting the index of a texture by
+ *  tag.  It searches by string, so it is only meant for
+ *  resolving tags while a scene is loaded.
+ ***********************************************************/
+int TextureManager::FindTexture(const std::string& tag) const
+{
+	for (size_t i = 0; i < m_textures.size(); i++)
+	{
+		if (m_textures[i].tag.compare(tag) == 0)
+		{
+			return((int)i);
+		}
+	}
+
+	return(-1);
+}
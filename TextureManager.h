@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturemanager.h
+// ============
+// load textures into layers of shared OpenGL texture arrays
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ThreadPool.h"
+#include "TextureCache.h"
+
+#include <GL/glew.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  TextureManager
+ *
+ *  This class packs every loaded image into a layer of a
+ *  GL_TEXTURE_2D_ARRAY holding images of the same size.  The
+ *  arrays are bound to their texture units once, after that
+ *  an object selects its texture with an array slot and a
+ *  layer, so there is no per-draw texture binding.  When
+ *  ARB_bindless_texture is available each array also gets a
+ *  resident bindless handle.
+ *
+ *  Images with a current entry in the texture cache are read
+ *  from it already block compressed with their mip chain,
+ *  everything else is decoded and mipmapped at runtime.
+ *
+ *  Images are decoded on worker threads.  The arrays start
+ *  out filled with a placeholder color, and Update() streams
+ *  the decoded images into their layers through a persistent
+ *  pixel buffer, a limited amount per frame.
+ ***********************************************************/
+class TextureManager
+{
+public:
+	// constructor
+	TextureManager();
+	// destructor
+	~TextureManager();
+
+	// queue an image file, returns the texture index or -1
+	int AddTexture(const char* filename, std::string tag);
+	// create the texture arrays and start decoding the images
+	bool Build();
+	// upload the images decoded since the last call, returns
+	// the number of textures that became resident
+	int Update();
+	// bind the texture arrays to their texture units
+	void Bind() const;
+	// free the texture arrays
+	void Destroy();
+
+	// find a texture index by tag, meant for load time only
+	int FindTexture(const std::string& tag) const;
+
+	int Count() const { return (int)m_textures.size(); }
+	int GetArraySlot(int texture) const { return m_textures[texture].arraySlot; }
+	int GetLayer(int texture) const { return m_textures[texture].layer; }
+	// true once the texture's image replaced the placeholder
+	bool IsResident(int texture) const { return m_textures[texture].bResident; }
+	// number of textures still being decoded or uploaded
+	int GetPendingCount() const { return m_pendingTextures; }
+	bool IsBindless() const { return m_bBindless; }
+	GLuint64 GetBindlessHandle(int texture) const { return m_arrays[m_textures[texture].arraySlot].handle; }
+
+private:
+	struct TEXTURE_ENTRY
+	{
+		std::string tag;
+		std::string filename;
+		int arraySlot;
+		int layer;
+		bool bResident;
+		// loaded from the texture cache instead of the source
+		bool bCached;
+	};
+
+	struct TEXTURE_ARRAY
+	{
+		GLuint ID;
+		GLuint64 handle;
+		GLenum internalFormat;
+		int width;
+		int height;
+		int layers;
+		int mipLevels;
+		// a layer changed, the mip chain must be generated again
+		bool bMipmapsDirty;
+	};
+
+	// an image decoded by a worker, waiting for upload
+	struct DECODED_IMAGE
+	{
+		int texture;
+		unsigned char* pixels;
+		int width;
+		int height;
+		int colorChannels;
+		// cached images come with every level already compressed
+		bool bCached;
+		CACHED_TEXTURE cached;
+	};
+
+	std::vector<TEXTURE_ENTRY> m_textures;
+	std::vector<TEXTURE_ARRAY> m_arrays;
+	bool m_bBindless;
+	TextureCache m_cache;
+
+	// decoding runs on the pool, finished images are handed
+	// back to the main thread through m_decodedImages
+	ThreadPool m_decodePool;
+	std::mutex m_decodedMutex;
+	std::vector<DECODED_IMAGE> m_decodedImages;
+	// images taken from the workers but not uploaded yet
+	std::vector<DECODED_IMAGE> m_readyImages;
+	int m_pendingTextures;
+
+	// persistently mapped pixel buffer, split into regions that
+	// are reused in turn once the GPU is done reading them
+	GLuint m_uploadBuffer;
+	unsigned char* m_pUploadMemory;
+	GLsync m_uploadFences[3];
+	int m_uploadRegion;
+
+	void DecodeImage(int texture, std::string filename, bool bCached);
+	void FillCompressedPlaceholder(const TEXTURE_ARRAY& textureArray);
+	bool CreateUploadBuffer();
+	void UploadImage(const DECODED_IMAGE& image, const void* pixelData);
+};
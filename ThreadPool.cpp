@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+// threadpool.cpp
+// ============
+// fixed set of worker threads running queued jobs
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+
+/***********************************************************
+ *  ThreadPool()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ThreadPool::ThreadPool()
+{
+	m_bStopping = false;
+}
+
+/***********************************************************
+ *  ~ThreadPool()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method is used for starting the worker threads.  It
+ *  does nothing when the pool is already running.
+ ***********************************************************/
+void ThreadPool::Start(int threadCount)
+{
+	if (!m_threads.empty())
+	{
+		return;
+	}
+
+	if (threadCount <= 0)
+	{
+		threadCount = (int)std::thread::hardware_concurrency() - 1;
+		if (threadCount < 1)
+		{
+			threadCount = 1;
+		}
+	}
+
+	m_bStopping = false;
+	for (int i = 0; i < threadCount; i++)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for stopping the worker threads.  Jobs
+ *  that have not started are dropped, running jobs finish.
+ ***********************************************************/
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStopping = true;
+		m_jobs.clear();
+	}
+	m_jobReady.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		m_threads[i].join();
+	}
+	m_threads.clear();
+}
+
+/***********************************************************
+ *  Submit()
+ ***********************************************************/
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_jobReady.notify_one();
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is run by every worker thread, it takes jobs
+ *  off the queue until the pool is stopped.
+ ***********************************************************/
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_bStopping && m_jobs.empty())
+			{
+				m_jobReady.wait(lock);
+			}
+			if (m_bStopping)
+			{
+				return;
+			}
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,49 @@
+///////////////////////////////////////////////////////////////////////////////
+// threadpool.h
+// ============
+// fixed set of worker threads running queued jobs
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  ThreadPool
+ *
+ *  This class runs queued jobs on a fixed number of worker
+ *  threads, in the order they were submitted.  Jobs must not
+ *  touch OpenGL, the context belongs to the main thread.
+ ***********************************************************/
+class ThreadPool
+{
+public:
+	// constructor
+	ThreadPool();
+	// destructor
+	~ThreadPool();
+
+	// start the worker threads, 0 uses one less than the
+	// number of hardware threads
+	void Start(int threadCount = 0);
+	// drop the queued jobs and wait for the running ones
+	void Stop();
+	// queue a job for the next free worker
+	void Submit(std::function<void()> job);
+
+	int GetThreadCount() const { return (int)m_threads.size(); }
+
+private:
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()> > m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_jobReady;
+	bool m_bStopping;
+
+	void WorkerLoop();
+};
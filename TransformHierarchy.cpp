@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformhierarchy.cpp
+// ============
+// local transforms with cached world matrices and parent/child links
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformHierarchy.h"
+
+#include <glm/gtx/transform.hpp>
+
+// declaration of local helpers
+namespace
+{
+	// build a local matrix in the same order as SetTransformations(),
+	// translation * rotationX * rotationY * rotationZ * scale
+	glm::mat4 ComposeMatrix(
+		const glm::vec3& scaleXYZ,
+		const glm::vec3& rotationDegreesXYZ,
+		const glm::vec3& positionXYZ)
+	{
+		glm::mat4 matrix = glm::translate(positionXYZ);
+		if (rotationDegreesXYZ.x != 0.0f)
+			matrix = matrix * glm::rotate(glm::radians(rotationDegreesXYZ.x), glm::vec3(1.0f, 0.0f, 0.0f));
+		if (rotationDegreesXYZ.y != 0.0f)
+			matrix = matrix * glm::rotate(glm::radians(rotationDegreesXYZ.y), glm::vec3(0.0f, 1.0f, 0.0f));
+		if (rotationDegreesXYZ.z != 0.0f)
+			matrix = matrix * glm::rotate(glm::radians(rotationDegreesXYZ.z), glm::vec3(0.0f, 0.0f, 1.0f));
+		return matrix * glm::scale(scaleXYZ);
+	}
+}
+
+/***********************************************************
+ *  TransformHierarchy()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TransformHierarchy::TransformHierarchy()
+{
+	m_firstDirty = 0;
+}
+
+/***********************************************************
+ *  Clear()
+ ***********************************************************/
+void TransformHierarchy::Clear()
+{
+	m_parents.clear();
+	m_scales.clear();
+	m_rotations.clear();
+	m_positions.clear();
+	m_worldMatrices.clear();
+	m_dirty.clear();
+	m_firstDirty = 0;
+}
+
+/***********************************************************
+ *  Reserve()
+ ***********************************************************/
+void TransformHierarchy::Reserve(size_t count)
+{
+	m_parents.reserve(count);
+	m_scales.reserve(count);
+	m_rotations.reserve(count);
+	m_positions.reserve(count);
+	m_worldMatrices.reserve(count);
+	m_dirty.reserve(count);
+}
+
+/***********************************************************
+ *  AddNode()
+ *
+ *  This method is used for adding a node to the hierarchy.
+ *  The parent must already have been added, which keeps
+ *  every parent ahead of its children in memory.
+ ***********************************************************/
+int TransformHierarchy::AddNode(
+	int parent,
+	glm::vec3 scaleXYZ,
+	glm::vec3 rotationDegreesXYZ,
+	glm::vec3 positionXYZ)
+{
+	int node = Count();
+	if (parent >= node)
+	{
+		parent = -1;
+	}
+
+	m_parents.push_back(parent);
+	m_scales.push_back(scaleXYZ);
+	m_rotations.push_back(rotationDegreesXYZ);
+	m_positions.push_back(positionXYZ);
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_dirty.push_back(1);
+	if (m_firstDirty > node)
+	{
+		m_firstDirty = node;
+	}
+
+	return(node);
+}
+
+/***********************************************************
+ *  MarkDirty()
+ *
+ *  This method is used for flagging a node so that its world
+ *  matrix and those of its descendants are recomputed.
+ ***********************************************************/
+void TransformHierarchy::MarkDirty(int node)
+{
+	m_dirty[node] = 1;
+	if (m_firstDirty > node)
+	{
+		m_firstDirty = node;
+	}
+}
+
+/***********************************************************
+ *  SetLocalTransform()
+ ***********************************************************/
+void TransformHierarchy::SetLocalTransform(
+	int node,
+	glm::vec3 scaleXYZ,
+	glm::vec3 rotationDegreesXYZ,
+	glm::vec3 positionXYZ)
+{
+	m_scales[node] = scaleXYZ;
+	m_rotations[node] = rotationDegreesXYZ;
+	m_positions[node] = positionXYZ;
+	MarkDirty(node);
+}
+
+/***********************************************************
+ *  SetLocalPosition()
+ ***********************************************************/
+void TransformHierarchy::SetLocalPosition(int node, glm::vec3 positionXYZ)
+{
+	m_positions[node] = positionXYZ;
+	MarkDirty(node);
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for recomputing the world matrices of
+ *  every dirty node and its descendants.  Nothing is done when
+ *  no node has changed since the last update.
+ ***********************************************************/
+int TransformHierarchy::Update()
+{
+	const int count = Count();
+	int updated = 0;
+
+	for (int node = m_firstDirty; node < count; node++)
+	{
+		int parent = m_parents[node];
+
+		// a child is dirty whenever its parent was recomputed,
+		// parents always come first so the flag is already set
+		if ((parent >= 0) && m_dirty[parent])
+		{
+			m_dirty[node] = 1;
+		}
+		if (!m_dirty[node])
+		{
+			continue;
+		}
+
+		glm::mat4 local = ComposeMatrix(m_scales[node], m_rotations[node], m_positions[node]);
+		m_worldMatrices[node] = (parent >= 0) ? m_worldMatrices[parent] * local : local;
+		updated++;
+	}
+
+	// clear the flags only after the pass so children could see them
+	for (int node = m_firstDirty; node < count; node++)
+	{
+		m_dirty[node] = 0;
+	}
+	m_firstDirty = count;
+
+	return(updated);
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformhierarchy.h
+// ============
+// local transforms with cached world matrices and parent/child links
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  TransformHierarchy
+ *
+ *  This class stores the local scale, rotation and position
+ *  of every node along with its cached world matrix.  Nodes
+ *  are always added after their parent, so a single front to
+ *  back pass sees every parent before its children.  Only
+ *  nodes that changed, and their descendants, are recomputed
+ *  by Update().
+ ***********************************************************/
+class TransformHierarchy
+{
+public:
+	// constructor
+	TransformHierarchy();
+
+	// remove all the nodes
+	void Clear();
+	// reserve memory for the passed in number of nodes
+	void Reserve(size_t count);
+
+	// add a node under the passed in parent, or -1 for a root,
+	// and return the index of the new node
+	int AddNode(
+		int parent,
+		glm::vec3 scaleXYZ,
+		glm::vec3 rotationDegreesXYZ,
+		glm::vec3 positionXYZ);
+
+	// change the local transform of a node
+	void SetLocalTransform(
+		int node,
+		glm::vec3 scaleXYZ,
+		glm::vec3 rotationDegreesXYZ,
+		glm::vec3 positionXYZ);
+	void SetLocalPosition(int node, glm::vec3 positionXYZ);
+
+	// recompute the world matrices of the changed subtrees and
+	// return the number of nodes that were recomputed
+	int Update();
+
+	const glm::mat4& GetWorldMatrix(int node) const { return m_worldMatrices[node]; }
+	int GetParent(int node) const { return m_parents[node]; }
+	int Count() const { return (int)m_parents.size(); }
+
+private:
+	std::vector<int> m_parents;
+	std::vector<glm::vec3> m_scales;
+	std::vector<glm::vec3> m_rotations;
+	std::vector<glm::vec3> m_positions;
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<uint8_t> m_dirty;
+	// lowest dirty node index, Count() when nothing changed
+	int m_firstDirty;
+
+	void MarkDirty(int node);
+};
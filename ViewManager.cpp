@@ -9,6 +9,8 @@
 
 #include "ViewManager.h"
 #include "Camera.h"
+#include "Profiler.h"
+#include "GLStateCache.h"
 
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
@@ -21,8 +23,6 @@ namespace
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 1000;
 	const int WINDOW_HEIGHT = 800;
-	const char* g_ViewName = "view";
-	const char* g_ProjectionName = "projection";
 
 	// camera object used for viewing and interacting with
 	// the 3D scene
@@ -43,6 +43,9 @@ namespace
 	//mouse sensitivity
 	float gMouseSensitivity = 0.1f;
 
+	// seconds between two recorded camera keys
+	const float CAMERA_KEY_INTERVAL = 0.1f;
+
 	// the following variable is false when orthographic projection
 	// is off and true when it is on
 	bool bOrthographicProjection = false;
@@ -59,6 +62,19 @@ ViewManager::ViewManager(
 	// initialize the member variables
 	m_pShaderManager = pShaderManager;
 	m_pWindow = NULL;
+	m_viewMatrix = glm::mat4(1.0f);
+	m_projectionMatrix = glm::mat4(1.0f);
+	m_width = WINDOW_WIDTH;
+	m_height = WINDOW_HEIGHT;
+	m_offscreenFramebuffer = 0;
+	m_offscreenColor = 0;
+	m_offscreenDepth = 0;
+	m_bRecording = false;
+	m_bPlaying = false;
+	m_recordStart = 0.0f;
+	m_playbackTime = 0.0f;
+	m_playbackTimestep = 1.0f / 60.0f;
+	m_recordFilename = "camera.track";
 	g_pCamera = new Camera();
 	// default camera view parameters
 	g_pCamera->Position = glm::vec3(10.0f, 8.0f, 15.0f);
@@ -78,6 +94,15 @@ ViewManager::ViewManager(
 ViewManager::~ViewManager()
 {
 	// free up allocated memory
+	if (m_offscreenFramebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_offscreenFramebuffer);
+		glDeleteRenderbuffers(1, &m_offscreenColor);
+		glDeleteRenderbuffers(1, &m_offscreenDepth);
+		m_offscreenFramebuffer = 0;
+		m_offscreenColor = 0;
+		m_offscreenDepth = 0;
+	}
 	m_pShaderManager = NULL;
 	m_pWindow = NULL;
 	if (NULL != g_pCamera)
@@ -118,14 +143,94 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	glfwSetScrollCallback(window, &ViewManager::Mouse_Scroll_Callback);
 
 	// enable blending for supporting tranparent rendering
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	g_GLState.Enable(GL_BLEND);
+	g_GLState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	m_pWindow = window;
+
+	return(window);
+}
+
+/***********************************************************
+ *  CreateOffscreenWindow()
+ *
+ *  This method is used to create a window that is never
+ *  shown, only for its OpenGL context.  Software renderers
+ *  such as Mesa llvmpipe stop at OpenGL 4.5, so a 4.5 core
+ *  context is tried when 4.6 is not available, and on an EGL
+ *  capable GLFW the context is created through EGL when no
+ *  window system context can be made.
+ ***********************************************************/
+GLFWwindow* ViewManager::CreateOffscreenWindow(const char* windowTitle, int width, int height)
+{
+	GLFWwindow* window = nullptr;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	window = glfwCreateWindow(width, height, windowTitle, NULL, NULL);
+	if (window == NULL)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		window = glfwCreateWindow(width, height, windowTitle, NULL, NULL);
+	}
+#ifdef GLFW_EGL_CONTEXT_API
+	if (window == NULL)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+		window = glfwCreateWindow(width, height, windowTitle, NULL, NULL);
+	}
+#endif
+	if (window == NULL)
+	{
+		std::cout << "Failed to create offscreen GLFW context" << std::endl;
+		glfwTerminate();
+		return NULL;
+	}
+	glfwMakeContextCurrent(window);
+
+	// enable blending for supporting tranparent rendering
+	g_GLState.Enable(GL_BLEND);
+	g_GLState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	m_pWindow = window;
+	m_width = width;
+	m_height = height;
 
 	return(window);
 }
 
+/***********************************************************
+ *  CreateOffscreenTarget()
+ *
+ *  This method is used to create the color and depth
+ *  renderbuffers rendered into instead of the hidden window,
+ *  and to bind them for every following frame.
+ ***********************************************************/
+bool ViewManager::CreateOffscreenTarget()
+{
+	glGenRenderbuffers(1, &m_offscreenColor);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenColor);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+
+	glGenRenderbuffers(1, &m_offscreenDepth);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_offscreenDepth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_offscreenFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_offscreenFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_offscreenColor);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_offscreenDepth);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+		return(false);
+	}
+
+	glViewport(0, 0, m_width, m_height);
+	return(true);
+}
+
 /***********************************************************
  *  Mouse_Position_Callback()
  *
@@ -298,6 +403,44 @@ void ViewManager::ProcessKeyboardEvents()
 	{
 		rKeyPressed = false;
 	}
+
+	//camera recording, key = F9 starts it and saves it
+	static bool f9KeyPressed = false;
+	if (glfwGetKey(m_pWindow, GLFW_KEY_F9) == GLFW_PRESS && !f9KeyPressed)
+	{
+		f9KeyPressed = true;
+		if (m_bRecording)
+		{
+			StopRecording();
+		}
+		else
+		{
+			StartRecording(m_recordFilename.c_str());
+		}
+	}
+	if (glfwGetKey(m_pWindow, GLFW_KEY_F9) == GLFW_RELEASE)
+	{
+		f9KeyPressed = false;
+	}
+
+	//profiler capture, key = F12 starts it and saves it
+	static bool f12KeyPressed = false;
+	if (glfwGetKey(m_pWindow, GLFW_KEY_F12) == GLFW_PRESS && !f12KeyPressed)
+	{
+		f12KeyPressed = true;
+		if (g_Profiler.IsCapturing())
+		{
+			g_Profiler.StopCapture("profile_trace.json");
+		}
+		else
+		{
+			g_Profiler.StartCapture();
+		}
+	}
+	if (glfwGetKey(m_pWindow, GLFW_KEY_F12) == GLFW_RELEASE)
+	{
+		f12KeyPressed = false;
+	}
 }
 
 /***********************************************************
@@ -309,6 +452,8 @@ void ViewManager::ProcessKeyboardEvents()
  ***********************************************************/
 void ViewManager::PrepareSceneView()
 {
+	ProfileScope profileScope("PrepareSceneView");
+
 	glm::mat4 view;
 	glm::mat4 projection;
 
@@ -318,8 +463,23 @@ void ViewManager::PrepareSceneView()
 	gLastFrame = currentFrame;
 
 	// process any keyboard events that may be waiting in the 
-	// event queue
-	ProcessKeyboardEvents();
+	// event queue, an offscreen run takes no input
+	if (m_offscreenFramebuffer == 0)
+	{
+		ProcessKeyboardEvents();
+	}
+
+	// a played back track moves the camera on simulated time,
+	// so every run sees the same views frame after frame
+	if (m_bPlaying)
+	{
+		ApplyPlayback();
+		m_playbackTime += m_playbackTimestep;
+	}
+	else if (m_bRecording)
+	{
+		RecordCameraKey(currentFrame, false);
+	}
 
 	// get the current view matrix from the camera
 	view = g_pCamera->GetViewMatrix();
@@ -329,7 +489,7 @@ void ViewManager::PrepareSceneView()
 	{
 		//2d
 		float orthoSize = 15.0f;
-		float aspectRatio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
+		float aspectRatio = (float)m_width / (float)m_height;
 
 		projection = glm::ortho(
 			//left
@@ -348,17 +508,136 @@ void ViewManager::PrepareSceneView()
 	}
 	else
 	{
-		projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+		projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)m_width / (GLfloat)m_height, 0.1f, 100.0f);
 	}
 
+	// keep the matrices for the scene manager
+	m_viewMatrix = view;
+	m_projectionMatrix = projection;
+
 	// if the shader manager object is valid
 	if (NULL != m_pShaderManager)
 	{
+		// the uniform locations are only looked up when the program changes
+		m_uniforms.Bind(m_pShaderManager->m_programID);
+
 		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ViewName, view);
+		m_uniforms.SetMat4(UNIFORM_VIEW, view);
 		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ProjectionName, projection);
+		m_uniforms.SetMat4(UNIFORM_PROJECTION, projection);
 		// set the view position of the camera into the shader for proper rendering
-		m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+		m_uniforms.SetVec3(UNIFORM_VIEW_POSITION, g_pCamera->Position);
+	}
+}
+
+/***********************************************************
+ *  StartRecording()
+ *
+ *  This method is used for starting a new camera track from
+ *  the live camera, a key is added every CAMERA_KEY_INTERVAL
+ *  seconds and the spline fills in between them.
+ ***********************************************************/
+void ViewManager::StartRecording(const char* filename)
+{
+	m_cameraTrack.Clear();
+	m_recordFilename = filename;
+	m_recordStart = (float)glfwGetTime();
+	m_bRecording = true;
+	m_bPlaying = false;
+
+	RecordCameraKey(m_recordStart, true);
+	std::cout << "Camera recording started" << std::endl;
+}
+
+/***********************************************************
+ *  StopRecording()
+ ***********************************************************/
+bool ViewManager::StopRecording()
+{
+	if (!m_bRecording)
+	{
+		return(false);
 	}
-}
\ No newline at end of file
+	m_bRecording = false;
+
+	// end the track exactly where the camera stopped
+	RecordCameraKey((float)glfwGetTime(), true);
+	return(m_cameraTrack.Save(m_recordFilename.c_str()));
+}
+
+/***********************************************************
+ *  RecordCameraKey()
+ *
+ *  This method is used for adding the live camera to the
+ *  recorded track once the key interval has passed, or
+ *  right away when forced.
+ ***********************************************************/
+void ViewManager::RecordCameraKey(float currentTime, bool bForce)
+{
+	float time = currentTime - m_recordStart;
+	if (!bForce && (m_cameraTrack.Count() > 0) && (time - m_cameraTrack.GetDuration() < CAMERA_KEY_INTERVAL))
+	{
+		return;
+	}
+
+	CAMERA_KEY key;
+	key.time = time;
+	key.position = g_pCamera->Position;
+	key.yaw = g_pCamera->Yaw;
+	key.pitch = g_pCamera->Pitch;
+	key.zoom = g_pCamera->Zoom;
+	key.bOrthographic = bOrthographicProjection;
+	m_cameraTrack.AddKey(key);
+}
+
+/***********************************************************
+ *  StartPlayback()
+ ***********************************************************/
+bool ViewManager::StartPlayback(const char* filename, float timestep)
+{
+	if (!m_cameraTrack.Load(filename))
+	{
+		return(false);
+	}
+
+	m_bRecording = false;
+	m_bPlaying = true;
+	m_playbackTime = 0.0f;
+	m_playbackTimestep = timestep;
+	return(true);
+}
+
+/***********************************************************
+ *  ApplyPlayback()
+ *
+ *  This method is used for setting the camera to the track
+ *  at the current playback time.
+ ***********************************************************/
+void ViewManager::ApplyPlayback()
+{
+	CAMERA_KEY key;
+	if (!m_cameraTrack.Sample(m_playbackTime, key))
+	{
+		return;
+	}
+
+	g_pCamera->Position = key.position;
+	g_pCamera->Yaw = key.yaw;
+	g_pCamera->Pitch = key.pitch;
+	g_pCamera->Zoom = key.zoom;
+	g_pCamera->updateCameraVectors();
+	bOrthographicProjection = key.bOrthographic;
+
+	// keyboard movement stays consistent with the simulated time
+	gDeltaTime = m_playbackTimestep;
+}
+
+/***********************************************************
+ *  GetViewPosition()
+ *
+ *  This method is used for getting the camera position.
+ ***********************************************************/
+glm::vec3 ViewManager::GetViewPosition() const
+{
+	return(g_pCamera->Position);
+}
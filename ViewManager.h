@@ -10,8 +10,12 @@
 #pragma once
 
 #include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include "CameraTrack.h"
 #include "camera.h"
 
+#include <string>
+
 // GLFW library
 #include "GLFW/glfw3.h" 
 
@@ -33,6 +37,35 @@ private:
 	ShaderManager* m_pShaderManager;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
+	// cached uniform locations of the active shader program
+	ShaderUniforms m_uniforms;
+	// the view and projection set up by the last PrepareSceneView()
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	// size of the rendered image
+	int m_width;
+	int m_height;
+	// framebuffer rendered into instead of the window, if any
+	GLuint m_offscreenFramebuffer;
+	GLuint m_offscreenColor;
+	GLuint m_offscreenDepth;
+
+	// camera track being recorded or played back
+	CameraTrack m_cameraTrack;
+	bool m_bRecording;
+	bool m_bPlaying;
+	// wall clock time the recording started at
+	float m_recordStart;
+	// simulated time of the playback and its step per frame
+	float m_playbackTime;
+	float m_playbackTimestep;
+	// file the F9 key saves the recording to
+	std::string m_recordFilename;
+
+	// add the current camera to the recorded track
+	void RecordCameraKey(float currentTime, bool bForce);
+	// drive the camera from the track at the playback time
+	void ApplyPlayback();
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
@@ -40,7 +73,28 @@ private:
 public:
 	// create the initial OpenGL display window
 	GLFWwindow* CreateDisplayWindow(const char* windowTitle);
+	// create a hidden window that only provides the OpenGL
+	// context for rendering offscreen at the passed in size
+	GLFWwindow* CreateOffscreenWindow(const char* windowTitle, int width, int height);
+	// create and bind the framebuffer rendered into when
+	// offscreen, needs an initialized OpenGL context
+	bool CreateOffscreenTarget();
 	
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+
+	// record the live camera into a track, saved by StopRecording()
+	void StartRecording(const char* filename);
+	bool StopRecording();
+	// replace live input with a recorded track, advanced by a
+	// fixed timestep every frame whatever the frame took
+	bool StartPlayback(const char* filename, float timestep);
+	// go back to the start of the track
+	void RestartPlayback() { m_playbackTime = 0.0f; }
+	bool IsPlaying() const { return m_bPlaying; }
+
+	// the camera of the last prepared frame
+	const glm::mat4& GetViewMatrix() const { return m_viewMatrix; }
+	const glm::mat4& GetProjectionMatrix() const { return m_projectionMatrix; }
+	glm::vec3 GetViewPosition() const;
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+#version 440 core
+
+// one thread per object, must match CULL_GROUP_SIZE in GpuCulling.h
+layout (local_size_x = 64) in;
+
+// std430 layout, must match MESH_INSTANCE in MeshLibrary.h
+struct Instance
+{
+	mat4 model;
+	vec4 color;
+	vec2 uvScale;
+	int materialIndex;
+	int textureLayer;
+	vec2 uvOffset;
+	ivec2 padding;
+};
+
+// std430 layout, must match GPU_CULL_OBJECT in GpuCulling.h
+struct CullObject
+{
+	Instance instance;
+	vec3 boundsMin;
+	uint batch;
+	vec3 boundsMax;
+	uint padding;
+};
+
+// must match DRAW_ELEMENTS_COMMAND in MeshLibrary.h
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+// binding points must match CULL_STORAGE_BINDING in GpuCulling.h
+layout (std430, binding = 4) readonly buffer ObjectBuffer
+{
+	CullObject objects[];
+};
+
+layout (std430, binding = 5) buffer CommandBuffer
+{
+	DrawCommand commands[];
+};
+
+layout (std430, binding = 6) writeonly buffer InstanceBuffer
+{
+	Instance instances[];
+};
+
+// objects culled this frame, for the debug output
+layout (std430, binding = 7) buffer StatsBuffer
+{
+	uint frustumCulled;
+	uint occlusionCulled;
+};
+
+uniform uint objectCount;
+// (normal, distance) with the normal pointing inside
+uniform vec4 frustumPlanes[6];
+
+// the farthest depth pyramid of the occluders, see HiZBuffer.h
+uniform bool bUseOcclusion;
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+
+// true when the world box touches the frustum
+bool IsInFrustum(vec3 worldCenter, vec3 worldExtent)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		vec3 normal = frustumPlanes[i].xyz;
+		float radius = dot(abs(normal), worldExtent);
+		if (dot(normal, worldCenter) + frustumPlanes[i].w + radius < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// true when the world box is behind the occluder depth at every
+// texel its screen rectangle covers
+bool IsOccluded(vec3 worldCenter, vec3 worldExtent)
+{
+	vec3 screenMin = vec3(1.0f);
+	vec3 screenMax = vec3(0.0f);
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = worldCenter + worldExtent * vec3(
+			((i & 1) != 0) ? 1.0f : -1.0f,
+			((i & 2) != 0) ? 1.0f : -1.0f,
+			((i & 4) != 0) ? 1.0f : -1.0f);
+		vec4 clip = viewProjection * vec4(corner, 1.0f);
+		// a box reaching behind the camera covers the whole view
+		if (clip.w <= 0.0f)
+		{
+			return false;
+		}
+		vec3 screen = (clip.xyz / clip.w) * 0.5f + 0.5f;
+		screenMin = min(screenMin, screen);
+		screenMax = max(screenMax, screen);
+	}
+	screenMin.xy = clamp(screenMin.xy, 0.0f, 1.0f);
+	screenMax.xy = clamp(screenMax.xy, 0.0f, 1.0f);
+
+	// the level where the rectangle is at most one texel a side,
+	// so it touches at most 2x2 texels
+	vec2 size = (screenMax.xy - screenMin.xy) * hiZSize;
+	int level = int(ceil(log2(max(max(size.x, size.y), 1.0f))));
+	level = clamp(level, 0, hiZLevels - 1);
+
+	ivec2 levelSize = textureSize(hiZ, level);
+	ivec2 first = clamp(ivec2(screenMin.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+	ivec2 last = clamp(ivec2(screenMax.xy * vec2(levelSize)), ivec2(0), levelSize - 1);
+	float farthest = max(
+		max(texelFetch(hiZ, first, level).r, texelFetch(hiZ, ivec2(last.x, first.y), level).r),
+		max(texelFetch(hiZ, ivec2(first.x, last.y), level).r, texelFetch(hiZ, last, level).r));
+
+	return screenMin.z > farthest;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= objectCount)
+	{
+		return;
+	}
+
+	CullObject object = objects[index];
+	vec3 center = (object.boundsMin + object.boundsMax) * 0.5f;
+	vec3 extent = (object.boundsMax - object.boundsMin) * 0.5f;
+
+	mat4 model = object.instance.model;
+	vec3 worldCenter = vec3(model * vec4(center, 1.0f));
+	vec3 worldExtent = abs(model[0].xyz) * extent.x +
+		abs(model[1].xyz) * extent.y +
+		abs(model[2].xyz) * extent.z;
+
+	if (!IsInFrustum(worldCenter, worldExtent))
+	{
+		atomicAdd(frustumCulled, 1u);
+		return;
+	}
+	if (bUseOcclusion && IsOccluded(worldCenter, worldExtent))
+	{
+		atomicAdd(occlusionCulled, 1u);
+		return;
+	}
+
+	// take the next free slot of the batch's instance range
+	uint slot = atomicAdd(commands[object.batch].instanceCount, 1u);
+	instances[commands[object.batch].baseInstance + slot] = object.instance;
+}
@@ -0,0 +1,6 @@
+#version 440 core
+
+// the occluder pass only writes depth
+void main()
+{
+}
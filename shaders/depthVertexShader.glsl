@@ -0,0 +1,42 @@
+#version 440 core
+// gl_BaseInstanceARB, the base instance of the draw
+#extension GL_ARB_shader_draw_parameters : require
+
+layout (location = 0) in vec3 inVertexPosition;
+
+// std430 layout, must match MESH_INSTANCE in MeshLibrary.h
+struct Instance
+{
+	mat4 model;
+	vec4 color;
+	vec2 uvScale;
+	int materialIndex;
+	int textureLayer;
+	vec2 uvOffset;
+	ivec2 padding;
+};
+
+// std430 layout, must match GPU_CULL_OBJECT in GpuCulling.h
+struct CullObject
+{
+	Instance instance;
+	vec3 boundsMin;
+	uint batch;
+	vec3 boundsMax;
+	uint padding;
+};
+
+// the culling objects, every occluder draw has the index of
+// its object as base instance
+layout (std430, binding = 4) readonly buffer ObjectBuffer
+{
+	CullObject objects[];
+};
+
+uniform mat4 viewProjection;
+
+void main()
+{
+	mat4 model = objects[gl_BaseInstanceARB + gl_InstanceID].instance.model;
+	gl_Position = viewProjection * model * vec4(inVertexPosition, 1.0f);
+}
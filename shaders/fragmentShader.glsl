@@ -0,0 +1,241 @@
+#version 440 core
+
+// use bindless texture handles when the driver supports them
+#ifdef GL_ARB_bindless_texture
+#extension GL_ARB_bindless_texture : enable
+#endif
+
+// must match SceneManager::MAX_MATERIALS
+#define MAX_MATERIALS 256
+// must match the cluster grid in LightClusters.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+// must match MAX_TEXTURE_ARRAYS in ShaderUniforms.h
+#define MAX_TEXTURE_ARRAYS 8
+
+#define LIGHT_DIRECTIONAL 0
+#define LIGHT_POINT 1
+#define LIGHT_SPOT 2
+
+// compile-time features of a program variant, see
+// ShaderVariants.h; the general program is built without them
+// and branches on the uniforms instead
+#ifndef SHADER_VARIANT
+#define VARIANT_TEXTURED 1
+#define VARIANT_LIT 1
+#define VARIANT_LOCAL_LIGHTS 1
+// -1 reads the count from numGlobalLights
+#define VARIANT_GLOBAL_LIGHTS -1
+#endif
+
+// std140 layout, must match SceneManager::GPU_MATERIAL
+struct Material
+{
+	vec3 ambientColor;
+	float ambientStrength;
+	vec3 diffuseColor;
+	float shininess;
+	vec3 specularColor;
+};
+
+// std430 layout, must match SceneManager::GPU_LIGHT
+struct LightSource
+{
+	vec3 position;
+	int type;
+	vec3 direction;
+	int enabled;
+	vec3 ambientColor;
+	float cutOff;
+	vec3 diffuseColor;
+	float outerCutOff;
+	vec3 specularColor;
+	float constant;
+	float linear;
+	float quadratic;
+	// attenuation radius, 0 when the light reaches everywhere
+	float radius;
+};
+
+// the first numGlobalLights lights reach everywhere, the rest
+// are found through the light list of the fragment's cluster
+layout (std430, binding = 0) readonly buffer LightBuffer
+{
+	LightSource lights[];
+};
+
+// offset and count of every cluster's range of lightIndices
+layout (std430, binding = 1) readonly buffer LightClusterBuffer
+{
+	uvec2 lightClusters[];
+};
+
+layout (std430, binding = 2) readonly buffer LightIndexBuffer
+{
+	uint lightIndices[];
+};
+
+layout (std140, binding = 1) uniform MaterialBlock
+{
+	Material materials[MAX_MATERIALS];
+};
+
+in vec3 fragmentPosition;
+in vec3 fragmentVertexNormal;
+in vec2 fragmentTextureCoordinate;
+flat in vec4 fragmentColor;
+flat in int fragmentMaterialIndex;
+flat in int fragmentTextureLayer;
+flat in int fragmentTextureArray;
+
+out vec4 outFragmentColor;
+
+uniform bool bUseLighting = false;
+// one texture array per image size, the array and the layer
+// come from the vertex shader
+uniform sampler2DArray objectTextures[MAX_TEXTURE_ARRAYS];
+uniform bool bUseBindless = false;
+#ifdef GL_ARB_bindless_texture
+layout (bindless_sampler) uniform sampler2DArray objectTextureBindless;
+#endif
+uniform vec3 viewPosition;
+uniform mat4 view;
+uniform int numGlobalLights = 0;
+// window pixels to cluster tiles
+uniform vec2 clusterTileScale;
+// log of the view depth to depth slice, scale and bias
+uniform vec2 clusterDepthScale;
+
+vec3 CalculateLight(LightSource light, Material material, vec3 normal, vec3 viewDirection)
+{
+	vec3 lightDirection;
+	float attenuation = 1.0f;
+
+	if (light.type == LIGHT_DIRECTIONAL)
+	{
+		lightDirection = normalize(-light.direction);
+	}
+	else
+	{
+		float distance = length(light.position - fragmentPosition);
+		// the cluster lists only hold the light inside its radius
+		if ((light.radius > 0.0f) && (distance > light.radius))
+		{
+			return vec3(0.0f);
+		}
+		lightDirection = normalize(light.position - fragmentPosition);
+		attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+	}
+
+	// ambient
+	vec3 ambient = light.ambientColor * material.ambientColor * material.ambientStrength;
+
+	// diffuse
+	float diffuseImpact = max(dot(normal, lightDirection), 0.0f);
+	vec3 diffuse = light.diffuseColor * diffuseImpact * material.diffuseColor;
+
+	// specular
+	vec3 reflectDirection = reflect(-lightDirection, normal);
+	float specularComponent = pow(max(dot(viewDirection, reflectDirection), 0.0f), material.shininess);
+	vec3 specular = light.specularColor * specularComponent * material.specularColor;
+
+	if (light.type == LIGHT_SPOT)
+	{
+		float theta = dot(lightDirection, normalize(-light.direction));
+		float epsilon = light.cutOff - light.outerCutOff;
+		float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
+		diffuse *= intensity;
+		specular *= intensity;
+	}
+
+	return (ambient + diffuse + specular) * attenuation;
+}
+
+uint FindCluster()
+{
+	// view depth, the camera looks down -z
+	float viewDepth = -dot(vec4(view[0][2], view[1][2], view[2][2], view[3][2]), vec4(fragmentPosition, 1.0f));
+	int slice = int(floor(log(max(viewDepth, 1e-4f)) * clusterDepthScale.x + clusterDepthScale.y));
+	ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy * clusterTileScale), slice);
+	cluster = clamp(cluster, ivec3(0), ivec3(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1, CLUSTER_GRID_Z - 1));
+	return uint(cluster.x + CLUSTER_GRID_X * (cluster.y + CLUSTER_GRID_Y * cluster.z));
+}
+
+vec4 SampleObjectTexture(vec2 textureCoordinate)
+{
+	vec3 coordinate = vec3(textureCoordinate, float(fragmentTextureLayer));
+	// the variants only draw multi-draw batches, which never
+	// use a bindless handle
+#if defined(GL_ARB_bindless_texture) && !defined(SHADER_VARIANT)
+	if (bUseBindless == true)
+	{
+		return texture(objectTextureBindless, coordinate);
+	}
+#endif
+	// fragments of different draws of one multi-draw call can be
+	// shaded together, so the array index is not dynamically
+	// uniform; every array is tested with a constant index and
+	// the derivatives are taken before the branch
+	vec2 gradientX = dFdx(textureCoordinate);
+	vec2 gradientY = dFdy(textureCoordinate);
+	for (int i = 0; i < MAX_TEXTURE_ARRAYS; i++)
+	{
+		if (i == fragmentTextureArray)
+		{
+			return textureGrad(objectTextures[i], coordinate, gradientX, gradientY);
+		}
+	}
+	return fragmentColor;
+}
+
+void main()
+{
+	vec4 baseColor = fragmentColor;
+#if VARIANT_TEXTURED
+	// a texture still streaming in has no layer yet
+	if (fragmentTextureLayer >= 0)
+	{
+		baseColor = SampleObjectTexture(fragmentTextureCoordinate);
+	}
+#endif
+
+#if VARIANT_LIT
+#ifndef SHADER_VARIANT
+	if (bUseLighting == false)
+	{
+		outFragmentColor = baseColor;
+		return;
+	}
+#endif
+
+	vec3 normal = normalize(fragmentVertexNormal);
+	vec3 viewDirection = normalize(viewPosition - fragmentPosition);
+
+	Material material = materials[fragmentMaterialIndex];
+
+	vec3 lighting = vec3(0.0f);
+#if VARIANT_GLOBAL_LIGHTS >= 0
+	// a fixed count the compiler can unroll
+	for (int i = 0; i < VARIANT_GLOBAL_LIGHTS; i++)
+#else
+	for (int i = 0; i < numGlobalLights; i++)
+#endif
+	{
+		lighting += CalculateLight(lights[i], material, normal, viewDirection);
+	}
+
+#if VARIANT_LOCAL_LIGHTS
+	// only the local lights that reach this fragment's cluster
+	uvec2 cluster = lightClusters[FindCluster()];
+	for (uint i = 0u; i < cluster.y; i++)
+	{
+		lighting += CalculateLight(lights[lightIndices[cluster.x + i]], material, normal, viewDirection);
+	}
+#endif
+
+	outFragmentColor = vec4(lighting * baseColor.rgb, baseColor.a);
+#else
+	outFragmentColor = baseColor;
+#endif
+}
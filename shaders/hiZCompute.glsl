@@ -0,0 +1,41 @@
+#version 440 core
+
+// one thread per destination texel, must match PYRAMID_GROUP_SIZE
+// in HiZBuffer.cpp
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) writeonly uniform image2D destination;
+
+// the occluder depth when sourceLevel is -1, otherwise the
+// pyramid itself read at sourceLevel
+uniform sampler2D source;
+uniform int sourceLevel;
+uniform ivec2 sourceSize;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, imageSize(destination))))
+	{
+		return;
+	}
+
+	float depth;
+	if (sourceLevel < 0)
+	{
+		depth = texelFetch(source, texel, 0).r;
+	}
+	else
+	{
+		// farthest of the 2x2 block, clamped where a side of the
+		// level above was already a single texel
+		ivec2 first = texel * 2;
+		ivec2 last = sourceSize - 1;
+		float depth0 = texelFetch(source, min(first, last), sourceLevel).r;
+		float depth1 = texelFetch(source, min(first + ivec2(1, 0), last), sourceLevel).r;
+		float depth2 = texelFetch(source, min(first + ivec2(0, 1), last), sourceLevel).r;
+		float depth3 = texelFetch(source, min(first + ivec2(1, 1), last), sourceLevel).r;
+		depth = max(max(depth0, depth1), max(depth2, depth3));
+	}
+	imageStore(destination, texel, vec4(depth));
+}
@@ -0,0 +1,97 @@
+#version 440 core
+// gl_DrawIDARB, the index of a draw within a multi-draw call
+#extension GL_ARB_shader_draw_parameters : require
+
+// packed vertex, see PACKED_VERTEX in MeshLibrary.h; the position
+// is scaled back by the model matrix and the texture coordinate
+// by the UV scale and offset, the normal is octahedral encoded
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec2 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+
+// per-instance attributes, must match MESH_INSTANCE in MeshLibrary.h
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec4 instanceColor;
+layout (location = 8) in vec2 instanceUVScale;
+layout (location = 9) in ivec2 instanceMaterialLayer;
+layout (location = 10) in vec2 instanceUVOffset;
+
+out vec3 fragmentPosition;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+flat out vec4 fragmentColor;
+flat out int fragmentMaterialIndex;
+// texture array layer, -1 when the object uses its color
+flat out int fragmentTextureLayer;
+// texture array of the draw, see objectTextures
+flat out int fragmentTextureArray;
+
+// std430 layout, must match SceneManager::DRAW_PARAMETERS
+struct DrawParameters
+{
+	int textureArray;
+};
+
+layout (std430, binding = 3) readonly buffer DrawParameterBuffer
+{
+	DrawParameters drawParameters[];
+};
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// per-object values of non-instanced draws
+uniform bool bUseInstancing = false;
+// index of the first draw of the multi-draw call in drawParameters
+uniform int firstDraw = 0;
+uniform bool bUseTexture = false;
+uniform vec4 objectColor = vec4(1.0f);
+uniform ivec2 textureLayer = ivec2(0, 0);
+uniform vec2 UVscale = vec2(1.0f, 1.0f);
+uniform vec2 UVoffset = vec2(0.0f, 0.0f);
+uniform int materialIndex = 0;
+
+// unfold an octahedral encoded normal back into a unit vector
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	if (normal.z < 0.0f)
+	{
+		normal.xy = (1.0f - abs(normal.yx)) * vec2(
+			(normal.x >= 0.0f) ? 1.0f : -1.0f,
+			(normal.y >= 0.0f) ? 1.0f : -1.0f);
+	}
+	return normalize(normal);
+}
+
+void main()
+{
+	mat4 objectModel = model;
+	vec2 uvScale = UVscale;
+	vec2 uvOffset = UVoffset;
+	if (bUseInstancing == true)
+	{
+		objectModel = instanceModel;
+		uvScale = instanceUVScale;
+		uvOffset = instanceUVOffset;
+		fragmentColor = instanceColor;
+		fragmentMaterialIndex = instanceMaterialLayer.x;
+		fragmentTextureLayer = instanceMaterialLayer.y;
+		fragmentTextureArray = drawParameters[firstDraw + gl_DrawIDARB].textureArray;
+	}
+	else
+	{
+		fragmentColor = objectColor;
+		fragmentMaterialIndex = materialIndex;
+		fragmentTextureLayer = (bUseTexture == true) ? textureLayer.y : -1;
+		fragmentTextureArray = textureLayer.x;
+	}
+
+	// vertex position in world space for the lighting
+	fragmentPosition = vec3(objectModel * vec4(inVertexPosition, 1.0f));
+	gl_Position = projection * view * vec4(fragmentPosition, 1.0f);
+
+	fragmentVertexNormal = mat3(transpose(inverse(objectModel))) * DecodeOctahedral(inVertexNormal);
+	fragmentTextureCoordinate = inTextureCoordinate * uvScale + uvOffset;
+}